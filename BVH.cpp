@@ -0,0 +1,727 @@
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <array>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "Util.h"
+#include "ThreadPool.h"
+#include "BVH.h"
+
+using namespace std;
+
+
+// Below this depth the SAH may keep peeling off single primitives; past it
+// we fall back to median splits so the tree never exceeds MAX_DEPTH.
+static constexpr int SAH_MAX_DEPTH = BVH::MAX_DEPTH / 2;
+
+// Refit hands out the subtrees below this depth as tasks, which gives
+// enough tasks to balance the load while keeping their overhead small.
+static constexpr int REFIT_TASK_DEPTH = 6;
+
+// Node ranges at least this large have their bounds and bins computed by all
+// threads together; below it, whole subtrees are handed out as tasks.
+// Also used by the LBVH builder for its sort and emission.
+static constexpr int PARALLEL_BINNING_PRIMS = 1 << 16;
+static constexpr int TASK_PRIMS = 1 << 12;
+
+
+
+struct BVH::ParallelBuild
+{
+    ParallelBuild( vector<BuildPrim> &thePrims, ThreadPool &thePool )
+        : prims( thePrims ), pool( thePool ) {}
+
+    vector<BuildPrim> &prims;
+    ThreadPool &pool;
+    atomic<int> numNodes{ 1 };  // The root is allocated up front.
+    vector<uint32_t> mortonCodes;  // LBVH only, parallel to prims.
+};
+
+
+
+struct BVH::RefitResult
+{
+    BoundingBox box;
+    double interiorArea = 0.0;   // Sum of surface areas of interior nodes.
+    double leafPrimArea = 0.0;   // Sum of leaf surface areas times primitive batch counts.
+};
+
+
+
+namespace
+{
+    struct Bin
+    {
+        BoundingBox box;
+        int count = 0;
+    };
+
+    struct BinSet
+    {
+        Bin bins[3][ BVH::NUM_BINS ];
+
+        BinSet &merge( const BinSet &other )
+        {
+            for ( int a = 0; a < 3; a++ )
+                for ( int b = 0; b < BVH::NUM_BINS; b++ )
+                {
+                    bins[a][b].box.expand( other.bins[a][b].box );
+                    bins[a][b].count += other.bins[a][b].count;
+                }
+            return (*this);
+        }
+    };
+
+    // Maps centroid coordinates to numBins bins along each axis of a centroid box.
+    struct BinMapping
+    {
+        BinMapping( const BoundingBox &centroidBox, int theNumBins )
+            : numBins( theNumBins )
+        {
+            Vector3r extent = centroidBox.extent();
+            for ( int a = 0; a < 3; a++ )
+            {
+                origin[a] = centroidBox.min()[a];
+                scale[a] = ( extent[a] > 0.0 )? numBins / extent[a] : 0.0;
+            }
+        }
+
+        [[nodiscard]] int binIndex( const Vector3r &centroid, int axis ) const
+        {
+            int b = (int)( ( centroid[axis] - origin[axis] ) * scale[axis] );
+            return ( b < numBins - 1 )? b : numBins - 1;
+        }
+
+        int numBins;
+        double origin[3]{};
+        double scale[3]{};
+    };
+
+
+    // Index of the highest set bit of a nonzero value.
+    int HighestBit( uint32_t v )
+    {
+    #ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse( &index, v );
+        return (int)index;
+    #else
+        return 31 - __builtin_clz( v );
+    #endif
+    }
+}
+
+
+
+void BVH::clear()
+{
+    mNodes.clear();
+    mPrimIndices.clear();
+    mNumPrims = 0;
+    mBuildStats = BuildStats();
+    mSAHCost = 0.0;
+}
+
+
+
+void BVH::renumberPrimitives()
+{
+    mPrimIndices.clear();
+    mPrimIndices.shrink_to_fit();
+}
+
+
+
+void BVH::build( const vector<BoundingBox> &primBounds, BuildMethod method, int numThreads )
+{
+    double startTime = Util::GetCurrRealTime();
+    clear();
+    if ( primBounds.empty() ) return;
+
+    ThreadPool pool( ( method == BuildMethod::SweepSAH )? 1 : numThreads );
+    int numPrims = (int)primBounds.size();
+
+    vector<BuildPrim> prims( numPrims );
+    pool.parallelFor( 0, numPrims, [&]( int begin, int end )
+    {
+        for ( int i = begin; i < end; i++ )
+        {
+            assert( primBounds[i].isBounded() );
+            prims[i] = { primBounds[i], primBounds[i].centroid(), i };
+        }
+    } );
+
+    if ( method == BuildMethod::SweepSAH )
+    {
+        mNodes.reserve( 2 * numPrims - 1 );
+        mNodes.emplace_back();
+        subdivideSAH( prims, 0, 0, numPrims, 1 );
+    }
+    else
+    {
+        mNodes.resize( 2 * numPrims - 1 );
+        ParallelBuild parallelBuild( prims, pool );
+        if ( method == BuildMethod::BinnedSAH )
+        {
+            subdivideBinned( parallelBuild, 0, 0, numPrims, 1 );
+        }
+        else
+        {
+            sortByMortonCode( parallelBuild );
+            emitLBVH( parallelBuild, 0, 0, numPrims );
+        }
+        mNodes.resize( parallelBuild.numNodes );
+        mNodes.shrink_to_fit();
+    }
+
+    mNumPrims = numPrims;
+    mPrimIndices.resize( numPrims );
+    pool.parallelFor( 0, numPrims, [&]( int begin, int end )
+    {
+        for ( int i = begin; i < end; i++ ) mPrimIndices[i] = prims[i].index;
+    } );
+
+    pool.parallelFor( 0, (int)mNodes.size(), [&]( int begin, int end )
+    {
+        for ( int i = begin; i < end; i++ ) orderChildren( i );
+    } );
+
+    mBuildStats.buildTime = Util::GetCurrRealTime() - startTime;
+    mBuildMethod = method;
+    computeBuildStats();
+    mSAHCost = mBuildStats.sahCost;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Records which child of an interior node is larger, for the any-hit
+// traversals, which visit the larger child first since it is the more
+// likely to hold an occluder.
+//////////////////////////////////////////////////////////////////////////////
+
+void BVH::orderChildren( int nodeIndex )
+{
+    Node &node = mNodes[ nodeIndex ];
+    if ( node.count > 0 ) return;
+    node.leftIsLarger = ( mNodes[ node.first ].surfaceArea() >= mNodes[ node.first + 1 ].surfaceArea() );
+}
+
+
+
+void BVH::makeLeaf( int nodeIndex, int begin, int end )
+{
+    mNodes[ nodeIndex ].first = begin;
+    mNodes[ nodeIndex ].count = end - begin;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Splits prims[begin, end) at the position of lowest SAH cost, found by
+// sorting the centroids along each axis and sweeping the prefix and
+// suffix boxes. Creates a leaf when splitting does not pay off.
+//////////////////////////////////////////////////////////////////////////////
+
+void BVH::subdivideSAH( vector<BuildPrim> &prims, int nodeIndex, int begin, int end, int depth )
+{
+    BoundingBox box;
+    for ( int i = begin; i < end; i++ ) box.expand( prims[i].box );
+    mNodes[ nodeIndex ].setBox( box );
+
+    int count = end - begin;
+    if ( count == 1 )
+    {
+        makeLeaf( nodeIndex, begin, end );
+        return;
+    }
+
+    auto byCentroid = []( int axis )
+    {
+        return [axis]( const BuildPrim &a, const BuildPrim &b ) { return a.centroid[axis] < b.centroid[axis]; };
+    };
+
+    int bestAxis = box.maxExtentAxis();
+    int bestSplit = begin + count / 2;
+
+    if ( depth < SAH_MAX_DEPTH )
+    {
+        double bestCost = DBL_MAX;
+        vector<double> rightArea( count );
+
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            sort( prims.begin() + begin, prims.begin() + end, byCentroid( axis ) );
+
+            BoundingBox right;
+            for ( int i = end - 1; i > begin; i-- )
+            {
+                right.expand( prims[i].box );
+                rightArea[ i - begin ] = right.surfaceArea();
+            }
+
+            BoundingBox left;
+            for ( int i = begin + 1; i < end; i++ )
+            {
+                left.expand( prims[ i - 1 ].box );
+                double cost = left.surfaceArea() * numBatches( i - begin ) + rightArea[ i - begin ] * numBatches( end - i );
+                if ( cost < bestCost )
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        double area = box.surfaceArea();
+        double leafCost = INTERSECTION_COST * numBatches( count );
+        double splitCost = ( area > 0.0 )? TRAVERSAL_COST + INTERSECTION_COST * bestCost / area : leafCost;
+
+        if ( count <= maxLeafPrims() && leafCost <= splitCost )
+        {
+            makeLeaf( nodeIndex, begin, end );
+            return;
+        }
+
+        if ( bestAxis != 2 ) sort( prims.begin() + begin, prims.begin() + end, byCentroid( bestAxis ) );
+    }
+    else
+    {
+        if ( count <= maxLeafPrims() )
+        {
+            makeLeaf( nodeIndex, begin, end );
+            return;
+        }
+        nth_element( prims.begin() + begin, prims.begin() + bestSplit, prims.begin() + end, byCentroid( bestAxis ) );
+    }
+
+    int leftChild = (int)mNodes.size();
+    mNodes.emplace_back();
+    mNodes.emplace_back();
+    mNodes[ nodeIndex ].first = leftChild;
+    mNodes[ nodeIndex ].count = 0;
+    mNodes[ nodeIndex ].axis = bestAxis;
+
+    subdivideSAH( prims, leftChild, begin, bestSplit, depth + 1 );
+    subdivideSAH( prims, leftChild + 1, bestSplit, end, depth + 1 );
+}
+
+
+
+void BVH::computeBuildStats()
+{
+    mBuildStats.numNodes = (int)mNodes.size();
+    mBuildStats.numLeaves = 0;
+    mBuildStats.maxDepth = 0;
+    mBuildStats.sahCost = 0.0;
+
+    double rootArea = mNodes[0].box().surfaceArea();
+    if ( rootArea <= 0.0 ) rootArea = 1.0;
+
+    vector<pair<int, int>> stack = { { 0, 1 } };  // Node index and depth.
+    while ( !stack.empty() )
+    {
+        auto [ nodeIndex, depth ] = stack.back();
+        stack.pop_back();
+        const Node &node = mNodes[ nodeIndex ];
+        double relArea = node.box().surfaceArea() / rootArea;
+        mBuildStats.maxDepth = max( mBuildStats.maxDepth, depth );
+
+        if ( node.count > 0 )
+        {
+            mBuildStats.numLeaves++;
+            mBuildStats.sahCost += relArea * INTERSECTION_COST * numBatches( node.count );
+        }
+        else
+        {
+            mBuildStats.sahCost += relArea * TRAVERSAL_COST;
+            stack.push_back( { node.first, depth + 1 } );
+            stack.push_back( { node.first + 1, depth + 1 } );
+        }
+    }
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Splits prims[begin, end) at the bin boundary of lowest SAH cost, where
+// each axis of the centroid bounds is divided into NUM_BINS equal bins.
+// Large ranges are bounded and binned by all threads of the pool, and
+// large subtrees are built as separate tasks.
+//////////////////////////////////////////////////////////////////////////////
+
+void BVH::subdivideBinned( ParallelBuild &build, int nodeIndex, int begin, int end, int depth )
+{
+    vector<BuildPrim> &prims = build.prims;
+    int count = end - begin;
+    bool isParallel = ( count >= PARALLEL_BINNING_PRIMS && build.pool.numThreads() > 1 );
+    mutex mergeMutex;
+
+    BoundingBox box, centroidBox;
+    auto boundRange = [&]( int rangeBegin, int rangeEnd )
+    {
+        BoundingBox rangeBox, rangeCentroidBox;
+        for ( int i = rangeBegin; i < rangeEnd; i++ )
+        {
+            rangeBox.expand( prims[i].box );
+            rangeCentroidBox.expand( prims[i].centroid );
+        }
+        lock_guard<mutex> lock( mergeMutex );
+        box.expand( rangeBox );
+        centroidBox.expand( rangeCentroidBox );
+    };
+    if ( isParallel ) build.pool.parallelFor( begin, end, boundRange );
+    else boundRange( begin, end );
+
+    mNodes[ nodeIndex ].setBox( box );
+
+    if ( count == 1 )
+    {
+        makeLeaf( nodeIndex, begin, end );
+        return;
+    }
+
+    int bestAxis = centroidBox.maxExtentAxis();
+    int mid = begin + count / 2;
+    bool isDegenerate = ( centroidBox.extent()[ bestAxis ] <= 0.0 );
+
+    if ( depth < SAH_MAX_DEPTH && !isDegenerate )
+    {
+        // Small nodes need no more bins than primitives, and setting up and
+        // sweeping the bins is the main cost near the leaves.
+        int numBins = Util::Clamp( count, 4, NUM_BINS );
+        BinMapping mapping( centroidBox, numBins );
+        BinSet binSet;
+        auto binRange = [&]( BinSet &rangeBinSet, int rangeBegin, int rangeEnd )
+        {
+            for ( int i = rangeBegin; i < rangeEnd; i++ )
+            {
+                for ( int a = 0; a < 3; a++ )
+                {
+                    Bin &bin = rangeBinSet.bins[a][ mapping.binIndex( prims[i].centroid, a ) ];
+                    bin.box.expand( prims[i].box );
+                    bin.count++;
+                }
+            }
+        };
+        if ( isParallel )
+        {
+            build.pool.parallelFor( begin, end, [&]( int rangeBegin, int rangeEnd )
+            {
+                BinSet rangeBinSet;
+                binRange( rangeBinSet, rangeBegin, rangeEnd );
+                lock_guard<mutex> lock( mergeMutex );
+                binSet.merge( rangeBinSet );
+            } );
+        }
+        else binRange( binSet, begin, end );
+
+        // Sweep the bin boundaries of each axis for the cheapest split.
+        double bestCost = DBL_MAX;
+        int bestBin = 0;
+        for ( int a = 0; a < 3; a++ )
+        {
+            if ( mapping.scale[a] == 0.0 ) continue;
+            const Bin *bins = binSet.bins[a];
+
+            double rightCost[ NUM_BINS ];
+            BoundingBox right;
+            int rightCount = 0;
+            for ( int b = numBins - 1; b > 0; b-- )
+            {
+                right.expand( bins[b].box );
+                rightCount += bins[b].count;
+                rightCost[b] = right.surfaceArea() * numBatches( rightCount );
+            }
+
+            BoundingBox left;
+            int leftCount = 0;
+            for ( int b = 1; b < numBins; b++ )
+            {
+                left.expand( bins[ b - 1 ].box );
+                leftCount += bins[ b - 1 ].count;
+                if ( leftCount == 0 || leftCount == count ) continue;
+                double cost = left.surfaceArea() * numBatches( leftCount ) + rightCost[b];
+                if ( cost < bestCost )
+                {
+                    bestCost = cost;
+                    bestAxis = a;
+                    bestBin = b;
+                }
+            }
+        }
+
+        double area = box.surfaceArea();
+        double leafCost = INTERSECTION_COST * numBatches( count );
+        double splitCost = ( area > 0.0 )? TRAVERSAL_COST + INTERSECTION_COST * bestCost / area : leafCost;
+
+        if ( count <= maxLeafPrims() && leafCost <= splitCost )
+        {
+            makeLeaf( nodeIndex, begin, end );
+            return;
+        }
+
+        auto isLeft = [&mapping, bestAxis, bestBin]( const BuildPrim &p ) { return mapping.binIndex( p.centroid, bestAxis ) < bestBin; };
+        mid = (int)( partition( prims.begin() + begin, prims.begin() + end, isLeft ) - prims.begin() );
+    }
+    else
+    {
+        if ( count <= maxLeafPrims() )
+        {
+            makeLeaf( nodeIndex, begin, end );
+            return;
+        }
+        nth_element( prims.begin() + begin, prims.begin() + mid, prims.begin() + end,
+            [bestAxis]( const BuildPrim &a, const BuildPrim &b ) { return a.centroid[ bestAxis ] < b.centroid[ bestAxis ]; } );
+    }
+
+    int leftChild = build.numNodes.fetch_add( 2 );
+    mNodes[ nodeIndex ].first = leftChild;
+    mNodes[ nodeIndex ].count = 0;
+    mNodes[ nodeIndex ].axis = bestAxis;
+
+    if ( count >= TASK_PRIMS && build.pool.numThreads() > 1 )
+    {
+        ThreadPool::TaskGroup group( build.pool );
+        group.run( [&, leftChild]() { subdivideBinned( build, leftChild, begin, mid, depth + 1 ); } );
+        subdivideBinned( build, leftChild + 1, mid, end, depth + 1 );
+        group.wait();
+    }
+    else
+    {
+        subdivideBinned( build, leftChild, begin, mid, depth + 1 );
+        subdivideBinned( build, leftChild + 1, mid, end, depth + 1 );
+    }
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Computes the Morton code of each centroid within the centroid bounds and
+// sorts the primitives by it, using a parallel LSD radix sort: each thread
+// histograms one chunk per 8-bit digit, and then scatters its chunk to
+// offsets given by the prefix sums over all chunks.
+//////////////////////////////////////////////////////////////////////////////
+
+void BVH::sortByMortonCode( ParallelBuild &build )
+{
+    vector<BuildPrim> &prims = build.prims;
+    int numPrims = (int)prims.size();
+    int numChunks = build.pool.numThreads();
+    mutex mergeMutex;
+
+    BoundingBox centroidBox;
+    build.pool.parallelFor( 0, numPrims, [&]( int begin, int end )
+    {
+        BoundingBox rangeCentroidBox;
+        for ( int i = begin; i < end; i++ ) rangeCentroidBox.expand( prims[i].centroid );
+        lock_guard<mutex> lock( mergeMutex );
+        centroidBox.expand( rangeCentroidBox );
+    } );
+
+    Vector3r origin = centroidBox.min();
+    Vector3r extent = centroidBox.extent();
+    Vector3r invExtent( ( extent.x() > 0 )? 1 / extent.x() : 0,
+                        ( extent.y() > 0 )? 1 / extent.y() : 0,
+                        ( extent.z() > 0 )? 1 / extent.z() : 0 );
+
+    // Sort (code, prim) pairs packed into 64-bit keys, so only the code bits need sorting.
+    vector<uint64_t> keys( numPrims ), sortedKeys( numPrims );
+    build.pool.parallelFor( 0, numPrims, [&]( int begin, int end )
+    {
+        for ( int i = begin; i < end; i++ )
+        {
+            Vector3r c = ( prims[i].centroid - origin ) * invExtent;
+            keys[i] = ( (uint64_t)Util::MortonCode( c.x(), c.y(), c.z() ) << 32 ) | (uint32_t)i;
+        }
+    } );
+
+    auto chunkBegin = [numPrims, numChunks]( int c ) { return (int)( (long long)numPrims * c / numChunks ); };
+    vector<array<int, 256>> histograms( numChunks );
+
+    for ( int shift = 32; shift < 62; shift += 8 )
+    {
+        build.pool.parallelFor( 0, numChunks, [&]( int firstChunk, int lastChunk )
+        {
+            for ( int c = firstChunk; c < lastChunk; c++ )
+            {
+                histograms[c].fill( 0 );
+                for ( int i = chunkBegin( c ); i < chunkBegin( c + 1 ); i++ ) histograms[c][ ( keys[i] >> shift ) & 0xFF ]++;
+            }
+        } );
+
+        // Turn the counts into scatter offsets, digit-major then chunk-major.
+        int offset = 0;
+        for ( int digit = 0; digit < 256; digit++ )
+            for ( int c = 0; c < numChunks; c++ )
+            {
+                int count = histograms[c][ digit ];
+                histograms[c][ digit ] = offset;
+                offset += count;
+            }
+
+        build.pool.parallelFor( 0, numChunks, [&]( int firstChunk, int lastChunk )
+        {
+            for ( int c = firstChunk; c < lastChunk; c++ )
+                for ( int i = chunkBegin( c ); i < chunkBegin( c + 1 ); i++ )
+                    sortedKeys[ histograms[c][ ( keys[i] >> shift ) & 0xFF ]++ ] = keys[i];
+        } );
+        keys.swap( sortedKeys );
+    }
+
+    vector<BuildPrim> sortedPrims( numPrims );
+    build.mortonCodes.resize( numPrims );
+    build.pool.parallelFor( 0, numPrims, [&]( int begin, int end )
+    {
+        for ( int i = begin; i < end; i++ )
+        {
+            sortedPrims[i] = prims[ (uint32_t)keys[i] ];
+            build.mortonCodes[i] = (uint32_t)( keys[i] >> 32 );
+        }
+    } );
+    prims.swap( sortedPrims );
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Emits the subtree over the Morton-sorted prims[begin, end), splitting
+// where the highest bit that differs within the range changes, or in the
+// middle if all codes are equal. Returns the bounding box of the subtree.
+//////////////////////////////////////////////////////////////////////////////
+
+BoundingBox BVH::emitLBVH( ParallelBuild &build, int nodeIndex, int begin, int end )
+{
+    const vector<uint32_t> &codes = build.mortonCodes;
+    int count = end - begin;
+
+    if ( count <= maxLeafPrims() )
+    {
+        BoundingBox box;
+        for ( int i = begin; i < end; i++ ) box.expand( build.prims[i].box );
+        mNodes[ nodeIndex ].setBox( box );
+        makeLeaf( nodeIndex, begin, end );
+        return box;
+    }
+
+    int mid = begin + count / 2;
+    int axis = 0;
+    uint32_t firstCode = codes[ begin ];
+    uint32_t lastCode = codes[ end - 1 ];
+
+    if ( firstCode != lastCode )
+    {
+        // Binary search for the first code with the highest differing bit set.
+        int bit = HighestBit( firstCode ^ lastCode );
+        uint32_t mask = 1u << bit;
+        int lo = begin, hi = end - 1;
+        while ( lo + 1 < hi )
+        {
+            int m = ( lo + hi ) / 2;
+            if ( codes[m] & mask ) hi = m;
+            else lo = m;
+        }
+        mid = hi;
+        axis = 2 - bit % 3;
+    }
+
+    int leftChild = build.numNodes.fetch_add( 2 );
+    mNodes[ nodeIndex ].first = leftChild;
+    mNodes[ nodeIndex ].count = 0;
+    mNodes[ nodeIndex ].axis = axis;
+
+    BoundingBox leftBox, rightBox;
+    if ( count >= TASK_PRIMS && build.pool.numThreads() > 1 )
+    {
+        ThreadPool::TaskGroup group( build.pool );
+        group.run( [&, leftChild]() { leftBox = emitLBVH( build, leftChild, begin, mid ); } );
+        rightBox = emitLBVH( build, leftChild + 1, mid, end );
+        group.wait();
+    }
+    else
+    {
+        leftBox = emitLBVH( build, leftChild, begin, mid );
+        rightBox = emitLBVH( build, leftChild + 1, mid, end );
+    }
+
+    BoundingBox box = leftBox;
+    box.expand( rightBox );
+    mNodes[ nodeIndex ].setBox( box );
+    return box;
+}
+
+
+
+BVH::RefitResult BVH::refitNode( const vector<BoundingBox> &primBounds, ThreadPool &pool, int nodeIndex, int depth )
+{
+    Node &node = mNodes[ nodeIndex ];
+    RefitResult result;
+
+    if ( node.count > 0 )
+    {
+        for ( int i = node.first; i < node.first + node.count; i++ ) result.box.expand( primBounds[ primIndex( i ) ] );
+        result.leafPrimArea = result.box.surfaceArea() * numBatches( node.count );
+    }
+    else
+    {
+        RefitResult left, right;
+        if ( depth < REFIT_TASK_DEPTH && pool.numThreads() > 1 )
+        {
+            ThreadPool::TaskGroup group( pool );
+            group.run( [&]() { left = refitNode( primBounds, pool, node.first, depth + 1 ); } );
+            right = refitNode( primBounds, pool, node.first + 1, depth + 1 );
+            group.wait();
+        }
+        else
+        {
+            left = refitNode( primBounds, pool, node.first, depth + 1 );
+            right = refitNode( primBounds, pool, node.first + 1, depth + 1 );
+        }
+        result.box = left.box;
+        result.box.expand( right.box );
+        result.interiorArea = result.box.surfaceArea() + left.interiorArea + right.interiorArea;
+        result.leafPrimArea = left.leafPrimArea + right.leafPrimArea;
+    }
+
+    node.setBox( result.box );
+    orderChildren( nodeIndex );
+    return result;
+}
+
+
+
+double BVH::refit( const vector<BoundingBox> &primBounds, int numThreads )
+{
+    if ( mNodes.empty() ) return 0.0;
+    assert( (int)primBounds.size() == mNumPrims );
+
+    ThreadPool pool( numThreads );
+    RefitResult root = refitNode( primBounds, pool, 0, 0 );
+
+    double rootArea = root.box.surfaceArea();
+    if ( rootArea <= 0.0 ) rootArea = 1.0;
+    mSAHCost = ( TRAVERSAL_COST * root.interiorArea + INTERSECTION_COST * root.leafPrimArea ) / rootArea;
+    return mSAHCost;
+}
+
+
+
+bool BVH::update( const vector<BoundingBox> &primBounds, int numThreads )
+{
+    if ( (int)primBounds.size() != mNumPrims || mNodes.empty() )
+    {
+        build( primBounds, mBuildMethod, numThreads );
+        return true;
+    }
+
+    refit( primBounds, numThreads );
+    if ( sahGrowth() <= mRebuildThreshold ) return false;
+
+    build( primBounds, mBuildMethod, numThreads );
+    return true;
+}
@@ -0,0 +1,660 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <vector>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <algorithm>
+#include "Util.h"
+#include "Vector3d.h"
+#include "Ray.h"
+#include "BoundingBox.h"
+#include "RayPacket.h"
+
+class ThreadPool;
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A bounding volume hierarchy over a set of primitives, each given only by
+// its bounding box. The BVH knows nothing about the primitives themselves:
+// the traversal calls back into the owner with a primitive index, so the
+// same hierarchy code serves any kind of primitive.
+//
+// The tree is stored as a flat array of nodes. The root is node 0, and the
+// two children of an interior node are always adjacent in the array.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class BVH
+{
+public:
+
+    //////////////////////////////////////////////////////////////////////////////
+    // A node of 32 bytes, two to a cache line. Its bounds are stored in
+    // float, rounded outward, so that they always contain the bounds they
+    // were made from and no hit is missed. Only the slab tests read them;
+    // the primitives are still intersected in the precision of Real.
+    //////////////////////////////////////////////////////////////////////////////
+
+    struct Node
+    {
+        float min[3];
+        int first;          // Leaf: index of first entry in primIndices. Interior: index of left child (right child is first + 1).
+        float max[3];
+        int count : 29;     // Number of primitives in a leaf, 0 for an interior node.
+        unsigned axis : 2;  // Split axis of an interior node.
+        unsigned leftIsLarger : 1;  // Interior: the left child has at least the surface area of the right.
+
+        [[nodiscard]] BoundingBox box() const
+            { return { Vector3r( min[0], min[1], min[2] ), Vector3r( max[0], max[1], max[2] ) }; }
+
+        void setBox( const BoundingBox &b )
+        {
+            for ( int a = 0; a < 3; a++ )
+            {
+                min[a] = Util::RoundDownToFloat( b.min()[a] );
+                max[a] = Util::RoundUpToFloat( b.max()[a] );
+            }
+        }
+
+        [[nodiscard]] float surfaceArea() const
+        {
+            float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+            return 2 * ( dx * dy + dy * dz + dz * dx );
+        }
+
+        // Slab test as in BoundingBox::hit().
+        [[nodiscard]] bool hit( const Vector3r &origin, const Vector3r &invDir, Real tmin, Real tmax ) const
+        {
+            for ( int a = 0; a < 3; a++ )
+            {
+                Real t0 = ( min[a] - origin[a] ) * invDir[a];
+                Real t1 = ( max[a] - origin[a] ) * invDir[a];
+                if ( invDir[a] < 0 ) std::swap( t0, t1 );
+                tmin = ( t0 > tmin )? t0 : tmin;
+                tmax = ( t1 < tmax )? t1 : tmax;
+                if ( tmax < tmin ) return false;
+            }
+            return true;
+        }
+
+        //////////////////////////////////////////////////////////////////////////////
+        // Interval slab test of a coherent packet. Returns false only if no
+        // ray of the packet can overlap the box for any t in [tmin, tmax].
+        //////////////////////////////////////////////////////////////////////////////
+
+        [[nodiscard]] bool hit( const RayPacket &packet, Real tmin, Real tmax ) const
+        {
+            Vector3r origin = packet.origin();
+            for ( int a = 0; a < 3; a++ )
+            {
+                bool isNeg = packet.dirIsNeg( a );
+                Real nearDist = ( isNeg? max[a] : min[a] ) - origin[a];
+                Real farDist = ( isNeg? min[a] : max[a] ) - origin[a];
+                Real lo = packet.minInvDir()[a], hi = packet.maxInvDir()[a];
+                Real t0 = std::min( nearDist * lo, nearDist * hi );
+                Real t1 = std::max( farDist * lo, farDist * hi );
+                tmin = ( t0 > tmin )? t0 : tmin;
+                tmax = ( t1 < tmax )? t1 : tmax;
+                if ( tmax < tmin ) return false;
+            }
+            return true;
+        }
+    };
+
+
+    struct BuildStats
+    {
+        double buildTime{};  // In seconds.
+        int numNodes{};
+        int numLeaves{};
+        int maxDepth{};
+        double sahCost{};    // Expected cost of a random ray, relative to one primitive test.
+    };
+
+
+    struct TraversalStats
+    {
+        unsigned long long rays{};
+        unsigned long long nodesVisited{};
+        unsigned long long primTests{};
+    };
+
+
+    enum class BuildMethod
+    {
+        SweepSAH,   // Serial, evaluates the SAH at every primitive centroid.
+        BinnedSAH,  // Parallel, evaluates the SAH at the boundaries of NUM_BINS bins.
+        LBVH        // Parallel, splits the Morton curve through the centroids. Fastest
+                    // to build but gives a worse tree; meant for per-frame rebuilds.
+    };
+
+
+    // Maximum depth of the tree, which is also the size of the traversal stack.
+    static constexpr int MAX_DEPTH = 64;
+
+    // Maximum number of primitives in a leaf, unless the leaf batch width
+    // is larger, which then is the maximum.
+    static constexpr int MAX_LEAF_PRIMS = 4;
+
+    // A packet whose rays have diverged so that fewer than this many still
+    // hit a node traces the rays on through the node's subtree one by one.
+    static constexpr int MIN_PACKET_RAYS = 4;
+
+    // SAH costs of a node traversal step and of a primitive intersection test.
+    static constexpr double TRAVERSAL_COST = 1.0;
+    static constexpr double INTERSECTION_COST = 1.0;
+
+
+    // Number of bins per axis of the binned SAH builder.
+    static constexpr int NUM_BINS = 32;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Builds the hierarchy over primitives 0 .. primBounds.size()-1 using
+    // the given method. All boxes must be bounded. numThreads is ignored by
+    // the sweep builder; numThreads <= 0 uses all hardware threads.
+    //////////////////////////////////////////////////////////////////////////////
+
+    void build( const std::vector<BoundingBox> &primBounds, 
+                BuildMethod method = BuildMethod::BinnedSAH, int numThreads = 0 );
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Recomputes all node bounds bottom-up from new primitive bounds, keeping
+    // the tree topology. Meant for primitives that move but are neither added
+    // nor removed. Returns the SAH cost of the refitted tree.
+    //////////////////////////////////////////////////////////////////////////////
+
+    double refit( const std::vector<BoundingBox> &primBounds, int numThreads = 0 );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Refits the tree, then rebuilds it with the last build method if its SAH
+    // cost has grown by more than the rebuild threshold since the last build.
+    // Returns true iff the tree was rebuilt.
+    //////////////////////////////////////////////////////////////////////////////
+
+    bool update( const std::vector<BoundingBox> &primBounds, int numThreads = 0 );
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Tells the builders that the owner intersects the primitives of a leaf
+    // in batches of up to width at the cost of one, e.g. in SIMD lanes. The
+    // SAH then favours leaves that fill whole batches, and a leaf may hold a
+    // whole batch. Applies to the next build. The default width is 1.
+    //////////////////////////////////////////////////////////////////////////////
+
+    void setLeafBatchWidth( int width ) { mLeafBatchWidth = width; }
+
+    // Ratio of current to freshly built SAH cost past which update() rebuilds.
+    void setRebuildThreshold( double threshold ) { mRebuildThreshold = threshold; }
+
+    [[nodiscard]] double rebuildThreshold() const { return mRebuildThreshold; }
+
+    // Ratio of current to freshly built SAH cost.
+    [[nodiscard]] double sahGrowth() const
+        { return ( mBuildStats.sahCost > 0.0 )? mSAHCost / mBuildStats.sahCost : 1.0; }
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Renumbers the primitives in the order the leaves reference them: the
+    // primitive numbered primIndices()[i] becomes primitive i. The owner
+    // must reorder its own primitive arrays the same way. Each leaf then
+    // covers a contiguous range of primitives, which the owner can store
+    // contiguously for cache-friendly traversal. primIndices() is then
+    // empty, as it would map each primitive to itself.
+    //////////////////////////////////////////////////////////////////////////////
+
+    void renumberPrimitives();
+
+    void clear();
+
+    [[nodiscard]] bool empty() const { return mNodes.empty(); }
+
+    [[nodiscard]] BoundingBox bounds() const { return empty()? BoundingBox() : mNodes[0].box(); }
+
+    [[nodiscard]] const std::vector<Node> &nodes() const { return mNodes; }
+
+    [[nodiscard]] const std::vector<int> &primIndices() const { return mPrimIndices; }
+
+    // Primitive i in leaf order, the index the callbacks below receive.
+    [[nodiscard]] int primIndex( int i ) const { return mPrimIndices.empty()? i : mPrimIndices[i]; }
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Finds the nearest primitive hit by the ray in [tmin, tmax].
+    // hitPrim( primIndex, tmax ) must intersect the primitive and, if it is
+    // hit within [tmin, tmax], shrink tmax to the hit parameter and return
+    // true. On return, tmax holds the parameter of the nearest hit.
+    //////////////////////////////////////////////////////////////////////////////
+
+    template <typename PrimHitFunc>
+    bool hit( const Ray &r, Real tmin, Real &tmax, PrimHitFunc &&hitPrim ) const;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Returns true as soon as any primitive is hit by the ray in [tmin, tmax].
+    // occludedPrim( primIndex ) must return true iff the primitive is hit
+    // within [tmin, tmax]. Children are visited larger box first, as a
+    // random segment through the parent is most likely to be blocked there.
+    //////////////////////////////////////////////////////////////////////////////
+
+    template <typename PrimOccludedFunc>
+    bool occluded( const Ray &r, Real tmin, Real tmax, PrimOccludedFunc &&occludedPrim ) const;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Same as hit() and occluded(), but calling back once per leaf, with the
+    // range [first, first + count) of primIndex() it covers, so that the
+    // owner can intersect the primitives of a leaf together.
+    //////////////////////////////////////////////////////////////////////////////
+
+    template <typename LeafHitFunc>
+    bool hitLeaves( const Ray &r, Real tmin, Real &tmax, LeafHitFunc &&hitLeaf ) const;
+
+    template <typename LeafOccludedFunc>
+    bool occludedLeaves( const Ray &r, Real tmin, Real tmax, LeafOccludedFunc &&occludedLeaf ) const;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Same as hitLeaves(), for all rays of a coherent packet together.
+    // tmax holds one maximum hit parameter per ray of the packet. Nodes are
+    // culled for the whole packet by an interval test. At each leaf the
+    // packet reaches, hitLeaf( first, count, rayIndex, tmax[ rayIndex ] )
+    // is called for every ray whose own slab test passes. Below a node that
+    // fewer than MIN_PACKET_RAYS rays hit, those rays are traced singly.
+    //////////////////////////////////////////////////////////////////////////////
+
+    template <typename LeafHitFunc>
+    void hitPacketLeaves( const RayPacket &packet, Real tmin, Real tmax[], LeafHitFunc &&hitLeaf ) const;
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Same as occludedLeaves(), for all rays of a coherent packet together.
+    // Ray i is tested in [tmin, tmax[i]] and occluded[i] is set once a
+    // leaf is found for which occludedLeaf( first, count, i ) returns true.
+    // Rays with occluded[i] already set on entry are skipped.
+    //////////////////////////////////////////////////////////////////////////////
+
+    template <typename LeafOccludedFunc>
+    void occludedPacketLeaves( const RayPacket &packet, Real tmin, const Real tmax[], bool occluded[],
+                               LeafOccludedFunc &&occludedLeaf ) const;
+
+
+// Statistics.
+
+    [[nodiscard]] const BuildStats &buildStats() const { return mBuildStats; }
+
+    [[nodiscard]] TraversalStats traversalStats() const
+        { return { mRays.value.load(), mNodesVisited.value.load(), mPrimTests.value.load() }; }
+
+    void resetTraversalStats() { mRays.value = 0; mNodesVisited.value = 0; mPrimTests.value = 0; }
+
+    // Traversal counters cost one atomic add per query each, so they are off by default.
+    void setCollectStats( bool collect ) { mCollectStats = collect; }
+
+
+private:
+
+    struct BuildPrim
+    {
+        BoundingBox box;
+        Vector3r centroid;
+        int index;
+    };
+
+    // Relaxed atomic counter that can be copied together with its BVH.
+    struct Counter
+    {
+        std::atomic<unsigned long long> value{};
+        Counter() = default;
+        Counter( const Counter &c ) : value( c.value.load() ) {}
+        Counter &operator= ( const Counter &c ) { value = c.value.load(); return (*this); }
+        void add( unsigned long long n ) { value.fetch_add( n, std::memory_order_relaxed ); }
+    };
+
+    struct ParallelBuild;  // Shared state of a parallel build, defined in BVH.cpp.
+    struct RefitResult;    // Bounds and SAH terms of a refitted subtree, defined in BVH.cpp.
+
+    void subdivideSAH( std::vector<BuildPrim> &prims, int nodeIndex, int begin, int end, int depth );
+    void subdivideBinned( ParallelBuild &build, int nodeIndex, int begin, int end, int depth );
+    void sortByMortonCode( ParallelBuild &build );
+    BoundingBox emitLBVH( ParallelBuild &build, int nodeIndex, int begin, int end );
+    void makeLeaf( int nodeIndex, int begin, int end );
+    void computeBuildStats();
+    void orderChildren( int nodeIndex );
+
+    // hitLeaves() for the subtree at rootIndex, adding to the traversal counts.
+    template <typename LeafHitFunc>
+    bool hitSubtreeLeaves( int rootIndex, const Ray &r, Real tmin, Real &tmax, LeafHitFunc &&hitLeaf,
+                           unsigned long long &nodesVisited, unsigned long long &primTests ) const;
+    RefitResult refitNode( const std::vector<BoundingBox> &primBounds, ThreadPool &pool, int nodeIndex, int depth );
+
+    [[nodiscard]] int maxLeafPrims() const { return Util::Max2( MAX_LEAF_PRIMS, mLeafBatchWidth ); }
+
+    // Number of intersection batches needed for count primitives.
+    [[nodiscard]] int numBatches( int count ) const { return ( count + mLeafBatchWidth - 1 ) / mLeafBatchWidth; }
+
+    void recordTraversal( unsigned long long nodesVisited, unsigned long long primTests, int numRays = 1 ) const
+    {
+        if ( !mCollectStats ) return;
+        mRays.add( numRays );
+        mNodesVisited.add( nodesVisited );
+        mPrimTests.add( primTests );
+    }
+
+    std::vector<Node> mNodes;
+    std::vector<int> mPrimIndices;  // Empty once renumbered.
+    int mNumPrims = 0;
+
+    BuildStats mBuildStats;
+    BuildMethod mBuildMethod = BuildMethod::BinnedSAH;
+    double mSAHCost = 0.0;  // Of the tree as last built or refitted.
+    double mRebuildThreshold = 1.5;
+    int mLeafBatchWidth = 1;
+
+    bool mCollectStats = false;
+    mutable Counter mRays, mNodesVisited, mPrimTests;
+
+}; // BVH
+
+
+
+template <typename PrimHitFunc>
+bool BVH::hit( const Ray &r, Real tmin, Real &tmax, PrimHitFunc &&hitPrim ) const
+{
+    return hitLeaves( r, tmin, tmax,
+        [&]( int first, int count, Real &nearest_t )
+        {
+            bool hasHit = false;
+            for ( int i = first; i < first + count; i++ )
+            {
+                if ( hitPrim( primIndex( i ), nearest_t ) ) hasHit = true;
+            }
+            return hasHit;
+        } );
+}
+
+
+
+template <typename PrimOccludedFunc>
+bool BVH::occluded( const Ray &r, Real tmin, Real tmax, PrimOccludedFunc &&occludedPrim ) const
+{
+    return occludedLeaves( r, tmin, tmax,
+        [&]( int first, int count )
+        {
+            for ( int i = first; i < first + count; i++ )
+            {
+                if ( occludedPrim( primIndex( i ) ) ) return true;
+            }
+            return false;
+        } );
+}
+
+
+
+template <typename LeafHitFunc>
+bool BVH::hitLeaves( const Ray &r, Real tmin, Real &tmax, LeafHitFunc &&hitLeaf ) const
+{
+    if ( mNodes.empty() ) return false;
+
+    unsigned long long nodesVisited = 0, primTests = 0;
+    bool hasHit = hitSubtreeLeaves( 0, r, tmin, tmax, hitLeaf, nodesVisited, primTests );
+
+    recordTraversal( nodesVisited, primTests );
+    return hasHit;
+}
+
+
+
+template <typename LeafHitFunc>
+bool BVH::hitSubtreeLeaves( int rootIndex, const Ray &r, Real tmin, Real &tmax, LeafHitFunc &&hitLeaf,
+                            unsigned long long &nodesVisited, unsigned long long &primTests ) const
+{
+    Vector3r origin = r.origin();
+    Vector3r dir = r.direction();
+    Vector3r invDir( 1 / dir.x(), 1 / dir.y(), 1 / dir.z() );
+    bool dirIsNeg[3] = { invDir.x() < 0.0, invDir.y() < 0.0, invDir.z() < 0.0 };
+
+    int stack[ MAX_DEPTH ];
+    int stackSize = 0;
+    int nodeIndex = rootIndex;
+    bool hasHit = false;
+
+    while ( true )
+    {
+        const Node &node = mNodes[ nodeIndex ];
+        nodesVisited++;
+
+        if ( node.hit( origin, invDir, tmin, tmax ) )
+        {
+            if ( node.count > 0 )
+            {
+                primTests += node.count;
+                if ( hitLeaf( node.first, node.count, tmax ) ) hasHit = true;
+            }
+            else
+            {
+                // Visit the child nearer to the ray origin first, so that
+                // the far child is more likely to be culled by a shrunk tmax.
+                int nearChild = node.first + ( dirIsNeg[ node.axis ]? 1 : 0 );
+                int farChild = node.first + ( dirIsNeg[ node.axis ]? 0 : 1 );
+                stack[ stackSize++ ] = farChild;
+                nodeIndex = nearChild;
+                continue;
+            }
+        }
+
+        if ( stackSize == 0 ) break;
+        nodeIndex = stack[ --stackSize ];
+    }
+
+    return hasHit;
+}
+
+
+
+template <typename LeafOccludedFunc>
+bool BVH::occludedLeaves( const Ray &r, Real tmin, Real tmax, LeafOccludedFunc &&occludedLeaf ) const
+{
+    if ( mNodes.empty() ) return false;
+
+    Vector3r origin = r.origin();
+    Vector3r dir = r.direction();
+    Vector3r invDir( 1 / dir.x(), 1 / dir.y(), 1 / dir.z() );
+
+    int stack[ MAX_DEPTH ];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    bool isOccluded = false;
+    unsigned long long nodesVisited = 0, primTests = 0;
+
+    while ( true )
+    {
+        const Node &node = mNodes[ nodeIndex ];
+        nodesVisited++;
+
+        if ( node.hit( origin, invDir, tmin, tmax ) )
+        {
+            if ( node.count > 0 )
+            {
+                primTests += node.count;
+                isOccluded = occludedLeaf( node.first, node.count );
+                if ( isOccluded ) break;
+            }
+            else
+            {
+                stack[ stackSize++ ] = node.first + ( node.leftIsLarger? 1 : 0 );
+                nodeIndex = node.first + ( node.leftIsLarger? 0 : 1 );
+                continue;
+            }
+        }
+
+        if ( stackSize == 0 ) break;
+        nodeIndex = stack[ --stackSize ];
+    }
+
+    recordTraversal( nodesVisited, primTests );
+    return isOccluded;
+}
+
+
+
+template <typename LeafHitFunc>
+void BVH::hitPacketLeaves( const RayPacket &packet, Real tmin, Real tmax[], LeafHitFunc &&hitLeaf ) const
+{
+    assert( packet.isCoherent() );
+    if ( mNodes.empty() ) return;
+
+    int numRays = packet.numRays();
+    Vector3r invDirs[ RayPacket::MAX_RAYS ];
+    Real packetTmax = tmin;
+    for ( int i = 0; i < numRays; i++ )
+    {
+        Vector3r dir = packet.ray( i ).direction();
+        invDirs[i] = Vector3r( 1 / dir.x(), 1 / dir.y(), 1 / dir.z() );
+        packetTmax = std::max( packetTmax, tmax[i] );
+    }
+    Vector3r origin = packet.origin();
+
+    // Finds the rays that hit a node, stopping once MIN_PACKET_RAYS are found.
+    int activeRays[ RayPacket::MAX_RAYS ];
+    int numActive = 0;
+    auto findActiveRays = [&]( const Node &node )
+    {
+        numActive = 0;
+        for ( int i = 0; i < numRays && numActive < MIN_PACKET_RAYS; i++ )
+        {
+            if ( node.hit( origin, invDirs[i], tmin, tmax[i] ) ) activeRays[ numActive++ ] = i;
+        }
+        return numActive;
+    };
+
+    int stack[ MAX_DEPTH ];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    unsigned long long nodesVisited = 0, primTests = 0;
+
+    while ( true )
+    {
+        const Node &node = mNodes[ nodeIndex ];
+        nodesVisited++;
+
+        if ( node.hit( packet, tmin, packetTmax ) )
+        {
+            if ( node.count > 0 )
+            {
+                packetTmax = tmin;
+                for ( int i = 0; i < numRays; i++ )
+                {
+                    if ( node.hit( origin, invDirs[i], tmin, tmax[i] ) )
+                    {
+                        primTests += node.count;
+                        hitLeaf( node.first, node.count, i, tmax[i] );
+                    }
+                    packetTmax = std::max( packetTmax, tmax[i] );
+                }
+            }
+            else if ( findActiveRays( node ) < MIN_PACKET_RAYS )
+            {
+                // Too few rays left for the interval test to pay off.
+                for ( int j = 0; j < numActive; j++ )
+                {
+                    int i = activeRays[j];
+                    hitSubtreeLeaves( nodeIndex, packet.ray( i ), tmin, tmax[i],
+                        [&]( int first, int count, Real &nearest_t ) { return hitLeaf( first, count, i, nearest_t ); },
+                        nodesVisited, primTests );
+                }
+                packetTmax = tmin;
+                for ( int i = 0; i < numRays; i++ ) packetTmax = std::max( packetTmax, tmax[i] );
+            }
+            else
+            {
+                // All rays agree on the direction along the split axis.
+                int nearChild = node.first + ( packet.dirIsNeg( node.axis )? 1 : 0 );
+                int farChild = node.first + ( packet.dirIsNeg( node.axis )? 0 : 1 );
+                stack[ stackSize++ ] = farChild;
+                nodeIndex = nearChild;
+                continue;
+            }
+        }
+
+        if ( stackSize == 0 ) break;
+        nodeIndex = stack[ --stackSize ];
+    }
+
+    // Nodes are counted once per packet, as each is fetched once for all its rays.
+    recordTraversal( nodesVisited, primTests, numRays );
+}
+
+
+
+template <typename LeafOccludedFunc>
+void BVH::occludedPacketLeaves( const RayPacket &packet, Real tmin, const Real tmax[], bool occluded[],
+                                LeafOccludedFunc &&occludedLeaf ) const
+{
+    assert( packet.isCoherent() );
+
+    // The packet is tested up to the longest segment of a ray still unoccluded.
+    int numRays = packet.numRays();
+    auto packetTmax = [&]()
+    {
+        Real maxT = -std::numeric_limits<Real>::infinity();
+        for ( int i = 0; i < numRays; i++ ) if ( !occluded[i] ) maxT = std::max( maxT, tmax[i] );
+        return maxT;
+    };
+    Real maxT = packetTmax();
+    if ( mNodes.empty() || maxT < tmin ) return;
+
+    Vector3r invDirs[ RayPacket::MAX_RAYS ];
+    for ( int i = 0; i < numRays; i++ )
+    {
+        Vector3r dir = packet.ray( i ).direction();
+        invDirs[i] = Vector3r( 1 / dir.x(), 1 / dir.y(), 1 / dir.z() );
+    }
+    Vector3r origin = packet.origin();
+
+    int stack[ MAX_DEPTH ];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    unsigned long long nodesVisited = 0, primTests = 0;
+
+    while ( true )
+    {
+        const Node &node = mNodes[ nodeIndex ];
+        nodesVisited++;
+
+        if ( node.hit( packet, tmin, maxT ) )
+        {
+            if ( node.count > 0 )
+            {
+                bool hasNewOccluded = false;
+                for ( int i = 0; i < numRays; i++ )
+                {
+                    if ( occluded[i] || !node.hit( origin, invDirs[i], tmin, tmax[i] ) ) continue;
+                    primTests += node.count;
+                    occluded[i] = occludedLeaf( node.first, node.count, i );
+                    hasNewOccluded = hasNewOccluded || occluded[i];
+                }
+                if ( hasNewOccluded )
+                {
+                    maxT = packetTmax();
+                    if ( maxT < tmin ) break;  // No ray left to test.
+                }
+            }
+            else
+            {
+                stack[ stackSize++ ] = node.first + ( node.leftIsLarger? 1 : 0 );
+                nodeIndex = node.first + ( node.leftIsLarger? 0 : 1 );
+                continue;
+            }
+        }
+
+        if ( stackSize == 0 ) break;
+        nodeIndex = stack[ --stackSize ];
+    }
+
+    recordTraversal( nodesVisited, primTests, numRays );
+}
+
+
+#endif // _BVH_H_
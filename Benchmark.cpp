@@ -0,0 +1,957 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <random>
+#include <string>
+#include <iostream>
+#include <limits>
+#include "Util.h"
+#include "Vector3d.h"
+#include "BoundingBox.h"
+#include "BVH.h"
+#include "Sphere.h"
+#include "SphereSet.h"
+#include "ParticleSet.h"
+#include "Triangle.h"
+#include "TriangleMesh.h"
+#include "PrecomputedTriangle.h"
+#include "TriangleBatch.h"
+#include "SurfaceBVH.h"
+#include "Scene.h"
+#include "CompiledScene.h"
+#include "RayPacket.h"
+#include "Shading.h"
+#include "Raytrace.h"
+#include "Wavefront.h"
+#include "Benchmark.h"
+
+using namespace std;
+
+
+// The sweep builder is O(N log^2 N) and single-threaded, so it is only
+// run as a quality reference on meshes up to this size.
+static constexpr int MAX_SWEEP_TRIANGLES = 250000;
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Makes a height-field mesh of about numTriangles triangles over the unit
+// square, as shared vertex positions and three vertex indices per
+// triangle. A nonzero swirl rotates each vertex about the center by swirl
+// times its distance from the center, which keeps the connectivity but
+// scatters neighbours.
+//////////////////////////////////////////////////////////////////////////////
+
+static void MakeHeightFieldMesh( int numTriangles, double swirl, vector<Vector3r> &positions, vector<int> &indices )
+{
+    int n = Util::Max2( 1, (int)sqrt( numTriangles / 2.0 ) );
+    positions.clear();
+    positions.reserve( (size_t)( n + 1 ) * ( n + 1 ) );
+    indices.clear();
+    indices.reserve( 6 * (size_t)n * n );
+
+    for ( int j = 0; j <= n; j++ )
+        for ( int i = 0; i <= n; i++ )
+        {
+            double x = (double)i / n, z = (double)j / n;
+            double y = 0.05 * sin( 40.0 * x ) * cos( 30.0 * z ) + 0.02 * sin( 170.0 * x * z );
+            double dx = x - 0.5, dz = z - 0.5;
+            double angle = swirl * sqrt( dx * dx + dz * dz );
+            positions.emplace_back( 0.5 + dx * cos( angle ) - dz * sin( angle ), y, 
+                                    0.5 + dx * sin( angle ) + dz * cos( angle ) );
+        }
+
+    for ( int j = 0; j < n; j++ )
+        for ( int i = 0; i < n; i++ )
+        {
+            int v00 = j * ( n + 1 ) + i, v10 = v00 + 1;
+            int v01 = v00 + n + 1, v11 = v01 + 1;
+            indices.insert( indices.end(), { v00, v10, v11, v00, v11, v01 } );
+        }
+}
+
+
+
+// The height-field mesh as a triangle soup, three vertices per triangle.
+static vector<Vector3r> MakeHeightField( int numTriangles, double swirl = 0.0 )
+{
+    vector<Vector3r> positions;
+    vector<int> indices;
+    MakeHeightFieldMesh( numTriangles, swirl, positions, indices );
+
+    vector<Vector3r> vertices( indices.size() );
+    for ( size_t i = 0; i < indices.size(); i++ ) vertices[i] = positions[ indices[i] ];
+    return vertices;
+}
+
+
+
+static vector<BoundingBox> TriangleBounds( const vector<Vector3r> &vertices )
+{
+    vector<BoundingBox> triBounds( vertices.size() / 3 );
+    for ( size_t i = 0; i < triBounds.size(); i++ )
+    {
+        triBounds[i].expand( vertices[3*i] ).expand( vertices[3*i + 1] ).expand( vertices[3*i + 2] );
+    }
+    return triBounds;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// The Moller-Trumbore test that Triangle used before it had a
+// PrecomputedTriangle, as the reference for the "triangle" benchmark.
+//////////////////////////////////////////////////////////////////////////////
+
+static bool HitMollerTrumbore( const Vector3r &v0, const Vector3r &v1, const Vector3r &v2, const Ray &r, 
+                               Real tmin, Real tmax, Real &t, Real &beta, Real &gamma )
+{
+    Vector3r e1 = v1 - v0;
+    Vector3r e2 = v2 - v0;
+    Vector3r p = cross( r.direction(), e2 );
+    Real a = dot( e1, p );
+    Real f = 1 / a;
+    Vector3r s = r.origin() - v0;
+    beta = f * dot( s, p );
+    if ( beta < 0.0 || beta > 1.0 ) return false;
+
+    Vector3r q = cross( s, e1 );
+    gamma = f * dot( r.direction(), q );
+    if ( gamma < 0.0 || beta + gamma > 1.0 ) return false;
+
+    t = f * dot( e2, q );
+    return ( t >= tmin && t <= tmax );
+}
+
+
+
+static void ReportBuild( const char *method, int numThreads, const BVH &bvh )
+{
+    const BVH::BuildStats &stats = bvh.buildStats();
+    printf( "%-10s %8d %12.3f %10.3f %10d %6d\n", method, numThreads, 
+            stats.buildTime, stats.sahCost, stats.numNodes, stats.maxDepth );
+}
+
+
+
+void Benchmark::BVHBuild( int numTriangles )
+{
+    vector<BoundingBox> triBounds = TriangleBounds( MakeHeightField( numTriangles ) );
+
+    printf( "BVH build over %d triangles\n", (int)triBounds.size() );
+    printf( "%-10s %8s %12s %10s %10s %6s\n", "method", "threads", "time (sec)", "SAH cost", "nodes", "depth" );
+
+    int maxThreads = Util::Max2( 1, (int)thread::hardware_concurrency() );
+    for ( int numThreads = 1; ; numThreads *= 2 )
+    {
+        if ( numThreads > maxThreads ) numThreads = maxThreads;
+        BVH binned, lbvh;
+        binned.build( triBounds, BVH::BuildMethod::BinnedSAH, numThreads );
+        ReportBuild( "binned", numThreads, binned );
+        lbvh.build( triBounds, BVH::BuildMethod::LBVH, numThreads );
+        ReportBuild( "lbvh", numThreads, lbvh );
+        if ( numThreads == maxThreads ) break;
+    }
+
+    if ( (int)triBounds.size() <= MAX_SWEEP_TRIANGLES )
+    {
+        BVH bvh;
+        bvh.build( triBounds, BVH::BuildMethod::SweepSAH );
+        ReportBuild( "sweep", 1, bvh );
+    }
+}
+
+
+
+void Benchmark::BVHRefit( int numTriangles )
+{
+    static constexpr int numFrames = 12;
+    static constexpr double swirlPerFrame = 0.5;
+
+    BVH bvh;
+    bvh.build( TriangleBounds( MakeHeightField( numTriangles ) ), BVH::BuildMethod::BinnedSAH );
+    printf( "BVH refit over %d triangles, initial build %.3f sec, rebuild threshold %.2f\n", 
+            (int)bvh.primIndices().size(), bvh.buildStats().buildTime, bvh.rebuildThreshold() );
+    printf( "%6s %8s %12s %10s %10s %12s %14s\n", "frame", "action", "update (sec)", "SAH cost", "SAH growth", 
+            "rebuilt cost", "rebuild (sec)" );
+
+    for ( int frame = 1; frame <= numFrames; frame++ )
+    {
+        vector<BoundingBox> triBounds = TriangleBounds( MakeHeightField( numTriangles, frame * swirlPerFrame ) );
+
+        double startTime = Util::GetCurrRealTime();
+        bool rebuilt = bvh.update( triBounds );
+        double updateTime = Util::GetCurrRealTime() - startTime;
+
+        // What a full rebuild of this frame would cost and give.
+        BVH reference;
+        reference.build( triBounds, BVH::BuildMethod::BinnedSAH );
+
+        BVH::BuildStats stats = reference.buildStats();
+        printf( "%6d %8s %12.3f %10.3f %10.3f %12.3f %14.3f\n", frame, rebuilt? "rebuild" : "refit", updateTime, 
+                bvh.sahGrowth() * bvh.buildStats().sahCost, bvh.sahGrowth(), stats.sahCost, stats.buildTime );
+    }
+}
+
+
+
+void Benchmark::TriangleMeshTrace( int numTriangles )
+{
+    static constexpr int raysPerSide = 1000;
+
+    vector<Vector3r> positions;
+    vector<int> indices;
+    MakeHeightFieldMesh( numTriangles, 0.0, positions, indices );
+    vector<Vector3r> vertices = MakeHeightField( numTriangles );
+    int numTris = (int)indices.size() / 3;
+
+    // One Triangle object per triangle, in a SurfaceBVH.
+    double startTime = Util::GetCurrRealTime();
+    vector<Surface*> triangles( numTris );
+    for ( int i = 0; i < numTris; i++ )
+    {
+        triangles[i] = new Triangle( vertices[3*i], vertices[3*i + 1], vertices[3*i + 2], 0 );
+    }
+    SurfaceBVH soup;
+    soup.build( triangles );
+    double soupBuildTime = Util::GetCurrRealTime() - startTime;
+    size_t soupBytes = numTris * ( sizeof( Triangle ) + sizeof( Surface* ) * 2 )
+                     + soup.bvh().nodes().capacity() * sizeof( BVH::Node ) + soup.bvh().primIndices().capacity() * sizeof( int );
+
+    startTime = Util::GetCurrRealTime();
+    TriangleMesh mesh( positions, indices, 0 );
+    double meshBuildTime = Util::GetCurrRealTime() - startTime;
+
+    printf( "Closest-hit queries of %d rays against %d triangles\n", raysPerSide * raysPerSide, numTris );
+    printf( "%-10s %10s %12s %12s %14s\n", "storage", "hits", "trace (sec)", "build (sec)", "bytes/triangle" );
+
+    // Rays from above through a grid over the mesh, slightly tilted.
+    auto traceAll = [&]( const char *storage, double buildTime, size_t bytes, auto &&hitFunc )
+    {
+        int numHits = 0;
+        double startTime = Util::GetCurrRealTime();
+        for ( int j = 0; j < raysPerSide; j++ )
+            for ( int i = 0; i < raysPerSide; i++ )
+            {
+                Ray r( Vector3r( ( i + 0.5 ) / raysPerSide, 1.0, ( j + 0.5 ) / raysPerSide ), Vector3r( 0.1, -1.0, 0.05 ) );
+                SurfaceHit hit;
+                if ( hitFunc( r, hit ) ) numHits++;
+            }
+        double traceTime = Util::GetCurrRealTime() - startTime;
+        printf( "%-10s %10d %12.3f %12.3f %14.1f\n", storage, numHits, traceTime, buildTime, (double)bytes / numTris );
+    };
+
+    traceAll( "triangles", soupBuildTime, soupBytes,
+              [&]( const Ray &r, SurfaceHit &hit ) { return soup.hit( r, 0, numeric_limits<Real>::max(), hit ); } );
+    traceAll( "mesh", meshBuildTime, mesh.memoryBytes(),
+              [&]( const Ray &r, SurfaceHit &hit ) { return mesh.hit( r, 0, numeric_limits<Real>::max(), hit ); } );
+
+    // Where the memory of the mesh goes, and how much less it needs than the triangles.
+    double bvhBytes = (double)mesh.bvh().nodes().capacity() * sizeof( BVH::Node ) 
+                    + (double)mesh.bvh().primIndices().capacity() * sizeof( int );
+    printf( "mesh bytes/triangle: %.1f vertices and indices, %.1f BVH; %.1fx less than triangles\n", 
+            ( mesh.memoryBytes() - bvhBytes ) / numTris, bvhBytes / numTris, (double)soupBytes / mesh.memoryBytes() );
+
+    for ( Surface *triangle : triangles ) delete triangle;
+}
+
+
+
+void Benchmark::PrimaryRays( int numTriangles )
+{
+    static constexpr int imageWidth = 3840;
+    static constexpr int imageHeight = 2160;
+    static constexpr int tileSize = RayPacket::SIZE;
+
+    // A height-field mesh seen at an angle, with the background above its far edge.
+    // Its triangles are turned to face up, toward the light of the shading test.
+    Scene scene;
+    vector<Vector3r> vertices = MakeHeightField( numTriangles );
+    int numTris = (int)vertices.size() / 3;
+    for ( int i = 0; i < numTris; i++ )
+    {
+        scene.surfaces.push_back( new Triangle( vertices[3*i], vertices[3*i + 2], vertices[3*i + 1], 0 ) );
+    }
+    scene.materials.resize( 1 );
+    scene.camera = Camera( Vector3r( 0.5, 0.6, 1.5 ), Vector3r( 0.5, 0.0, 0.3 ), Vector3r( 0.0, 1.0, 0.0 ),
+                           -(Real)imageWidth / imageHeight, (Real)imageWidth / imageHeight, -1, 1, 2,
+                           imageWidth, imageHeight );
+
+    CompiledScene compiled( scene );
+    compiled.bvh().setCollectStats( true );
+
+    printf( "Primary rays of a %dx%d image of %d triangles, traced one by one and in %dx%d packets\n", 
+            imageWidth, imageHeight, numTris, tileSize, tileSize );
+    printf( "%-8s %10s %12s %12s %12s %12s\n", "tracing", "hits", "time (sec)", "Mrays/sec", "nodes/ray", "tests/ray" );
+
+    // Traces the image tile by tile. traceTile( x0, y0, x1, y1 ) returns the number of hits in the tile.
+    auto traceAll = [&]( const char *tracing, auto &&traceTile )
+    {
+        compiled.bvh().resetTraversalStats();
+        int numHits = 0;
+        double startTime = Util::GetCurrRealTime();
+        for ( int y0 = 0; y0 < imageHeight; y0 += tileSize )
+            for ( int x0 = 0; x0 < imageWidth; x0 += tileSize )
+                numHits += traceTile( x0, y0, Util::Min2( x0 + tileSize, imageWidth ), Util::Min2( y0 + tileSize, imageHeight ) );
+        double time = Util::GetCurrRealTime() - startTime;
+
+        BVH::TraversalStats stats = compiled.bvh().traversalStats();
+        double numRays = (double)imageWidth * imageHeight;
+        printf( "%-8s %10d %12.3f %12.2f %12.2f %12.2f\n", tracing, numHits, time, numRays / time * 1e-6,
+                stats.nodesVisited / numRays, stats.primTests / numRays );
+    };
+
+    auto pixelRay = [&]( int x, int y ) { return scene.camera.getRay( x + Real( 0.5 ), y + Real( 0.5 ) ).makeUnitDirection(); };
+
+    traceAll( "rays", [&]( int x0, int y0, int x1, int y1 )
+        {
+            int numHits = 0;
+            for ( int y = y0; y < y1; y++ )
+                for ( int x = x0; x < x1; x++ )
+                {
+                    SurfaceHitRecord rec;
+                    if ( compiled.hit( pixelRay( x, y ), 0, numeric_limits<Real>::max(), rec ) ) numHits++;
+                }
+            return numHits;
+        } );
+
+    int numIncoherent = 0;
+    traceAll( "packets", [&]( int x0, int y0, int x1, int y1 )
+        {
+            RayPacket packet;
+            for ( int y = y0; y < y1; y++ )
+                for ( int x = x0; x < x1; x++ ) packet.addRay( pixelRay( x, y ) );
+            packet.finalize();
+            if ( !packet.isCoherent() ) numIncoherent++;
+
+            SurfaceHitRecord recs[ RayPacket::MAX_RAYS ];
+            bool hasHit[ RayPacket::MAX_RAYS ];
+            compiled.hitPacket( packet, 0, numeric_limits<Real>::max(), recs, hasHit );
+            int numHits = 0;
+            for ( int i = 0; i < packet.numRays(); i++ ) numHits += hasHit[i]? 1 : 0;
+            return numHits;
+        } );
+    printf( "Packets traced ray by ray for diverging directions: %d\n", numIncoherent );
+
+    // Full shading with shadows, where the packets also trace the shadow rays of their hits together.
+    // A row of spheres on the mesh casts shadows on it, and their terminators face the camera.
+    scene.ptLights.push_back( { Vector3r( 1.2, 0.5, 0.5 ), Color( 1.0f, 1.0f, 1.0f ) } );
+    scene.materials[0].k_d = Color( 0.8f, 0.8f, 0.8f );
+    scene.materials[0].k_r = Color( 0.5f, 0.5f, 0.5f );
+    scene.materials[0].n = 16.0f;
+    const int numSpheres = 5;
+    for ( int i = 0; i < numSpheres; i++ ) scene.surfaces.push_back( new Sphere( Vector3r( 0.2 + 0.15 * i, 0.12, 0.5 ), 0.06, 0 ) );
+    CompiledScene lit( scene );
+
+    // The red channel of each pixel as shaded ray by ray, which the packets must reproduce.
+    vector<float> rayColors( (size_t)imageWidth * imageHeight );
+    long long numDiffering = 0;
+
+    printf( "Shaded with shadows from one point light, over %d spheres on the mesh\n", numSpheres );
+    printf( "%-8s %12s %12s %14s\n", "tracing", "time (sec)", "Mrays/sec", "color sum" );
+    auto shadeAll = [&]( const char *tracing, auto &&shadeTile )
+    {
+        double colorSum = 0.0;
+        double startTime = Util::GetCurrRealTime();
+        for ( int y0 = 0; y0 < imageHeight; y0 += tileSize )
+            for ( int x0 = 0; x0 < imageWidth; x0 += tileSize )
+                colorSum += shadeTile( x0, y0, Util::Min2( x0 + tileSize, imageWidth ), Util::Min2( y0 + tileSize, imageHeight ) );
+        double time = Util::GetCurrRealTime() - startTime;
+        printf( "%-8s %12.3f %12.2f %14.1f\n", tracing, time, (double)imageWidth * imageHeight / time * 1e-6, colorSum );
+    };
+
+    shadeAll( "rays", [&]( int x0, int y0, int x1, int y1 )
+        {
+            double colorSum = 0.0;
+            for ( int y = y0; y < y1; y++ )
+                for ( int x = x0; x < x1; x++ )
+                {
+                    // TraceRay normalizes the direction itself, as RenderTileByRays leaves it to.
+                    Ray ray = scene.camera.getRay( x + Real( 0.5 ), y + Real( 0.5 ) );
+                    float r = Raytrace::TraceRay( ray, lit, 0, true ).r();
+                    rayColors[ (size_t)y * imageWidth + x ] = r;
+                    colorSum += r;
+                }
+            return colorSum;
+        } );
+
+    shadeAll( "packets", [&]( int x0, int y0, int x1, int y1 )
+        {
+            RayPacket packet;
+            for ( int y = y0; y < y1; y++ )
+                for ( int x = x0; x < x1; x++ ) packet.addRay( pixelRay( x, y ) );
+            packet.finalize();
+
+            Color colors[ RayPacket::MAX_RAYS ];
+            Raytrace::TracePacket( packet, lit, 0, true, colors );
+            double colorSum = 0.0;
+            for ( int i = 0; i < packet.numRays(); i++ )
+            {
+                colorSum += colors[i].r();
+                int x = x0 + i % ( x1 - x0 ), y = y0 + i / ( x1 - x0 );
+                if ( colors[i].r() != rayColors[ (size_t)y * imageWidth + x ] ) numDiffering++;
+            }
+            return colorSum;
+        } );
+    printf( "Pixels shaded differently by packets than by rays: %lld\n", numDiffering );
+
+    for ( Surface *surface : scene.surfaces ) delete surface;
+}
+
+
+
+void Benchmark::ReflectedRays( int numSpheres )
+{
+    static constexpr int imageWidth = 1920;
+    static constexpr int imageHeight = 1080;
+    static constexpr int reflectLevels = 2;
+
+    // Random mirror-like spheres in the unit cube, filling about a tenth of
+    // it, seen from the front, so that the reflected rays scatter inside it.
+    mt19937 rng( 1 );
+    uniform_real_distribution<double> unit( 0.0, 1.0 );
+    double radius = cbrt( 0.1 / numSpheres * 3.0 / ( 4.0 * M_PI ) );
+    Scene scene;
+    for ( int i = 0; i < numSpheres; i++ )
+    {
+        Vector3r center( unit( rng ), unit( rng ), unit( rng ) );
+        scene.surfaces.push_back( new Sphere( center, Real( radius * ( 0.5 + unit( rng ) ) ), i % 2 ) );
+    }
+    scene.materials.resize( 2 );
+    scene.materials[0].k_d = scene.materials[0].k_a = Color( 0.8f, 0.4f, 0.4f );
+    scene.materials[1].k_d = scene.materials[1].k_a = Color( 0.4f, 0.4f, 0.8f );
+    for ( Material &material : scene.materials ) material.k_rg = Color( 0.5f, 0.5f, 0.5f );
+    scene.ptLights.push_back( { Vector3r( 3.0, 4.0, -5.0 ), Color( 1.0f, 1.0f, 1.0f ) } );
+    scene.camera = Camera( Vector3r( 0.5, 0.5, -1.5 ), Vector3r( 0.5, 0.5, 0.5 ), Vector3r( 0.0, 1.0, 0.0 ),
+                           -(Real)imageWidth / imageHeight * 0.3, (Real)imageWidth / imageHeight * 0.3, -0.3, 0.3, 1,
+                           imageWidth, imageHeight );
+    CompiledScene compiled( scene );
+
+    printf( "A %dx%d image of %d reflective spheres with %d levels of reflection\n", 
+            imageWidth, imageHeight, numSpheres, reflectLevels );
+    printf( "%-10s %12s %12s %12s %12s %12s %14s\n", "order", "time (sec)", "reflected", "sort (sec)", "Mrays/sec", 
+            "shade (sec)", "color sum" );
+
+    // Renders the image with render( image, stats ), reporting the tracing rate of the reflected rays.
+    auto renderAll = [&]( const char *order, auto &&render )
+    {
+        Image image( imageWidth, imageHeight );
+        Wavefront::Stats stats;
+        double startTime = Util::GetCurrRealTime();
+        render( image, stats );
+        double time = Util::GetCurrRealTime() - startTime;
+
+        double colorSum = 0.0;
+        for ( int y = 0; y < imageHeight; y++ )
+            for ( int x = 0; x < imageWidth; x++ ) colorSum += image.getPixel( x, y ).r();
+        if ( stats.reflectedRays == 0 )
+        {
+            printf( "%-10s %12.3f %12s %12s %12s %12s %14.1f\n", order, time, "-", "-", "-", "-", colorSum );
+            return;
+        }
+        printf( "%-10s %12.3f %12lld %12.3f %12.2f %12.3f %14.1f\n", order, time, stats.reflectedRays, stats.sortTime,
+                stats.reflectedRays / stats.reflectedTime * 1e-6, stats.shadeTime, colorSum );
+    };
+
+    renderAll( "recursive", [&]( Image &image, Wavefront::Stats & )
+        {
+            #ifndef __APPLE__
+            #pragma omp parallel for schedule( dynamic )
+            #endif
+            for ( int y = 0; y < imageHeight; y++ )
+                for ( int x = 0; x < imageWidth; x++ )
+                {
+                    Ray ray = scene.camera.getRay( x + Real( 0.5 ), y + Real( 0.5 ) );
+                    Color pixelColor = Raytrace::TraceRay( ray, compiled, reflectLevels, false );
+                    pixelColor.clamp();
+                    image.setPixel( x, y, pixelColor );
+                }
+        } );
+
+    renderAll( "wavefront", [&]( Image &image, Wavefront::Stats &stats )
+        { Wavefront::RenderImage( image, compiled, reflectLevels, false, false, &stats ); } );
+
+    renderAll( "sorted", [&]( Image &image, Wavefront::Stats &stats )
+        { Wavefront::RenderImage( image, compiled, reflectLevels, false, true, &stats ); } );
+
+    for ( Surface *sphere : scene.surfaces ) delete sphere;
+}
+
+
+
+void Benchmark::PhongShading( int numPoints )
+{
+    static constexpr int numLights = 32;
+
+    // The accuracy of FastPow() against pow() in double, over x in (0, 1].
+    printf( "FastPow relative error, where x^n > 1e-30\n" );
+    for ( float n : { 0.5f, 1.0f, 8.0f, 64.0f, 128.0f } )
+    {
+        double maxError = 0.0;
+        for ( int i = 1; i <= 1000000; i++ )
+        {
+            float x = i / 1000000.0f;
+            double exact = pow( (double)x, (double)n );
+            if ( exact > 1e-30 ) maxError = Util::Max2( maxError, fabs( Shading::FastPow( x, n ) - exact ) / exact );
+        }
+        printf( "  n = %5.1f: %.3g\n", n, maxError );
+    }
+
+    // Random points on the unit sphere, facing out, seen from random
+    // directions, lit by lights around the sphere.
+    mt19937 rng( 1 );
+    uniform_real_distribution<double> unit( -1.0, 1.0 );
+    auto randomUnitVector = [&]() { Vector3r v; do v = Vector3r( unit( rng ), unit( rng ), unit( rng ) ); while ( v.length() > 1 || v.length() < 0.1 ); return v.unitVector(); };
+    vector<Real> coords[9];
+    for ( int k = 0; k < numPoints; k++ )
+    {
+        Vector3r p = randomUnitVector(), v = randomUnitVector();
+        if ( dot( p, v ) < 0 ) v = -v;
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            coords[ axis ].push_back( p[ axis ] );
+            coords[ 3 + axis ].push_back( p[ axis ] );
+            coords[ 6 + axis ].push_back( v[ axis ] );
+        }
+    }
+    Shading::PointBatch points = { coords[0].data(), coords[1].data(), coords[2].data(), coords[3].data(), coords[4].data(), 
+                                   coords[5].data(), coords[6].data(), coords[7].data(), coords[8].data() };
+    vector<PointLightSource> lights( numLights );
+    for ( PointLightSource &light : lights ) light = { 3 * randomUnitVector(), Color( 1.0f, 1.0f, 1.0f ) / numLights };
+    Material material;
+    material.k_d = Color( 0.6f, 0.4f, 0.4f );
+    material.k_r = Color( 0.4f, 0.4f, 0.4f );
+    material.n = 64.0f;
+
+    printf( "Phong lighting of %d points of one material by %d lights\n", numPoints, numLights );
+    printf( "%-10s %12s %16s %12s\n", "kernel", "time (sec)", "Mshadings/sec", "max error" );
+
+    vector<Color> exact( (size_t)numPoints * numLights ), result( exact.size() );
+    double startTime = Util::GetCurrRealTime();
+    for ( int l = 0; l < numLights; l++ )
+        for ( int k = 0; k < numPoints; k++ )
+        {
+            Vector3r p( points.px[k], points.py[k], points.pz[k] );
+            Vector3r N( points.nx[k], points.ny[k], points.nz[k] );
+            Vector3r V( points.vx[k], points.vy[k], points.vz[k] );
+            Vector3r L = ( lights[l].position - p ).unitVector();
+            exact[ (size_t)l * numPoints + k ] = Shading::PhongLighting( L, N, V, material, lights[l] );
+        }
+    double time = Util::GetCurrRealTime() - startTime;
+    printf( "%-10s %12.3f %16.2f %12s\n", "reference", time, (double)numPoints * numLights / time * 1e-6, "-" );
+
+    ISA defaultISA = Shading::isa();
+    for ( ISA isa : { ISA::Scalar, ISA::AVX2 } )
+    {
+        Shading::setISA( isa );
+        if ( Shading::isa() != isa ) continue;  // Not supported by this CPU.
+
+        startTime = Util::GetCurrRealTime();
+        for ( int l = 0; l < numLights; l++ ) 
+            Shading::PhongLightingBatch( points, 0, numPoints, material, lights[l], &result[ (size_t)l * numPoints ] );
+        time = Util::GetCurrRealTime() - startTime;
+
+        double maxError = 0.0;
+        for ( size_t i = 0; i < exact.size(); i++ )
+            for ( int ch = 0; ch < 3; ch++ ) maxError = Util::Max2( maxError, (double)fabs( result[i][ch] - exact[i][ch] ) );
+        printf( "%-10s %12.3f %16.2f %12.3g\n", ISAName( isa ), time, (double)numPoints * numLights / time * 1e-6, maxError );
+    }
+    Shading::setISA( defaultISA );
+}
+
+
+
+void Benchmark::ManyLights( int numLights )
+{
+    static constexpr int imageWidth = 256;
+    static constexpr int imageHeight = 144;
+    static constexpr int numSpheres = 200;
+
+    // A floor over the unit square with random spheres on it, lit by random
+    // lights spread over a ceiling above it, that add up to unit intensity.
+    mt19937 rng( 1 );
+    uniform_real_distribution<double> unit( 0.0, 1.0 );
+    Scene scene;
+    scene.surfaces.push_back( new Triangle( Vector3r( 0, 0, 0 ), Vector3r( 0, 0, 1 ), Vector3r( 1, 0, 0 ), 0 ) );
+    scene.surfaces.push_back( new Triangle( Vector3r( 1, 0, 0 ), Vector3r( 0, 0, 1 ), Vector3r( 1, 0, 1 ), 0 ) );
+    for ( int i = 0; i < numSpheres; i++ )
+    {
+        Real radius = Real( 0.01 + 0.03 * unit( rng ) );
+        scene.surfaces.push_back( new Sphere( Vector3r( unit( rng ), radius, unit( rng ) ), radius, 1 ) );
+    }
+    for ( int l = 0; l < numLights; l++ )
+    {
+        Vector3r position( unit( rng ), 0.3 + 0.05 * unit( rng ), unit( rng ) );
+        scene.ptLights.push_back( { position, Color( 1.0f, 0.9f, 0.8f ) / (float)numLights } );
+    }
+    scene.materials.resize( 2 );
+    scene.materials[0].k_d = Color( 0.8f, 0.8f, 0.8f );
+    scene.materials[1].k_d = Color( 0.8f, 0.3f, 0.3f );
+    scene.materials[1].k_r = Color( 0.5f, 0.5f, 0.5f );
+    scene.materials[1].n = 32.0f;
+    scene.camera = Camera( Vector3r( 0.5, 0.25, 1.4 ), Vector3r( 0.5, 0.0, 0.5 ), Vector3r( 0.0, 1.0, 0.0 ),
+                           -(Real)imageWidth / imageHeight * 0.5, (Real)imageWidth / imageHeight * 0.5, -0.5, 0.5, 1,
+                           imageWidth, imageHeight );
+    CompiledScene compiled( scene );
+
+    printf( "A %dx%d image of a floor with %d spheres lit by %d point lights, with shadows\n", 
+            imageWidth, imageHeight, numSpheres, numLights );
+    printf( "%-20s %12s %12s %12s %12s %12s\n", "lighting", "time (sec)", "traced/hit", "culled/hit", 
+            "mean error", "max error" );
+
+    int numHits = 0;
+    for ( int y = 0; y < imageHeight; y++ )
+        for ( int x = 0; x < imageWidth; x++ )
+        {
+            SurfaceHitRecord rec;
+            numHits += compiled.hit( scene.camera.getRay( x + Real( 0.5 ), y + Real( 0.5 ) ), 
+                                     Shading::DEFAULT_TMIN, Shading::DEFAULT_TMAX, rec );
+        }
+
+    // Renders the image with the cut limits of the light tree and the shadow
+    // cull threshold, and reports its error against exact, which the first
+    // rendering fills in.
+    vector<Color> exact, image( (size_t)imageWidth * imageHeight );
+    auto renderAll = [&]( const char *lighting )
+    {
+        Shading::resetShadowStats();
+        double startTime = Util::GetCurrRealTime();
+        #ifndef __APPLE__
+        #pragma omp parallel for schedule( dynamic )
+        #endif
+        for ( int y = 0; y < imageHeight; y++ )
+            for ( int x = 0; x < imageWidth; x++ )
+            {
+                Ray ray = scene.camera.getRay( x + Real( 0.5 ), y + Real( 0.5 ) );
+                Color pixelColor = Raytrace::TraceRay( ray, compiled, 0, true );
+                pixelColor.clamp();
+                image[ (size_t)y * imageWidth + x ] = pixelColor;
+            }
+        double time = Util::GetCurrRealTime() - startTime;
+        Shading::ShadowStats stats = Shading::shadowStats();
+
+        if ( exact.empty() ) exact = image;
+        double sumError = 0.0, maxError = 0.0;
+        for ( size_t i = 0; i < image.size(); i++ )
+            for ( int ch = 0; ch < 3; ch++ )
+            {
+                double error = fabs( image[i][ch] - exact[i][ch] );
+                sumError += error;
+                maxError = Util::Max2( maxError, error );
+            }
+        double perHit = 1.0 / Util::Max2( 1, numHits );
+        printf( "%-20s %12.3f %12.1f %12.1f %12.4f %12.4f\n", lighting, time, stats.traced * perHit, stats.culled * perHit,
+                sumError / ( 3.0 * image.size() ), maxError );
+    };
+
+    Shading::setCollectShadowStats( true );
+    float defaultThreshold = Shading::shadowCullThreshold();
+    for ( float threshold : { -1.0f, 0.0f, 1e-4f } )
+    {
+        Shading::setShadowCullThreshold( threshold );
+        char lighting[32];
+        snprintf( lighting, sizeof( lighting ), ( threshold < 0 )? "every light" : "every light, >%g", threshold );
+        renderAll( lighting );
+    }
+    Shading::setShadowCullThreshold( defaultThreshold );
+
+    for ( auto [maxError, maxShadowRays] : { pair<float, int>{ 0.02f, 8 }, { 0.02f, 16 }, { 0.02f, 32 }, { 0.002f, 64 }, { 0.2f, 64 } } )
+    {
+        compiled.lightTree().setCutLimits( maxError, maxShadowRays );
+        char lighting[32];
+        snprintf( lighting, sizeof( lighting ), "cut %g, <= %d", maxError, maxShadowRays );
+        renderAll( lighting );
+    }
+    Shading::setCollectShadowStats( false );
+
+    for ( Surface *surface : scene.surfaces ) delete surface;
+}
+
+
+
+void Benchmark::TriangleKernel( int numRays )
+{
+    static constexpr int numTriangles = 1000;
+
+    // Random triangles of size about 0.1 to 0.3, and random rays, in the unit cube.
+    mt19937 rng( 1 );
+    uniform_real_distribution<double> unit( 0.0, 1.0 ), offset( -0.15, 0.15 );
+    auto randomPoint = [&]() { return Vector3r( unit( rng ), unit( rng ), unit( rng ) ); };
+    auto randomOffset = [&]() { return Vector3r( offset( rng ), offset( rng ), offset( rng ) ); };
+
+    vector<Vector3r> vertices( 3 * numTriangles );
+    vector<PrecomputedTriangle> precomputed( numTriangles );
+    vector<TriangleBatch> batches( ( numTriangles + TriangleBatch::WIDTH - 1 ) / TriangleBatch::WIDTH );
+    for ( int i = 0; i < numTriangles; i++ )
+    {
+        Vector3r c = randomPoint();
+        vertices[3*i] = c + randomOffset();
+        vertices[3*i + 1] = c + randomOffset();
+        vertices[3*i + 2] = c + randomOffset();
+        precomputed[i] = PrecomputedTriangle( vertices[3*i], vertices[3*i + 1], vertices[3*i + 2] );
+        batches[ i / TriangleBatch::WIDTH ].set( i % TriangleBatch::WIDTH, vertices[3*i], vertices[3*i + 1], vertices[3*i + 2] );
+    }
+
+    vector<Ray> rays( numRays );
+    for ( Ray &r : rays ) r.setRay( randomPoint(), ( randomPoint() - randomPoint() ).makeUnitVector() );
+
+    printf( "Closest-hit tests of %d rays against each of %d triangles\n", numRays, numTriangles );
+    printf( "%-18s %10s %12s %14s %12s\n", "kernel", "hits", "time (sec)", "Mtests/sec", "t sum" );
+
+    auto runKernel = [&]( const char *kernel, auto &&hitTriangle )
+    {
+        int numHits = 0;
+        double tSum = 0.0;
+        double startTime = Util::GetCurrRealTime();
+        for ( const Ray &r : rays )
+        {
+            Real tmax = numeric_limits<Real>::max();
+            for ( int i = 0; i < numTriangles; i++ )
+            {
+                Real t, beta, gamma;
+                if ( hitTriangle( i, r, tmax, t, beta, gamma ) ) { tmax = t; numHits++; }
+            }
+            if ( tmax < numeric_limits<Real>::max() ) tSum += tmax;
+        }
+        double time = Util::GetCurrRealTime() - startTime;
+        printf( "%-18s %10d %12.3f %14.1f %12.3f\n", kernel, numHits, time, 
+                (double)numRays * numTriangles / time * 1e-6, tSum );
+    };
+
+    runKernel( "moller-trumbore", [&]( int i, const Ray &r, Real tmax, Real &t, Real &beta, Real &gamma )
+        { return HitMollerTrumbore( vertices[3*i], vertices[3*i + 1], vertices[3*i + 2], r, 0, tmax, t, beta, gamma ); } );
+    runKernel( "precomputed", [&]( int i, const Ray &r, Real tmax, Real &t, Real &beta, Real &gamma )
+        { return precomputed[i].hit( r, 0, tmax, t, beta, gamma ); } );
+
+    // The batch kernels test WIDTH triangles per call, made on the first lane of each batch.
+    ISA defaultISA = TriangleBatch::isa();
+    for ( ISA isa : { ISA::Scalar, ISA::AVX2 } )
+    {
+        TriangleBatch::setISA( isa );
+        if ( TriangleBatch::isa() != isa ) continue;  // Not supported by this CPU.
+
+        string kernel = string( "batch-" ) + ISAName( isa );
+        runKernel( kernel.c_str(), [&]( int i, const Ray &r, Real tmax, Real &t, Real &beta, Real &gamma )
+            {
+                if ( i % TriangleBatch::WIDTH != 0 ) return false;
+                t = tmax;
+                return batches[ i / TriangleBatch::WIDTH ].hit( r, 0, t, beta, gamma ) >= 0;
+            } );
+    }
+    TriangleBatch::setISA( defaultISA );
+}
+
+
+
+void Benchmark::SphereSetTrace( int numSpheres )
+{
+    static constexpr int raysPerSide = 1000;
+
+    // Random spheres in the unit cube, filling about a tenth of it.
+    mt19937 rng( 1 );
+    uniform_real_distribution<double> unit( 0.0, 1.0 );
+    double radius = cbrt( 0.1 / numSpheres * 3.0 / ( 4.0 * M_PI ) );
+    vector<Vector3r> centers( numSpheres );
+    vector<Real> radii( numSpheres );
+    vector<Surface*> spheres( numSpheres );
+    for ( int i = 0; i < numSpheres; i++ )
+    {
+        centers[i] = Vector3r( unit( rng ), unit( rng ), unit( rng ) );
+        radii[i] = Real( radius * ( 0.5 + unit( rng ) ) );
+        spheres[i] = new Sphere( centers[i], radii[i], 0 );
+    }
+
+    SurfaceBVH sphereBVH;
+    sphereBVH.build( spheres );
+    size_t sphereBytes = numSpheres * ( sizeof( Sphere ) + sizeof( Surface* ) * 2 )
+                       + sphereBVH.bvh().nodes().capacity() * sizeof( BVH::Node ) + sphereBVH.bvh().primIndices().capacity() * sizeof( int );
+    SphereSet sphereSet( centers, radii, 0 );
+
+    printf( "Closest-hit and shadow queries of %d rays against %d spheres\n", raysPerSide * raysPerSide, numSpheres );
+    printf( "%-16s %10s %12s %10s %12s %13s\n", "storage", "hits", "trace (sec)", "occluded", "shadow (sec)", "bytes/sphere" );
+
+    // Rays through a grid over the cube from a point in front of it, and
+    // shadow rays from the same points toward a light beyond the cube.
+    auto traceAll = [&]( const char *storage, size_t bytes, const Surface *surface, const SurfaceBVH *bvh )
+    {
+        int numHits = 0, numOccluded = 0;
+        double startTime = Util::GetCurrRealTime();
+        for ( int j = 0; j < raysPerSide; j++ )
+            for ( int i = 0; i < raysPerSide; i++ )
+            {
+                Vector3r target( ( i + 0.5 ) / raysPerSide, ( j + 0.5 ) / raysPerSide, 0.5 );
+                Ray r( Vector3r( 0.5, 0.5, -2.0 ), target - Vector3r( 0.5, 0.5, -2.0 ) );
+                r.makeUnitDirection();
+                SurfaceHit hit;
+                if ( ( surface != nullptr )? surface->hit( r, 0, numeric_limits<Real>::max(), hit ) : bvh->hit( r, 0, numeric_limits<Real>::max(), hit ) ) numHits++;
+            }
+        double traceTime = Util::GetCurrRealTime() - startTime;
+
+        startTime = Util::GetCurrRealTime();
+        for ( int j = 0; j < raysPerSide; j++ )
+            for ( int i = 0; i < raysPerSide; i++ )
+            {
+                Vector3r p( ( i + 0.5 ) / raysPerSide, ( j + 0.5 ) / raysPerSide, 0.5 );
+                Vector3r toLight = Vector3r( 3.0, 4.0, 5.0 ) - p;
+                double lightDist = toLight.length();
+                Ray r( p, toLight / lightDist );
+                if ( ( surface != nullptr )? surface->shadowHit( r, 1e-6, lightDist ) : bvh->shadowHit( r, 1e-6, lightDist ) ) numOccluded++;
+            }
+        double shadowTime = Util::GetCurrRealTime() - startTime;
+        printf( "%-16s %10d %12.3f %10d %12.3f %13.1f\n", storage, numHits, traceTime, numOccluded, shadowTime, 
+                (double)bytes / numSpheres );
+    };
+
+    traceAll( "spheres", sphereBytes, nullptr, &sphereBVH );
+
+    ISA defaultISA = SphereBatch::isa();
+    for ( ISA isa : { ISA::Scalar, ISA::AVX2 } )
+    {
+        SphereBatch::setISA( isa );
+        if ( SphereBatch::isa() != isa ) continue;  // Not supported by this CPU.
+
+        string storage = string( "set-" ) + ISAName( isa );
+        traceAll( storage.c_str(), sphereSet.memoryBytes(), &sphereSet, nullptr );
+    }
+    SphereBatch::setISA( defaultISA );
+
+    for ( Surface *sphere : spheres ) delete sphere;
+}
+
+
+
+void Benchmark::ParticleSetTrace( int numSpheres )
+{
+    static constexpr int raysPerSide = 1000;
+
+    // Random spheres in the unit cube, filling about a tenth of it, in four materials.
+    double startTime = Util::GetCurrRealTime();
+    mt19937 rng( 1 );
+    uniform_real_distribution<double> unit( 0.0, 1.0 );
+    double radius = cbrt( 0.1 / numSpheres * 3.0 / ( 4.0 * M_PI ) );
+    ParticleSet particles;
+    particles.reserve( numSpheres );
+    for ( int i = 0; i < numSpheres; i++ )
+    {
+        Vector3r center( unit( rng ), unit( rng ), unit( rng ) );
+        particles.addSphere( center, radius * ( 0.5 + unit( rng ) ), i % 4 );
+    }
+    double makeTime = Util::GetCurrRealTime() - startTime;
+
+    startTime = Util::GetCurrRealTime();
+    particles.build();
+    double buildTime = Util::GetCurrRealTime() - startTime;
+
+    printf( "ParticleSet of %d spheres: made in %.3f sec, built in %.3f sec, %d nodes, %.1f bytes/sphere, %.1f MB\n",
+            numSpheres, makeTime, buildTime, particles.numNodes(), (double)particles.memoryBytes() / numSpheres, 
+            particles.memoryBytes() / 1048576.0 );
+
+    // Rays through a grid over the cube from a point in front of it, and
+    // shadow rays from the same points toward a light beyond the cube.
+    int numHits = 0, numOccluded = 0;
+    startTime = Util::GetCurrRealTime();
+    for ( int j = 0; j < raysPerSide; j++ )
+        for ( int i = 0; i < raysPerSide; i++ )
+        {
+            Vector3r target( ( i + 0.5 ) / raysPerSide, ( j + 0.5 ) / raysPerSide, 0.5 );
+            Ray r( Vector3r( 0.5, 0.5, -2.0 ), target - Vector3r( 0.5, 0.5, -2.0 ) );
+            r.makeUnitDirection();
+            SurfaceHit hit;
+            if ( particles.hit( r, 0, numeric_limits<Real>::max(), hit ) ) numHits++;
+        }
+    double traceTime = Util::GetCurrRealTime() - startTime;
+
+    startTime = Util::GetCurrRealTime();
+    for ( int j = 0; j < raysPerSide; j++ )
+        for ( int i = 0; i < raysPerSide; i++ )
+        {
+            Vector3r p( ( i + 0.5 ) / raysPerSide, ( j + 0.5 ) / raysPerSide, 0.5 );
+            Vector3r toLight = Vector3r( 3.0, 4.0, 5.0 ) - p;
+            double lightDist = toLight.length();
+            if ( particles.shadowHit( Ray( p, toLight / lightDist ), 1e-6, lightDist ) ) numOccluded++;
+        }
+    double shadowTime = Util::GetCurrRealTime() - startTime;
+
+    printf( "%d primary rays: %d hits in %.3f sec\n", raysPerSide * raysPerSide, numHits, traceTime );
+    printf( "%d shadow rays: %d occluded in %.3f sec\n", raysPerSide * raysPerSide, numOccluded, shadowTime );
+}
+
+
+
+int Benchmark::Run( int argc, char *argv[] )
+{
+    if ( argc >= 1 && strcmp( argv[0], "build" ) == 0 )
+    {
+        BVHBuild( ( argc >= 2 )? atoi( argv[1] ) : 2000000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "refit" ) == 0 )
+    {
+        BVHRefit( ( argc >= 2 )? atoi( argv[1] ) : 1000000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "mesh" ) == 0 )
+    {
+        TriangleMeshTrace( ( argc >= 2 )? atoi( argv[1] ) : 1000000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "primary" ) == 0 )
+    {
+        PrimaryRays( ( argc >= 2 )? atoi( argv[1] ) : 1000000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "reflect" ) == 0 )
+    {
+        ReflectedRays( ( argc >= 2 )? atoi( argv[1] ) : 1000000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "shading" ) == 0 )
+    {
+        PhongShading( ( argc >= 2 )? atoi( argv[1] ) : 100000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "lights" ) == 0 )
+    {
+        ManyLights( ( argc >= 2 )? atoi( argv[1] ) : 2000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "triangle" ) == 0 )
+    {
+        TriangleKernel( ( argc >= 2 )? atoi( argv[1] ) : 100000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "spheres" ) == 0 )
+    {
+        SphereSetTrace( ( argc >= 2 )? atoi( argv[1] ) : 1000000 );
+        return 0;
+    }
+
+    if ( argc >= 1 && strcmp( argv[0], "particles" ) == 0 )
+    {
+        ParticleSetTrace( ( argc >= 2 )? atoi( argv[1] ) : 10000000 );
+        return 0;
+    }
+
+    fprintf( stderr, "Usage: Main [--stats]\n"
+                     "       Main build [numTriangles]\n"
+                     "       Main refit [numTriangles]\n"
+                     "       Main mesh [numTriangles]\n"
+                     "       Main primary [numTriangles]\n"
+                     "       Main reflect [numSpheres]\n"
+                     "       Main shading [numPoints]\n"
+                     "       Main lights [numLights]\n"
+                     "       Main triangle [numRays]\n"
+                     "       Main spheres [numSpheres]\n"
+                     "       Main particles [numSpheres]\n" );
+    return 1;
+}
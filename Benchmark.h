@@ -0,0 +1,121 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+
+// Performance benchmarks of the ray tracer components, run from the
+// command line as:  Main <benchmark> [arguments]
+
+class Benchmark
+{
+public:
+
+    // Runs the benchmark named by argv[0] with arguments argv[1 .. argc-1].
+    // Returns the process exit code.
+    static int Run( int argc, char *argv[] );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "build [numTriangles]": Builds BVHs over a bumpy height-field mesh and
+    // reports build time and SAH cost of the binned and LBVH builders for
+    // 1, 2, 4, ... threads, and of the sweep builder for meshes small enough
+    // to finish.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void BVHBuild( int numTriangles );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "refit [numTriangles]": Animates a height-field mesh with a growing
+    // swirl and updates its BVH every frame, reporting refit time and SAH
+    // growth until the automatic rebuild kicks in, against a full rebuild.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void BVHRefit( int numTriangles );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "mesh [numTriangles]": Traces a grid of rays against a height-field
+    // mesh stored once as Triangle objects in a SurfaceBVH and once as a
+    // TriangleMesh, reporting trace time, build time and memory use.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void TriangleMeshTrace( int numTriangles );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "primary [numTriangles]": Traces the primary rays of a 4K image of a
+    // height-field mesh in a CompiledScene, one ray at a time and in packets
+    // of RayPacket::MAX_RAYS, reporting rays per second and BVH statistics.
+    // Then shades the image with shadows from a point light both ways, with
+    // spheres added on the mesh, and counts the pixels that differ.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void PrimaryRays( int numTriangles );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "reflect [numSpheres]": Renders a cube of random reflective spheres
+    // recursively and with the Wavefront renderer, with its reflected rays
+    // traced in the order they are spawned and sorted for coherence,
+    // reporting render time, the tracing rate of the reflected rays and the
+    // time spent shading.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void ReflectedRays( int numSpheres );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "shading [numPoints]": Reports the accuracy of Shading::FastPow(), and
+    // lights random points of one material by 32 point lights with
+    // Shading::PhongLighting() and with the batch kernels of each
+    // instruction set the CPU supports, reporting shadings per second and
+    // the largest color difference from PhongLighting().
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void PhongShading( int numPoints );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "lights [numLights]": Renders a floor with spheres under a ceiling of
+    // small point lights, with shadows, by evaluating every light, with
+    // shadow rays culled at a few thresholds, and by cuts of the LightTree
+    // at a few error bounds and shadow ray limits, reporting render time,
+    // shadow rays traced and culled per hit and the image error against
+    // tracing every shadow ray.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void ManyLights( int numLights );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "triangle [numRays]": Tests random rays against random triangles with
+    // the Moller-Trumbore kernel on the vertices, the PrecomputedTriangle
+    // kernel, and the TriangleBatch kernels of each instruction set the CPU
+    // supports, reporting ray-triangle tests per second.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void TriangleKernel( int numRays );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "spheres [numSpheres]": Traces primary and shadow rays through a cube
+    // of random spheres, stored once as Sphere objects in a SurfaceBVH and
+    // once as a SphereSet with the kernels of each instruction set the CPU
+    // supports, reporting trace time and memory use.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void SphereSetTrace( int numSpheres );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // "particles [numSpheres]": Makes a ParticleSet of random spheres in a
+    // cube and traces primary and shadow rays through it, reporting build
+    // time, memory use and trace time.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void ParticleSetTrace( int numSpheres );
+
+}; // Benchmark
+
+
+#endif // _BENCHMARK_H_
@@ -0,0 +1,116 @@
+#ifndef _BOUNDINGBOX_H_
+#define _BOUNDINGBOX_H_
+
+#include <cmath>
+#include <cfloat>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include "Vector3d.h"
+
+
+// An axis-aligned bounding box. A default-constructed box is empty
+// (min > max), so expanding it by any point or box gives that point or box.
+
+class BoundingBox
+{
+public:
+
+// Constructors
+
+    BoundingBox() = default;
+
+    BoundingBox( const Vector3r &theMin, const Vector3r &theMax )
+        : mMin( theMin ), mMax( theMax ) {}
+
+
+// Data reading.
+
+    [[nodiscard]] const Vector3r &min() const { return mMin; }
+    [[nodiscard]] const Vector3r &max() const { return mMax; }
+
+
+// Other functions.
+
+    BoundingBox &expand( const Vector3r &p )
+    {
+        mMin.setXYZ( std::min( mMin.x(), p.x() ), std::min( mMin.y(), p.y() ), std::min( mMin.z(), p.z() ) );
+        mMax.setXYZ( std::max( mMax.x(), p.x() ), std::max( mMax.y(), p.y() ), std::max( mMax.z(), p.z() ) );
+        return (*this);
+    }
+
+    BoundingBox &expand( const BoundingBox &b )
+    {
+        mMin.setXYZ( std::min( mMin.x(), b.mMin.x() ), std::min( mMin.y(), b.mMin.y() ), std::min( mMin.z(), b.mMin.z() ) );
+        mMax.setXYZ( std::max( mMax.x(), b.mMax.x() ), std::max( mMax.y(), b.mMax.y() ), std::max( mMax.z(), b.mMax.z() ) );
+        return (*this);
+    }
+
+    [[nodiscard]] bool isEmpty() const
+        { return ( mMin.x() > mMax.x() || mMin.y() > mMax.y() || mMin.z() > mMax.z() ); }
+
+    // A box is bounded iff all its coordinates are finite. Unbounded surfaces
+    // such as planes report a box that extends to infinity.
+    [[nodiscard]] bool isBounded() const
+    {
+        return ( std::isfinite( mMin.x() ) && std::isfinite( mMin.y() ) && std::isfinite( mMin.z() ) &&
+                 std::isfinite( mMax.x() ) && std::isfinite( mMax.y() ) && std::isfinite( mMax.z() ) );
+    }
+
+    [[nodiscard]] Vector3r centroid() const { return 0.5 * ( mMin + mMax ); }
+
+    [[nodiscard]] Vector3r extent() const { return mMax - mMin; }
+
+    [[nodiscard]] Real surfaceArea() const
+    {
+        if ( isEmpty() ) return 0;
+        Vector3r d = extent();
+        return 2 * ( d.x() * d.y() + d.y() * d.z() + d.z() * d.x() );
+    }
+
+    // Returns the axis (0, 1 or 2) along which the box is longest.
+    [[nodiscard]] int maxExtentAxis() const
+    {
+        Vector3r d = extent();
+        if ( d.x() > d.y() && d.x() > d.z() ) return 0;
+        return ( d.y() > d.z() )? 1 : 2;
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Slab test of the ray origin + t * direction against the box, where
+    // invDir holds the reciprocals of the ray direction components. Returns
+    // true iff the ray overlaps the box for some t in [tmin, tmax].
+    //////////////////////////////////////////////////////////////////////////////
+
+    [[nodiscard]] bool hit( const Vector3r &origin, const Vector3r &invDir, Real tmin, Real tmax ) const
+    {
+        for ( int a = 0; a < 3; a++ )
+        {
+            Real t0 = ( mMin[a] - origin[a] ) * invDir[a];
+            Real t1 = ( mMax[a] - origin[a] ) * invDir[a];
+            if ( invDir[a] < 0.0 ) std::swap( t0, t1 );
+            // Written so that a NaN (origin on a slab plane of a zero-width
+            // direction) leaves the interval unchanged.
+            tmin = ( t0 > tmin )? t0 : tmin;
+            tmax = ( t1 < tmax )? t1 : tmax;
+            if ( tmax < tmin ) return false;
+        }
+        return true;
+    }
+
+
+    static BoundingBox infinite()
+        { return { Vector3r( -INFINITY, -INFINITY, -INFINITY ), Vector3r( INFINITY, INFINITY, INFINITY ) }; }
+
+private:
+
+    static constexpr Real MAX = std::numeric_limits<Real>::max();
+
+    Vector3r mMin{ MAX, MAX, MAX };
+    Vector3r mMax{ -MAX, -MAX, -MAX };
+
+}; // BoundingBox
+
+
+#endif // _BOUNDINGBOX_H_
@@ -4,8 +4,8 @@
 
 
 Camera &Camera::setCamera( 
-                const Vector3d &eye, const Vector3d &lookAt, const Vector3d &upVector,
-                double left, double right, double bottom, double top, double near,
+                const Vector3r &eye, const Vector3r &lookAt, const Vector3r &upVector,
+                Real left, Real right, Real bottom, Real top, Real near,
                 int image_width, int image_height )
 {
     assert( image_width > 0 && image_height > 0 );
@@ -13,9 +13,9 @@ Camera &Camera::setCamera(
     mImageHeight = image_height;
 
     mCOP = eye;
-    Vector3d cop_n = (eye - lookAt).unitVector();
-    Vector3d cop_u = cross( upVector.unitVector(), cop_n );
-    Vector3d cop_v = cross( cop_n, cop_u );
+    Vector3r cop_n = (eye - lookAt).unitVector();
+    Vector3r cop_u = cross( upVector.unitVector(), cop_n );
+    Vector3r cop_v = cross( cop_n, cop_u );
 
     mImageOrigin = mCOP + ( left * cop_u ) + ( bottom * cop_v ) + ( -near * cop_n );
 
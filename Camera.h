@@ -20,7 +20,7 @@ public:
 
     Camera() 
     {
-        setCamera( Vector3d( 0, 0, 0 ), Vector3d( 0, 0, -1 ), Vector3d( 0, 1, 0 ),
+        setCamera( Vector3r( 0, 0, 0 ), Vector3r( 0, 0, -1 ), Vector3r( 0, 1, 0 ),
                    -1, 1, -1, 1, 1, 256, 256 );
     }
 
@@ -31,16 +31,16 @@ public:
     // viewport size in pixels.
     //////////////////////////////////////////////////////////////////////////////////////
 
-    Camera( const Vector3d &eye, const Vector3d &lookAt, const Vector3d &upVector,
-            double left, double right, double bottom, double top, double near,
+    Camera( const Vector3r &eye, const Vector3r &lookAt, const Vector3r &upVector,
+            Real left, Real right, Real bottom, Real top, Real near,
             int image_width, int image_height )
     {
         setCamera( eye, lookAt, upVector, left, right, bottom, top, near, image_width, image_height );
     }
 
 
-    Camera &setCamera( const Vector3d &eye, const Vector3d &lookAt, const Vector3d &upVector,
-                    double left, double right, double bottom, double top, double near,
+    Camera &setCamera( const Vector3r &eye, const Vector3r &lookAt, const Vector3r &upVector,
+                    Real left, Real right, Real bottom, Real top, Real near,
                     int image_width, int image_height );
 
 
@@ -71,18 +71,18 @@ public:
     // Note that the ray returned may not have unit direction vector.
     //////////////////////////////////////////////////////////////////////////////////////
 
-    [[nodiscard]] Ray getRay( double pixelPosX, double pixelPosY ) const
+    [[nodiscard]] Ray getRay( Real pixelPosX, Real pixelPosY ) const
     {
-        Vector3d imgPos = mImageOrigin + (pixelPosX/mImageWidth) * mImageU + (pixelPosY/mImageHeight) * mImageV;
+        Vector3r imgPos = mImageOrigin + (pixelPosX/mImageWidth) * mImageU + (pixelPosY/mImageHeight) * mImageV;
         return { mCOP, imgPos - mCOP };
     }
 
 
 private:
 
-    Vector3d mCOP; // The center of projection or the camera viewpoint.
-    Vector3d mImageOrigin;
-    Vector3d mImageU, mImageV;
+    Vector3r mCOP; // The center of projection or the camera viewpoint.
+    Vector3r mImageOrigin;
+    Vector3r mImageU, mImageV;
     int mImageWidth{}, mImageHeight{}; // In number of pixels.
 
 }; // Camera
@@ -0,0 +1,294 @@
+#include <climits>
+#include "CompiledScene.h"
+#include "Util.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "Plane.h"
+
+using namespace std;
+
+
+
+CompiledScene::CompiledScene( const Scene &scene, BVH::BuildMethod method )
+    : materials( scene.materials ), ptLights( scene.ptLights ), amLight( scene.amLight ),
+      backgroundColor( scene.backgroundColor ), camera( scene.camera )
+{
+    vector<const Surface*> bounded;
+    vector<BoundingBox> primBounds;
+    bounded.reserve( scene.surfaces.size() );
+    primBounds.reserve( scene.surfaces.size() );
+
+    for ( const Surface *surface : scene.surfaces )
+    {
+        // Every material the surface can be shaded with, including those
+        // inside instanced objects and particle sets.
+        int lo = INT_MAX, hi = INT_MIN;
+        surface->expandMaterialRange( lo, hi );
+        if ( lo < 0 ) Util::ErrorExit( "CompiledScene: surface material index %d out of range.\n", lo );
+        if ( hi >= (int)materials.size() )
+            Util::ErrorExit( "CompiledScene: surface material index %d out of range.\n", hi );
+
+        BoundingBox box = surface->boundingBox();
+        if ( box.isBounded() )
+        {
+            bounded.push_back( surface );
+            primBounds.push_back( box );
+        }
+        else if ( auto plane = dynamic_cast<const Plane*>( surface ) )
+        {
+            mPlanes.add( *plane );
+        }
+        else mUnbounded.push_back( surface );
+    }
+
+    mBVH.build( primBounds, method );
+    mLightTree.build( ptLights );
+
+    // Copy the surfaces out in leaf order, so that each leaf covers a
+    // contiguous range of mPrims and, mostly, of each type's array.
+    vector<int> order = mBVH.primIndices();
+    mBVH.renumberPrimitives();
+
+    mPrims.reserve( bounded.size() );
+    for ( int surfaceIndex : order )
+    {
+        const Surface *surface = bounded[ surfaceIndex ];
+        if ( auto sphere = dynamic_cast<const Sphere*>( surface ) )
+        {
+            mPrims.push_back( { PrimType::Sphere, (int)mSpheres.size() } );
+            mSpheres.push_back( { sphere->center, sphere->radius, sphere->material } );
+        }
+        else if ( auto triangle = dynamic_cast<const Triangle*>( surface ) )
+        {
+            mPrims.push_back( { PrimType::Triangle, (int)mTriangles.size() } );
+            mTriangles.push_back( { PrecomputedTriangle( triangle->v0, triangle->v1, triangle->v2 ),
+                                    triangle->n0, triangle->n1, triangle->n2,
+                                    triangle->material } );
+        }
+        else
+        {
+            mPrims.push_back( { PrimType::Other, (int)mOthers.size() } );
+            mOthers.push_back( surface );
+        }
+    }
+}
+
+
+
+void CompiledScene::hitUnbounded( const Ray &r, Real tmin, Real &tmax, NearestHit &nearest ) const
+{
+    nearest.plane = mPlanes.hit( r, tmin, tmax );
+
+    for ( const Surface *surface : mUnbounded )
+    {
+        if ( surface->hit( r, tmin, tmax, nearest.other ) )
+        {
+            nearest.hasHitOther = true;
+            tmax = nearest.other.t;
+        }
+    }
+}
+
+
+
+bool CompiledScene::hitLeaf( int first, int count, const Ray &r, Real tmin, Real &tmax, NearestHit &nearest ) const
+{
+    bool hasHit = false;
+    for ( int i = first; i < first + count; i++ )
+    {
+        const PrimRef &prim = mPrims[i];
+        switch ( prim.type )
+        {
+            case PrimType::Sphere:
+            {
+                const SphereRecord &sphere = mSpheres[ prim.index ];
+                Real t = Sphere::nearestRoot( sphere.center, sphere.radius, r );
+                if ( !( t >= tmin && t <= tmax ) ) break;
+                tmax = t;
+                nearest.prim = prim;
+                hasHit = true;
+                break;
+            }
+            case PrimType::Triangle:
+            {
+                Real t, beta, gamma;
+                if ( !mTriangles[ prim.index ].precomputed.hit( r, tmin, tmax, t, beta, gamma ) ) break;
+                tmax = t;
+                nearest.prim = prim;
+                nearest.beta = beta;
+                nearest.gamma = gamma;
+                hasHit = true;
+                break;
+            }
+            case PrimType::Other:
+            {
+                if ( !mOthers[ prim.index ]->hit( r, tmin, tmax, nearest.other ) ) break;
+                tmax = nearest.other.t;
+                nearest.prim = prim;
+                hasHit = true;
+                break;
+            }
+        }
+    }
+    return hasHit;
+}
+
+
+
+bool CompiledScene::resolve( const Ray &r, Real t, const NearestHit &nearest, SurfaceHitRecord &rec ) const
+{
+    if ( nearest.prim.index >= 0 )
+    {
+        switch ( nearest.prim.type )
+        {
+            case PrimType::Sphere:
+            {
+                const SphereRecord &sphere = mSpheres[ nearest.prim.index ];
+                rec.t = t;
+                rec.p = r.pointAtParam( t );
+                rec.normal = ( rec.p - sphere.center ).unitVector();
+                rec.material = sphere.material;
+                break;
+            }
+            case PrimType::Triangle:
+            {
+                const TriangleRecord &triangle = mTriangles[ nearest.prim.index ];
+                Real alpha = 1 - nearest.beta - nearest.gamma;
+                rec.t = t;
+                rec.p = r.pointAtParam( t );
+                rec.normal = alpha * triangle.n0 + nearest.beta * triangle.n1 + nearest.gamma * triangle.n2;
+                rec.material = triangle.material;
+                break;
+            }
+            case PrimType::Other:
+                nearest.other.resolve( r, rec );
+                break;
+        }
+        return true;
+    }
+
+    if ( nearest.hasHitOther )
+    {
+        nearest.other.resolve( r, rec );
+        return true;
+    }
+    if ( nearest.plane < 0 ) return false;
+
+    rec.t = t;
+    rec.p = r.pointAtParam( t );
+    rec.normal = mPlanes.normal( nearest.plane );
+    rec.material = mPlanes.plane( nearest.plane ).material;
+    return true;
+}
+
+
+
+bool CompiledScene::hit( const Ray &r, Real tmin, Real tmax, SurfaceHitRecord &rec ) const
+{
+    // Unbounded surfaces first, so that the hierarchy is only searched in
+    // front of the nearest of them. Only the nearest primitive and its
+    // barycentric coordinates are remembered during traversal. The hit
+    // record is filled in at the end.
+    NearestHit nearest;
+    hitUnbounded( r, tmin, tmax, nearest );
+
+    mBVH.hitLeaves( r, tmin, tmax,
+        [&]( int first, int count, Real &nearest_t )
+            { return hitLeaf( first, count, r, tmin, nearest_t, nearest ); } );
+
+    return resolve( r, tmax, nearest, rec );
+}
+
+
+
+void CompiledScene::hitPacket( const RayPacket &packet, Real tmin, Real tmax,
+                               SurfaceHitRecord recs[], bool hasHit[] ) const
+{
+    if ( !packet.isCoherent() )
+    {
+        for ( int i = 0; i < packet.numRays(); i++ ) hasHit[i] = hit( packet.ray( i ), tmin, tmax, recs[i] );
+        return;
+    }
+
+    NearestHit nearest[ RayPacket::MAX_RAYS ];
+    Real rayTmax[ RayPacket::MAX_RAYS ];
+    for ( int i = 0; i < packet.numRays(); i++ )
+    {
+        rayTmax[i] = tmax;
+        hitUnbounded( packet.ray( i ), tmin, rayTmax[i], nearest[i] );
+    }
+
+    mBVH.hitPacketLeaves( packet, tmin, rayTmax,
+        [&]( int first, int count, int rayIndex, Real &nearest_t )
+            { return hitLeaf( first, count, packet.ray( rayIndex ), tmin, nearest_t, nearest[ rayIndex ] ); } );
+
+    for ( int i = 0; i < packet.numRays(); i++ ) hasHit[i] = resolve( packet.ray( i ), rayTmax[i], nearest[i], recs[i] );
+}
+
+
+
+bool CompiledScene::occludedUnbounded( const Ray &r, Real tmin, Real tmax ) const
+{
+    if ( mPlanes.occluded( r, tmin, tmax ) ) return true;
+
+    for ( const Surface *surface : mUnbounded )
+    {
+        if ( surface->shadowHit( r, tmin, tmax ) ) return true;
+    }
+    return false;
+}
+
+
+
+bool CompiledScene::occludedLeaf( int first, int count, const Ray &r, Real tmin, Real tmax ) const
+{
+    for ( int i = first; i < first + count; i++ )
+    {
+        const PrimRef &prim = mPrims[i];
+        switch ( prim.type )
+        {
+            case PrimType::Sphere:
+            {
+                const SphereRecord &sphere = mSpheres[ prim.index ];
+                Real t = Sphere::nearestRoot( sphere.center, sphere.radius, r );
+                if ( t >= 0 && t >= tmin && t <= tmax ) return true;
+                break;
+            }
+            case PrimType::Triangle:
+                if ( mTriangles[ prim.index ].precomputed.hit( r, tmin, tmax ) ) return true;
+                break;
+            case PrimType::Other:
+                if ( mOthers[ prim.index ]->shadowHit( r, tmin, tmax ) ) return true;
+                break;
+        }
+    }
+    return false;
+}
+
+
+
+bool CompiledScene::shadowHit( const Ray &r, Real tmin, Real tmax ) const
+{
+    // Unbounded surfaces are few and large, so they are the cheapest likely blockers.
+    if ( occludedUnbounded( r, tmin, tmax ) ) return true;
+
+    return mBVH.occludedLeaves( r, tmin, tmax,
+        [&]( int first, int count ) { return occludedLeaf( first, count, r, tmin, tmax ); } );
+}
+
+
+
+void CompiledScene::shadowHitPacket( const RayPacket &packet, Real tmin, const Real tmax[], bool occluded[] ) const
+{
+    if ( !packet.isCoherent() )
+    {
+        for ( int i = 0; i < packet.numRays(); i++ ) occluded[i] = shadowHit( packet.ray( i ), tmin, tmax[i] );
+        return;
+    }
+
+    for ( int i = 0; i < packet.numRays(); i++ ) occluded[i] = occludedUnbounded( packet.ray( i ), tmin, tmax[i] );
+
+    mBVH.occludedPacketLeaves( packet, tmin, tmax, occluded,
+        [&]( int first, int count, int rayIndex )
+            { return occludedLeaf( first, count, packet.ray( rayIndex ), tmin, tmax[ rayIndex ] ); } );
+}
@@ -0,0 +1,160 @@
+#ifndef _COMPILEDSCENE_H_
+#define _COMPILEDSCENE_H_
+
+#include <cstdint>
+#include <vector>
+#include "Scene.h"
+#include "BVH.h"
+#include "PrecomputedTriangle.h"
+#include "RayPacket.h"
+#include "LightTree.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// An immutable, render-ready form of a Scene. Spheres, triangles and planes
+// are copied out of their Surface objects into contiguous arrays, one per
+// type, laid out in the order the BVH leaves visit them. A hit test then
+// switches on a small type tag instead of making a virtual call through a
+// pointer into the heap. Materials are referenced by index, as in the Scene.
+//
+// Surfaces of other types (meshes, instances, sphere sets, ...) already
+// accelerate themselves internally, so they are kept as Surface pointers
+// and reached through their virtual functions.
+//
+// The Scene remains the authoring interface. A CompiledScene does not own
+// its surfaces, and must be compiled again after the Scene changes.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class CompiledScene
+{
+public:
+
+    explicit CompiledScene( const Scene &scene,
+                            BVH::BuildMethod method = BVH::BuildMethod::BinnedSAH );
+
+    CompiledScene( const CompiledScene & ) = delete;
+    CompiledScene &operator=( const CompiledScene & ) = delete;
+
+
+    // Finds the nearest hit of the ray in [tmin, tmax] over all surfaces.
+    bool hit( const Ray &r, Real tmin, Real tmax, SurfaceHitRecord &rec ) const;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Finds the nearest hit in [tmin, tmax] of each ray of the packet.
+    // hasHit[i] tells whether recs[i] was filled in for ray i. A coherent
+    // packet traverses the BVH together; any other is traced ray by ray.
+    //////////////////////////////////////////////////////////////////////////////
+
+    void hitPacket( const RayPacket &packet, Real tmin, Real tmax,
+                    SurfaceHitRecord recs[], bool hasHit[] ) const;
+
+
+    // Does the ray hit any surface in [tmin, tmax]? Stops at the first blocker found.
+    [[nodiscard]] bool shadowHit( const Ray &r, Real tmin, Real tmax ) const;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Sets occluded[i] iff ray i of the packet hits any surface in
+    // [tmin, tmax[i]]. A coherent packet traverses the BVH together; any
+    // other is tested ray by ray.
+    //////////////////////////////////////////////////////////////////////////////
+
+    void shadowHitPacket( const RayPacket &packet, Real tmin, const Real tmax[], bool occluded[] ) const;
+
+
+    [[nodiscard]] const BVH &bvh() const { return mBVH; }
+    [[nodiscard]] BVH &bvh() { return mBVH; }
+
+    // The tree over ptLights. Lighting by its cuts is off until enabled by LightTree::setCutLimits().
+    [[nodiscard]] const LightTree &lightTree() const { return mLightTree; }
+    [[nodiscard]] LightTree &lightTree() { return mLightTree; }
+
+    [[nodiscard]] int numSpheres() const { return (int)mSpheres.size(); }
+    [[nodiscard]] int numTriangles() const { return (int)mTriangles.size(); }
+    [[nodiscard]] int numPlanes() const { return (int)mPlanes.size(); }
+    [[nodiscard]] int numOthers() const { return (int)( mOthers.size() + mUnbounded.size() ); }
+
+    [[nodiscard]] int numBounded() const { return (int)mPrims.size(); }
+    [[nodiscard]] int numUnbounded() const { return (int)( mPlanes.size() + mUnbounded.size() ); }
+
+
+    // Copied from the Scene.
+    const std::vector<Material> materials;
+    const std::vector<PointLightSource> ptLights;
+    const AmbientLightSource amLight;
+    const Color backgroundColor;
+    const Camera camera;
+
+
+private:
+
+    enum class PrimType : uint8_t
+    {
+        Sphere,
+        Triangle,
+        Other    // A Surface of any other type.
+    };
+
+    struct PrimRef
+    {
+        PrimType type;
+        int index;  // Into the array of its type.
+    };
+
+    struct SphereRecord
+    {
+        Vector3r center;
+        Real radius;
+        int material;
+    };
+
+    struct TriangleRecord
+    {
+        PrecomputedTriangle precomputed;
+        Vector3r n0, n1, n2;  // Vertex normals.
+        int material;
+    };
+
+    // The nearest hit of a ray found so far, of which only the hit record is
+    // yet to be filled in.
+    struct NearestHit
+    {
+        PrimRef prim{ PrimType::Other, -1 };  // Nearest bounded primitive, if index >= 0.
+        Real beta = 0, gamma = 0;             // Barycentric coordinates on a triangle.
+        SurfaceHit other;                     // Nearest hit on a surface of another type.
+        bool hasHitOther = false;             // On an unbounded surface of another type.
+        int plane = -1;
+    };
+
+    // Intersects the ray with the planes and the other unbounded surfaces.
+    void hitUnbounded( const Ray &r, Real tmin, Real &tmax, NearestHit &nearest ) const;
+
+    // Intersects the ray with the primitives [first, first + count) of a
+    // leaf, shrinking tmax to any nearer hit.
+    bool hitLeaf( int first, int count, const Ray &r, Real tmin, Real &tmax, NearestHit &nearest ) const;
+
+    // Does the ray hit an unbounded surface in [tmin, tmax]?
+    bool occludedUnbounded( const Ray &r, Real tmin, Real tmax ) const;
+
+    // Does the ray hit any of the primitives [first, first + count) of a leaf in [tmin, tmax]?
+    bool occludedLeaf( int first, int count, const Ray &r, Real tmin, Real tmax ) const;
+
+    // Fills in the hit record of the nearest hit at t. Returns false if there is none.
+    bool resolve( const Ray &r, Real t, const NearestHit &nearest, SurfaceHitRecord &rec ) const;
+
+    BVH mBVH;
+    LightTree mLightTree;
+    std::vector<PrimRef> mPrims;               // Indexed by BVH primitive index.
+    std::vector<SphereRecord> mSpheres;
+    std::vector<TriangleRecord> mTriangles;
+    std::vector<const Surface*> mOthers;
+    PlaneList mPlanes;                         // Tested linearly.
+    std::vector<const Surface*> mUnbounded;    // Other unbounded surfaces, tested linearly.
+
+}; // CompiledScene
+
+
+#endif // _COMPILEDSCENE_H_
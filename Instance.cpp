@@ -0,0 +1,100 @@
+#include "Instance.h"
+#include "Util.h"
+
+using namespace std;
+
+
+
+Instance::Instance( const Object *theObject, const Transform &objectToWorld )
+    : mObject( theObject ), mObjectToWorld( objectToWorld ), mWorldToObject( objectToWorld.inverse() ),
+      mOverridesMaterial( false ), mMirrors( objectToWorld.determinant() < 0.0 )
+{
+}
+
+
+
+Instance::Instance( const Object *theObject, const Transform &objectToWorld, int theMaterial )
+    : Instance( theObject, objectToWorld )
+{
+    material = theMaterial;
+    mOverridesMaterial = true;
+}
+
+
+
+bool Instance::hit( const Ray &r, Real tmin, Real tmax, SurfaceHit &hit ) const 
+{
+    if ( !mObject->bvh.hit( toObjectSpace( r ), tmin, tmax, hit ) ) return false;
+
+    if ( hit.numInstances == SurfaceHit::MAX_INSTANCE_DEPTH ) Util::ErrorExit( "Instance: instances nested too deeply.\n" );
+    hit.instances[ hit.numInstances++ ] = this;
+    return true;
+}
+
+
+
+void Instance::hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const
+{
+    // The hit lists the instances it was traced through, innermost first.
+    // Whatever this instance wraps, the surface or a nested instance, comes
+    // just before it.
+    int level = 0;
+    while ( level < hit.numInstances && hit.instances[ level ] != this ) level++;
+    if ( level == hit.numInstances ) Util::ErrorExit( "Instance: hit was not traced through this instance.\n" );
+
+    const Surface *inner = ( level > 0 )? hit.instances[ level - 1 ] : hit.surface;
+    inner->hitAttributes( toObjectSpace( r ), hit, rec );
+    toWorldSpace( rec );
+
+    // Instance rays are not normalized, so t is the same in every space.
+    rec.p = r.pointAtParam( hit.t );
+}
+
+
+
+void Instance::toWorldSpace( SurfaceHitRecord &rec ) const
+{
+    // A mirroring transform reverses the winding order of triangles, so the
+    // normal is flipped to match what the mirrored geometry would have had
+    // if modelled directly.
+    rec.normal = mObjectToWorld.transformNormal( rec.normal );
+    if ( mMirrors ) rec.normal = -rec.normal;
+    if ( mOverridesMaterial ) rec.material = material;
+}
+
+
+
+void Instance::expandMaterialRange( int &lo, int &hi ) const
+{
+    if ( mOverridesMaterial )
+    {
+        Surface::expandMaterialRange( lo, hi );
+        return;
+    }
+    for ( const Surface *surface : mObject->surfaces ) surface->expandMaterialRange( lo, hi );
+}
+
+
+
+bool Instance::shadowHit( const Ray &r, Real tmin, Real tmax ) const 
+{
+    return mObject->bvh.shadowHit( toObjectSpace( r ), tmin, tmax );
+}
+
+
+
+BoundingBox Instance::boundingBox() const
+{
+    BoundingBox objectBox = mObject->bvh.bounds();
+    if ( !objectBox.isBounded() ) return objectBox;
+
+    BoundingBox box;
+    for ( int corner = 0; corner < 8; corner++ )
+    {
+        Vector3r p( ( corner & 1 )? objectBox.max().x() : objectBox.min().x(),
+                    ( corner & 2 )? objectBox.max().y() : objectBox.min().y(),
+                    ( corner & 4 )? objectBox.max().z() : objectBox.min().z() );
+        box.expand( mObjectToWorld.transformPoint( p ) );
+    }
+    return box;
+}
@@ -0,0 +1,77 @@
+#ifndef _INSTANCE_H_
+#define _INSTANCE_H_
+
+#include "Surface.h"
+#include "Object.h"
+#include "Transform.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A placement of a shared Object in the scene. Rays are transformed into
+// object space and traced through the object's bottom-level BVH, so any
+// number of instances cost only their own few bytes. An instance can
+// override the materials of the object's surfaces with its own material.
+//
+// Instance surfaces are the primitives of the scene's top-level BVH.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class Instance : public Surface 
+{
+public:
+
+    // Places object with the given object-to-world transform, keeping the object's materials.
+    Instance( const Object *theObject, const Transform &objectToWorld );
+
+    // Places object with the given object-to-world transform, shaded with the material
+    // of index theMaterial in Scene::materials.
+    Instance( const Object *theObject, const Transform &objectToWorld, int theMaterial );
+
+
+    bool hit(const Ray &r, // Ray being sent.
+             Real tmin,  // Minimum hit parameter to be searched for.
+             Real tmax,  // Maximum hit parameter to be searched for.
+             SurfaceHit &hit
+             ) const override;
+
+
+    [[nodiscard]] bool shadowHit(const Ray &r, // Ray being sent.
+                                 Real tmin,  // Minimum hit parameter to be searched for.
+                                 Real tmax   // Maximum hit parameter to be searched for.
+                                 ) const override;
+
+
+    // Resolves a hit traced through this instance, with r in world space,
+    // by resolving it in object space and transforming the result back.
+    void hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const override;
+
+
+    [[nodiscard]] BoundingBox boundingBox() const override;
+
+
+    // The instance's own material if it overrides them, else those of the object's surfaces.
+    void expandMaterialRange( int &lo, int &hi ) const override;
+
+
+    // The ray in object space. Its direction is not normalized, so that
+    // ray parameters are the same in both spaces.
+    [[nodiscard]] Ray toObjectSpace( const Ray &r ) const
+        { return { mWorldToObject.transformPoint( r.origin() ), mWorldToObject.transformVector( r.direction() ) }; }
+
+    // Takes the normal and material of a hit record from object space to
+    // world space. The hit point is left to the caller.
+    void toWorldSpace( SurfaceHitRecord &rec ) const;
+
+
+private:
+
+    const Object *mObject;
+    Transform mObjectToWorld, mWorldToObject;
+    bool mOverridesMaterial;
+    bool mMirrors;  // The transform flips handedness.
+
+};
+
+
+#endif // _INSTANCE_H_
@@ -27,7 +27,7 @@
 
 struct PointLightSource
 {
-    Vector3d position;
+    Vector3r position;
     Color I_source;
 };
 
@@ -0,0 +1,161 @@
+#include <cmath>
+#include <algorithm>
+#include "Util.h"
+#include "Shading.h"
+#include "LightTree.h"
+
+using namespace std;
+
+
+
+// The largest channel of a color, by which lighting is compared.
+static float maxChannel( const Color &c )
+{
+    return Util::Max3( c.r(), c.g(), c.b() );
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// An upper bound of dot( A, L ) over the unit vectors L from p toward the
+// points of the box, for a unit vector A.
+//////////////////////////////////////////////////////////////////////////////
+
+static Real maxCosine( const Vector3r &A, const Vector3r &p, const BoundingBox &box )
+{
+    // The largest dot( A, x - p ) over the box, over the least | x - p |.
+    Real maxDot = 0, minDistSqr = 0;
+    for ( int a = 0; a < 3; a++ )
+    {
+        Real lo = box.min()[a] - p[a], hi = box.max()[a] - p[a];
+        maxDot += Util::Max2( A[a] * lo, A[a] * hi );
+        if ( lo > 0 ) minDistSqr += lo * lo;
+        else if ( hi < 0 ) minDistSqr += hi * hi;
+    }
+    if ( maxDot <= 0 ) return 0;
+    if ( minDistSqr == 0 ) return 1;  // p is in the box.
+    return Util::Min2( Real( 1 ), maxDot / sqrt( minDistSqr ) );
+}
+
+
+
+void LightTree::build( const vector<PointLightSource> &lights )
+{
+    mLights = lights;
+    mNodes.clear();
+    mOrder.resize( lights.size() );
+    for ( int i = 0; i < (int)lights.size(); i++ ) mOrder[i] = i;
+    if ( lights.empty() ) return;
+
+    mNodes.reserve( 2 * lights.size() - 1 );
+    mNodes.emplace_back();
+    buildNode( 0, 0, (int)lights.size() );
+}
+
+
+
+void LightTree::buildNode( int nodeIndex, int begin, int end )
+{
+    BoundingBox box;
+    Color intensity( 0.0f, 0.0f, 0.0f );
+    for ( int i = begin; i < end; i++ )
+    {
+        box.expand( mLights[ mOrder[i] ].position );
+        intensity += mLights[ mOrder[i] ].I_source;
+    }
+
+    if ( end - begin == 1 )
+    {
+        mNodes[ nodeIndex ] = { box, intensity, mOrder[ begin ], -1 };
+        return;
+    }
+
+    int axis = box.maxExtentAxis();
+    int mid = ( begin + end ) / 2;
+    nth_element( mOrder.begin() + begin, mOrder.begin() + mid, mOrder.begin() + end,
+                 [&]( int a, int b ) { return mLights[a].position[ axis ] < mLights[b].position[ axis ]; } );
+
+    int left = (int)mNodes.size();
+    mNodes.emplace_back();
+    mNodes.emplace_back();
+    buildNode( left, begin, mid );
+    buildNode( left + 1, mid, end );
+
+    // The cluster is represented by the representative of its brighter child.
+    const Node &leftNode = mNodes[ left ], &rightNode = mNodes[ left + 1 ];
+    int light = ( maxChannel( leftNode.intensity ) >= maxChannel( rightNode.intensity ) )? leftNode.light : rightNode.light;
+    mNodes[ nodeIndex ] = { box, intensity, light, left };
+}
+
+
+
+void LightTree::setCutLimits( float maxError, int maxShadowRays )
+{
+    mMaxError = maxError;
+    mMaxCut = Util::Clamp( maxShadowRays, 0, MAX_CUT );
+}
+
+
+
+int LightTree::selectCut( const Vector3r &p, const Vector3r &N, const Vector3r &V,
+                          const Material &mat, CutLight cut[] ) const
+{
+    if ( mNodes.empty() ) return 0;
+
+    // The error bound of a cluster uses the mirror direction of V, since
+    // dot( MirrorReflect( L, N ), V ) = dot( L, MirrorReflect( V, N ) ).
+    Vector3r mirrorV = Shading::MirrorReflect( V, N );
+
+    struct Entry
+    {
+        int node;
+        float error;
+    };
+    Entry entries[ MAX_CUT ];
+    int numEntries = 0;
+    float estimate = 0.0f;  // Of the lighting by the cut.
+
+    auto addNode = [&]( int nodeIndex )
+    {
+        const Node &node = mNodes[ nodeIndex ];
+        PointLightSource cluster = { mLights[ node.light ].position, node.intensity };
+        Vector3r L = ( cluster.position - p ).unitVector();
+        cut[ numEntries ] = { node.light, Shading::PhongLighting( L, N, V, mat, cluster ) };
+        estimate += maxChannel( cut[ numEntries ].lighting );
+
+        float error = 0.0f;
+        if ( node.left >= 0 )
+        {
+            auto cosN = (float)maxCosine( N, p, node.box );
+            float specular = powf( (float)maxCosine( mirrorV, p, node.box ), mat.n );
+            error = maxChannel( node.intensity * ( mat.k_d * cosN + mat.k_r * specular ) );
+        }
+        entries[ numEntries++ ] = { nodeIndex, error };
+    };
+
+    addNode( 0 );
+    while ( numEntries < mMaxCut )
+    {
+        int worst = 0;
+        for ( int i = 1; i < numEntries; i++ )
+        {
+            if ( entries[i].error > entries[ worst ].error ) worst = i;
+        }
+        if ( entries[ worst ].error <= mMaxError * estimate || entries[ worst ].error == 0.0f ) break;
+
+        // Replace the cluster by its two children.
+        int left = mNodes[ entries[ worst ].node ].left;
+        estimate -= maxChannel( cut[ worst ].lighting );
+        CutLight last = cut[ numEntries - 1 ];
+        Entry lastEntry = entries[ numEntries - 1 ];
+        numEntries--;
+        if ( worst < numEntries )
+        {
+            cut[ worst ] = last;
+            entries[ worst ] = lastEntry;
+        }
+        addNode( left );
+        addNode( left + 1 );
+    }
+    return numEntries;
+}
@@ -0,0 +1,100 @@
+#ifndef _LIGHTTREE_H_
+#define _LIGHTTREE_H_
+
+#include <vector>
+#include "Vector3d.h"
+#include "Color.h"
+#include "Material.h"
+#include "Light.h"
+#include "BoundingBox.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A binary tree of clusters over the point lights of a scene, for lighting
+// a point by a few clusters instead of every light, as in Lightcuts.
+//
+// A cluster is represented by one of its lights carrying the intensity of
+// the whole cluster. A cut of the tree is a set of clusters that covers
+// each light exactly once. For a shading point, the cut starts at the root
+// and repeatedly replaces the cluster of largest error bound by its two
+// children, until every error bound is at most maxError times the
+// estimated lighting of the cut, or the cut has maxShadowRays clusters.
+// The error bound of a cluster is the largest lighting that any light in
+// its bounding box could give with the cluster's intensity. A single
+// light is exact. Each cluster of the cut then takes one shadow ray, to
+// its representative.
+//
+// The estimates that drive the refinement ignore shadows, so that no
+// shadow ray is traced before the cut is chosen.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class LightTree
+{
+public:
+
+    // The most clusters a cut can have.
+    static constexpr int MAX_CUT = 64;
+
+
+    // A cluster of a cut.
+    struct CutLight
+    {
+        int light;       // The representative light, indexed as in the scene.
+        Color lighting;  // Shading::PhongLighting() by it, with the intensity of its cluster.
+    };
+
+
+    // Builds the tree over the lights, by median splits along the longest axis.
+    void build( const std::vector<PointLightSource> &lights );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Enables lighting by cuts of at most maxShadowRays clusters, up to
+    // MAX_CUT, and error bounds of at most maxError of the estimate. A
+    // maxShadowRays of 0 disables it, so that every light is evaluated.
+    //////////////////////////////////////////////////////////////////////////////
+
+    void setCutLimits( float maxError, int maxShadowRays );
+
+    [[nodiscard]] bool isEnabled() const { return mMaxCut > 0; }
+
+    [[nodiscard]] int maxCut() const { return mMaxCut; }
+
+    [[nodiscard]] int numNodes() const { return (int)mNodes.size(); }
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Selects the cut for the point p of material mat, with unit normal N
+    // and unit vector V toward the viewer, into cut[]. Returns its number
+    // of clusters.
+    //////////////////////////////////////////////////////////////////////////////
+
+    int selectCut( const Vector3r &p, const Vector3r &N, const Vector3r &V,
+                   const Material &mat, CutLight cut[] ) const;
+
+
+private:
+
+    struct Node
+    {
+        BoundingBox box;    // Of the light positions.
+        Color intensity;    // Sum over the cluster.
+        int light;          // Representative light.
+        int left;           // Index of the left child (right child is left + 1), or -1 for a single light.
+    };
+
+    // Builds the node over lights[ begin, end ) of mOrder.
+    void buildNode( int nodeIndex, int begin, int end );
+
+    std::vector<Node> mNodes;
+    std::vector<PointLightSource> mLights;
+    std::vector<int> mOrder;  // Light indices, partitioned by the build.
+    float mMaxError = 0.0f;
+    int mMaxCut = 0;
+
+}; // LightTree
+
+
+#endif // _LIGHTTREE_H_
@@ -17,16 +17,41 @@
 #include "Sphere.h"
 #include "Plane.h"
 #include "Triangle.h"
+#include "TriangleMesh.h"
+#include "Transform.h"
+#include "Object.h"
+#include "Instance.h"
 #include "Scene.h"
+#include "CompiledScene.h"
+#include "RayPacket.h"
 #include "Raytrace.h"
+#include "Wavefront.h"
+#include "Benchmark.h"
 #include <string>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
 
 
+// How a compiled scene is rendered. A Scene rendered uncompiled is always
+// traced one ray at a time.
+enum class RenderMode
+{
+    Rays,             // Each pixel's rays depth first, one at a time.
+    Packets,          // Each tile's primary rays as one packet, then depth first.
+    Wavefront,        // All rays of a wave of pixels stage by stage (see Wavefront.h).
+    SortedWavefront   // As Wavefront, with the reflected rays sorted for coherence.
+                      // This pays off on scenes too large for the cache.
+};
+
 // Constants for Scene 1.
 static constexpr int imageWidth1 = 640;
 static constexpr int imageHeight1 = 480;
 static constexpr int reflectLevels1 = 2;  // 0 -- object does not reflect scene.
 static constexpr int hasShadow1 = false;
+static constexpr bool useBVH1 = true;  // false -- render the scene uncompiled, testing every surface for every ray.
+static constexpr BVH::BuildMethod bvhBuildMethod1 = BVH::BuildMethod::BinnedSAH;
+static constexpr RenderMode renderMode1 = RenderMode::Wavefront;
 static constexpr std::string_view outImageFile1 = "out1.png";
 
 // Constants for Scene 2.
@@ -34,53 +59,212 @@ static constexpr int imageWidth2 = 640;
 static constexpr int imageHeight2 = 480;
 static constexpr int reflectLevels2 = 2;  // 0 -- object does not reflect scene.
 static constexpr int hasShadow2 = true;
+static constexpr bool useBVH2 = true;  // false -- render the scene uncompiled, testing every surface for every ray.
+static constexpr BVH::BuildMethod bvhBuildMethod2 = BVH::BuildMethod::LBVH;
+static constexpr RenderMode renderMode2 = RenderMode::Wavefront;
 static constexpr std::string_view outImageFile2 = "out2.png";
 
 
 
+// Whether to count the BVH nodes and surfaces visited while rendering, set
+// by "Main --stats". The counters are atomic adds shared by all threads,
+// which slows rendering, so they are off by default.
+static bool collectBVHStats = false;
+
+
+
 ///////////////////////////////////////////////////////////////////////////
-// Raytrace the whole image of the scene and write it to a file.
+// Compile the scene for rendering and report its BVH statistics.
+///////////////////////////////////////////////////////////////////////////
+
+void ReportCompiledScene( CompiledScene &compiled )
+{
+    compiled.bvh().setCollectStats( collectBVHStats );
+
+    const BVH::BuildStats &stats = compiled.bvh().buildStats();
+    std::cout << "BVH build time = " << stats.buildTime << "sec" << std::endl;
+    std::cout << "BVH surfaces = " << compiled.numBounded() << " bounded + " 
+              << compiled.numUnbounded() << " unbounded" << std::endl;
+    std::cout << "Compiled surfaces = " << compiled.numSpheres() << " spheres, " 
+              << compiled.numTriangles() << " triangles, " << compiled.numPlanes() << " planes, " 
+              << compiled.numOthers() << " others" << std::endl;
+    std::cout << "BVH nodes = " << stats.numNodes << ", leaves = " << stats.numLeaves 
+              << ", max depth = " << stats.maxDepth << ", SAH cost = " << stats.sahCost << std::endl;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// Report the BVH traversal statistics gathered while rendering.
+///////////////////////////////////////////////////////////////////////////
+
+void ReportBVHTraversal( const CompiledScene &compiled )
+{
+    BVH::TraversalStats stats = compiled.bvh().traversalStats();
+    if ( stats.rays == 0 ) return;
+
+    double rays = (double)stats.rays;
+    std::cout << "BVH rays traced = " << stats.rays << std::endl;
+    std::cout << "BVH nodes visited per ray = " << stats.nodesVisited / rays << std::endl;
+    std::cout << "BVH surfaces tested per ray = " << stats.primTests / rays + compiled.numUnbounded()
+              << " (linear loop: " << compiled.numBounded() + compiled.numUnbounded() << ")" << std::endl;
+}
+
+
+// A Scene rendered directly is tested linearly, so there is nothing to report.
+void ReportBVHTraversal( const Scene & ) {}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// Raytrace the pixels [x0, x1) x [y0, y1) of the image one ray at a time.
+///////////////////////////////////////////////////////////////////////////
+
+template <typename SceneType>
+void RenderTileByRays( Image &image, const SceneType &scene, int x0, int y0, int x1, int y1,
+                       int reflectLevels, bool hasShadow )
+{
+    for ( int y = y0; y < y1; y++ )
+    {
+        Real pixelPosY = y + Real( 0.5 );
+
+        for ( int x = x0; x < x1; x++ )
+        {
+            Real pixelPosX = x + Real( 0.5 );
+            Ray ray = scene.camera.getRay( pixelPosX, pixelPosY );
+            Color pixelColor = Raytrace::TraceRay( ray, scene, reflectLevels, hasShadow );
+            pixelColor.clamp();
+            image.setPixel( x, y, pixelColor );
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// Raytrace the pixels [x0, x1) x [y0, y1) of the image as one packet of
+// primary rays. The tile must have at most RayPacket::MAX_RAYS pixels.
+///////////////////////////////////////////////////////////////////////////
+
+void RenderTileByPacket( Image &image, const CompiledScene &scene, int x0, int y0, int x1, int y1,
+                         int reflectLevels, bool hasShadow )
+{
+    RayPacket packet;
+    for ( int y = y0; y < y1; y++ )
+    {
+        for ( int x = x0; x < x1; x++ )
+        {
+            Ray ray = scene.camera.getRay( x + Real( 0.5 ), y + Real( 0.5 ) );
+            packet.addRay( ray.makeUnitDirection() );
+        }
+    }
+    packet.finalize();
+
+    Color pixelColors[ RayPacket::MAX_RAYS ];
+    Raytrace::TracePacket( packet, scene, reflectLevels, hasShadow, pixelColors );
+
+    int i = 0;
+    for ( int y = y0; y < y1; y++ )
+    {
+        for ( int x = x0; x < x1; x++ )
+        {
+            pixelColors[i].clamp();
+            image.setPixel( x, y, pixelColors[ i++ ] );
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// Raytrace the whole image in tiles of RayPacket::SIZE x RayPacket::SIZE
+// pixels, each traced as one packet of primary rays if usePackets is true
+// and the scene is compiled.
 ///////////////////////////////////////////////////////////////////////////
 
-void RenderImage( const std::string &imageFilename, const Scene &scene, 
-                  int reflectLevels, bool hasShadow )
+template <typename SceneType>
+void RenderTiles( Image &image, const SceneType &scene, 
+                  int reflectLevels, bool hasShadow, bool usePackets )
 {
     int imgWidth = scene.camera.getImageWidth();
     int imgHeight = scene.camera.getImageHeight();
 
-    Image image( imgWidth, imgHeight ); // To store the result of ray tracing.
-
-    double startTime = Util::GetCurrRealTime();
-    double startCPUTime = Util::GetCurrCPUTime();
+    constexpr int tileSize = RayPacket::SIZE;
+    int numTilesX = ( imgWidth + tileSize - 1 ) / tileSize;
+    int numTilesY = ( imgHeight + tileSize - 1 ) / tileSize;
 
     // Generate image, rendering in parallel on Windows and Linux.
     #ifndef __APPLE__
     #pragma warning( push )
     #pragma warning( disable : 6993 )
-    #pragma omp parallel for
+    #pragma omp parallel for schedule( dynamic )
     #endif
-    for ( int y = 0; y < imgHeight; y++ )
+    for ( int tile = 0; tile < numTilesX * numTilesY; tile++ )
     {
-        double pixelPosY = y + 0.5;
+        int x0 = ( tile % numTilesX ) * tileSize;
+        int y0 = ( tile / numTilesX ) * tileSize;
+        int x1 = std::min( x0 + tileSize, imgWidth );
+        int y1 = std::min( y0 + tileSize, imgHeight );
 
-        for ( int x = 0; x < imgWidth; x++ )
+        if constexpr ( std::is_same_v<SceneType, CompiledScene> )
         {
-            double pixelPosX = x + 0.5;
-            Ray ray = scene.camera.getRay( pixelPosX, pixelPosY );
-            Color pixelColor = Raytrace::TraceRay( ray, scene, reflectLevels, hasShadow );
-            pixelColor.clamp();
-            image.setPixel( x, y, pixelColor );
+            if ( usePackets )
+            {
+                RenderTileByPacket( image, scene, x0, y0, x1, y1, reflectLevels, hasShadow );
+                continue;
+            }
         }
+        RenderTileByRays( image, scene, x0, y0, x1, y1, reflectLevels, hasShadow );
     }
     #ifndef __APPLE__
     #pragma warning( pop )
     #endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// Raytrace the whole image of the scene and write it to a file.
+// SceneType is CompiledScene, or Scene to test every surface for every ray,
+// which is always traced one ray at a time.
+///////////////////////////////////////////////////////////////////////////
+
+template <typename SceneType>
+void RenderImage( const std::string &imageFilename, const SceneType &scene, 
+                  int reflectLevels, bool hasShadow, RenderMode mode )
+{
+    Image image( scene.camera.getImageWidth(), scene.camera.getImageHeight() ); // To store the result of ray tracing.
+
+    double startTime = Util::GetCurrRealTime();
+    double startCPUTime = Util::GetCurrCPUTime();
+
+    Wavefront::Stats wavefrontStats;
+    bool isWavefront = ( mode == RenderMode::Wavefront || mode == RenderMode::SortedWavefront );
+    if constexpr ( std::is_same_v<SceneType, CompiledScene> )
+    {
+        if ( isWavefront )
+        {
+            Wavefront::RenderImage( image, scene, reflectLevels, hasShadow, 
+                                    mode == RenderMode::SortedWavefront, &wavefrontStats );
+        }
+        else RenderTiles( image, scene, reflectLevels, hasShadow, mode == RenderMode::Packets );
+    }
+    else RenderTiles( image, scene, reflectLevels, hasShadow, false );
 
     double cpuTimeElapsed = Util::GetCurrCPUTime() - startCPUTime;
     double realTimeElapsed = Util::GetCurrRealTime() - startTime;
     std::cout << "CPU time taken = " << cpuTimeElapsed << "sec" << std::endl;
     std::cout << "Real time taken = " << realTimeElapsed << "sec" << std::endl;
 
+    ReportBVHTraversal( scene );
+    if ( isWavefront && wavefrontStats.reflectedRays > 0 )
+    {
+        std::cout << "Reflected rays = " << wavefrontStats.reflectedRays << ", traced in " 
+                  << wavefrontStats.reflectedTime << "sec";
+        if ( mode == RenderMode::SortedWavefront ) std::cout << " after sorting in " << wavefrontStats.sortTime << "sec";
+        std::cout << std::endl;
+    }
+
     // Write image to file.
     if ( !image.writeToFile( imageFilename ) ) return;
     else Util::ErrorExit("File: %s could not be written.\n", imageFilename.c_str() );
@@ -88,14 +272,41 @@ void RenderImage( const std::string &imageFilename, const Scene &scene,
 
 
 
+///////////////////////////////////////////////////////////////////////////
+// Compile the scene unless useBVH is false, and render it.
+///////////////////////////////////////////////////////////////////////////
+
+void CompileAndRender( const std::string &imageFilename, const Scene &scene, bool useBVH,
+                       BVH::BuildMethod method, RenderMode mode, int reflectLevels, bool hasShadow )
+{
+    if ( !useBVH )
+    {
+        RenderImage( imageFilename, scene, reflectLevels, hasShadow, RenderMode::Rays );
+        return;
+    }
+
+    CompiledScene compiled( scene, method );
+    ReportCompiledScene( compiled );
+    RenderImage( imageFilename, compiled, reflectLevels, hasShadow, mode );
+}
+
+
+
 // Forward declarations. These functions are defined later in the file.
 void DefineScene1( Scene &scene, int imageWidth, int imageHeight );
 void DefineScene2( Scene &scene, int imageWidth, int imageHeight );
 
 
 
-int main()
+int main( int argc, char *argv[] )
 {
+    // Run a benchmark instead of rendering if one is named on the command line.
+
+    if ( argc > 1 && strcmp( argv[1], "--stats" ) == 0 ) collectBVHStats = true;
+    else if ( argc > 1 ) return Benchmark::Run( argc - 1, argv + 1 );
+
+    std::cout << "Precision = " << ( ( sizeof( Real ) == sizeof( float ) )? "float" : "double" ) << std::endl;
+
 
 // Define Scene 1.
 
@@ -105,16 +316,22 @@ int main()
 // Render Scene 1.
 
     std::cout << "Render Scene 1..." << std::endl;
-    RenderImage( std::string(outImageFile1), scene1, reflectLevels1, hasShadow1 );
+    CompileAndRender( std::string(outImageFile1), scene1, useBVH1, bvhBuildMethod1, renderMode1,
+                      reflectLevels1, hasShadow1 );
     std::cout << "Scene 1 completed." << std::endl;
 
-// Delete Scene 1 surfaces.
+// Delete Scene 1 surfaces and objects.
 
     for (auto& surface : scene1.surfaces)
     {
         delete surface;
     }
 
+    for (auto& object : scene1.objects)
+    {
+        delete object;
+    }
+
 
 // Define Scene 2.
 
@@ -124,16 +341,22 @@ int main()
 // Render Scene 2.
 
     std::cout << "Render Scene 2..." << std::endl;
-    RenderImage( std::string(outImageFile2), scene2, reflectLevels2, hasShadow2 );
+    CompileAndRender( std::string(outImageFile2), scene2, useBVH2, bvhBuildMethod2, renderMode2,
+                      reflectLevels2, hasShadow2 );
     std::cout << "Scene 2 completed." << std::endl;
 
-// Delete Scene 2 surfaces.
+// Delete Scene 2 surfaces and objects.
 
     for (auto& surface : scene2.surfaces)
     {
         delete surface;
     }
 
+    for (auto& object : scene2.objects)
+    {
+        delete object;
+    }
+
     std::cout << "All done. Press Enter to exit." << std::endl;
     std::cin.get();
     return 0;
@@ -201,8 +424,8 @@ void DefineScene1( Scene &scene, int imageWidth, int imageHeight )
 
     scene.ptLights.resize(2);
 
-    PointLightSource light0 = { Vector3d(100.0, 120.0, 10.0), Color(1.0f, 1.0f, 1.0f) * 0.6f };
-    PointLightSource light1 = { Vector3d(5.0, 80.0, 60.0), Color(1.0f, 1.0f, 1.0f) * 0.6f };
+    PointLightSource light0 = { Vector3r(100.0, 120.0, 10.0), Color(1.0f, 1.0f, 1.0f) * 0.6f };
+    PointLightSource light1 = { Vector3r(5.0, 80.0, 60.0), Color(1.0f, 1.0f, 1.0f) * 0.6f };
 
     scene.ptLights = { light0, light1 };
 
@@ -211,61 +434,61 @@ void DefineScene1( Scene &scene, int imageWidth, int imageHeight )
 
     scene.surfaces.resize(15);
 
-    auto horzPlane = new Plane( 0.0, 1.0, 0.0, 0.0, scene.materials[2] ); // Horizontal plane.
-    auto leftVertPlane = new Plane( 1.0, 0.0, 0.0, 0.0, scene.materials[4] ); // Left vertical plane.
-    auto rightVertPlane = new Plane( 0.0, 0.0, 1.0, 0.0, scene.materials[4] ); // Right vertical plane.
-    auto bigSphere =  new Sphere( Vector3d( 40.0, 20.0, 42.0 ), 22.0, scene.materials[0] ); // Big sphere.
-    auto smallSphere = new Sphere( Vector3d( 75.0, 10.0, 40.0 ), 12.0, scene.materials[1] ); // Small sphere.
+    auto horzPlane = new Plane( 0.0, 1.0, 0.0, 0.0, 2 ); // Horizontal plane.
+    auto leftVertPlane = new Plane( 1.0, 0.0, 0.0, 0.0, 4 ); // Left vertical plane.
+    auto rightVertPlane = new Plane( 0.0, 0.0, 1.0, 0.0, 4 ); // Right vertical plane.
+    auto bigSphere =  new Sphere( Vector3r( 40.0, 20.0, 42.0 ), 22.0, 0 ); // Big sphere.
+    auto smallSphere = new Sphere( Vector3r( 75.0, 10.0, 40.0 ), 12.0, 1 ); // Small sphere.
 
     // Cube +y face.
-    auto cubePosYTri1 = new Triangle( Vector3d( 50.0, 20.0, 90.0 ),
-                                      Vector3d( 50.0, 20.0, 70.0 ),
-                                      Vector3d( 30.0, 20.0, 70.0 ),
-                                      scene.materials[3] );
-    auto cubePosYTri2 = new Triangle( Vector3d( 50.0, 20.0, 90.0 ),
-                                      Vector3d( 30.0, 20.0, 70.0 ),
-                                      Vector3d( 30.0, 20.0, 90.0 ),
-                                      scene.materials[3] );
+    auto cubePosYTri1 = new Triangle( Vector3r( 50.0, 20.0, 90.0 ),
+                                      Vector3r( 50.0, 20.0, 70.0 ),
+                                      Vector3r( 30.0, 20.0, 70.0 ),
+                                      3 );
+    auto cubePosYTri2 = new Triangle( Vector3r( 50.0, 20.0, 90.0 ),
+                                      Vector3r( 30.0, 20.0, 70.0 ),
+                                      Vector3r( 30.0, 20.0, 90.0 ),
+                                      3 );
 
     // Cube +x face.
-    auto cubePosXTri1 = new Triangle( Vector3d( 50.0, 0.0, 70.0 ),
-                                      Vector3d( 50.0, 20.0, 70.0 ),
-                                      Vector3d( 50.0, 20.0, 90.0 ),
-                                      scene.materials[3]);
-    auto cubePosXTri2 = new Triangle( Vector3d( 50.0, 0.0, 70.0 ),
-                                      Vector3d( 50.0, 20.0, 90.0 ),
-                                      Vector3d( 50.0, 0.0, 90.0 ),
-                                      scene.materials[3] );
+    auto cubePosXTri1 = new Triangle( Vector3r( 50.0, 0.0, 70.0 ),
+                                      Vector3r( 50.0, 20.0, 70.0 ),
+                                      Vector3r( 50.0, 20.0, 90.0 ),
+                                      3);
+    auto cubePosXTri2 = new Triangle( Vector3r( 50.0, 0.0, 70.0 ),
+                                      Vector3r( 50.0, 20.0, 90.0 ),
+                                      Vector3r( 50.0, 0.0, 90.0 ),
+                                      3 );
 
     // Cube -x face.
-    auto cubeNegXTri1 = new Triangle( Vector3d( 30.0, 0.0, 90.0 ),
-                                      Vector3d( 30.0, 20.0, 90.0 ),
-                                      Vector3d( 30.0, 20.0, 70.0 ),
-                                      scene.materials[3]);
-    auto cubeNegXTri2 = new Triangle( Vector3d( 30.0, 0.0, 90.0 ),
-                                      Vector3d( 30.0, 20.0, 70.0 ),
-                                      Vector3d( 30.0, 0.0, 70.0 ),
-                                      scene.materials[3] );
+    auto cubeNegXTri1 = new Triangle( Vector3r( 30.0, 0.0, 90.0 ),
+                                      Vector3r( 30.0, 20.0, 90.0 ),
+                                      Vector3r( 30.0, 20.0, 70.0 ),
+                                      3);
+    auto cubeNegXTri2 = new Triangle( Vector3r( 30.0, 0.0, 90.0 ),
+                                      Vector3r( 30.0, 20.0, 70.0 ),
+                                      Vector3r( 30.0, 0.0, 70.0 ),
+                                      3 );
 
     // Cube +z face.
-    auto cubePosZTri1 = new Triangle( Vector3d( 50.0, 0.0, 90.0 ),
-                                      Vector3d( 50.0, 20.0, 90.0 ),
-                                      Vector3d( 30.0, 20.0, 90.0 ),
-                                      scene.materials[3]);
-    auto cubePosZTri2 = new Triangle( Vector3d( 50.0, 0.0, 90.0 ),
-                                      Vector3d( 30.0, 20.0, 90.0 ),
-                                      Vector3d( 30.0, 0.0, 90.0 ),
-                                      scene.materials[3] );
+    auto cubePosZTri1 = new Triangle( Vector3r( 50.0, 0.0, 90.0 ),
+                                      Vector3r( 50.0, 20.0, 90.0 ),
+                                      Vector3r( 30.0, 20.0, 90.0 ),
+                                      3);
+    auto cubePosZTri2 = new Triangle( Vector3r( 50.0, 0.0, 90.0 ),
+                                      Vector3r( 30.0, 20.0, 90.0 ),
+                                      Vector3r( 30.0, 0.0, 90.0 ),
+                                      3 );
 
     // Cube -z face.
-    auto cubeNegZTri1 = new Triangle( Vector3d( 30.0, 0.0, 70.0 ),
-                                      Vector3d( 30.0, 20.0, 70.0 ),
-                                      Vector3d( 50.0, 20.0, 70.0 ),
-                                      scene.materials[3] );
-    auto cubeNegZTri2 = new Triangle( Vector3d( 30.0, 0.0, 70.0 ),
-                                      Vector3d( 50.0, 20.0, 70.0 ),
-                                      Vector3d( 50.0, 0.0, 70.0 ),
-                                      scene.materials[3] );
+    auto cubeNegZTri1 = new Triangle( Vector3r( 30.0, 0.0, 70.0 ),
+                                      Vector3r( 30.0, 20.0, 70.0 ),
+                                      Vector3r( 50.0, 20.0, 70.0 ),
+                                      3 );
+    auto cubeNegZTri2 = new Triangle( Vector3r( 30.0, 0.0, 70.0 ),
+                                      Vector3r( 50.0, 20.0, 70.0 ),
+                                      Vector3r( 50.0, 0.0, 70.0 ),
+                                      3 );
 
     scene.surfaces = { horzPlane, leftVertPlane, rightVertPlane, 
                        bigSphere, smallSphere,
@@ -278,9 +501,9 @@ void DefineScene1( Scene &scene, int imageWidth, int imageHeight )
 
 // Define camera.
 
-    scene.camera = Camera( Vector3d( 150.0, 120.0, 150.0 ),  // eye
-                           Vector3d( 45.0, 22.0, 55.0 ),  // lookAt
-                           Vector3d( 0.0, 1.0, 0.0 ),  //upVector
+    scene.camera = Camera( Vector3r( 150.0, 120.0, 150.0 ),  // eye
+                           Vector3r( 45.0, 22.0, 55.0 ),  // lookAt
+                           Vector3r( 0.0, 1.0, 0.0 ),  //upVector
                            (-1.0 * imageWidth) / imageHeight,  // left
                            (1.0 * imageWidth) / imageHeight,  // right
                            -1.0, 1.0, 3.0,  // bottom, top, near
@@ -293,88 +516,44 @@ void DefineScene1( Scene &scene, int imageWidth, int imageHeight )
 // Modeling of Scene 2.
 ///////////////////////////////////////////////////////////////////////////
 
-void DrawTetrahedron(Vector3d c, Scene& s, Material m, double scale, bool rotateX, bool rotateY, bool rotateZ);
-
-void DrawTetrahedron(Vector3d c, Scene& s,  Material m, double scale, bool rotateX, bool rotateY, bool rotateZ) {
-    
-    // draw out the four coordinates of the tetrahedron
-
-    Vector3d v1 = Vector3d(1, 0, - (1 / sqrt(2)));
-
-    Vector3d v2 = Vector3d(-1, 0, -(1 / sqrt(2)));
-
-    Vector3d v3 = Vector3d(0, 1, 1 / sqrt(2));
-
-    Vector3d v4 = Vector3d(0, -1, 1 / sqrt(2));
+Object *MakeTetrahedron();
+void DrawTetrahedron(Vector3r c, Scene& s, const Object *tetrahedron, int m, double scale, bool rotateX, bool rotateY, bool rotateZ);
 
-    // do necessary transformation
+Object *MakeTetrahedron() {
 
-    v1 *= scale; v2 *= scale; v3 *= scale; v4 *= scale;
+    // the four coordinates of the unit tetrahedron, centred at the origin
 
-    double rotation = 180;
-
-    if (rotateX) {
-        v1 = Vector3d(v1.x(), dot(v1, Vector3d(0, cos(rotation), -sin(rotation))),
-            dot(v1, Vector3d(0, sin(rotation), cos(rotation))));
-
-        v2 = Vector3d(v2.x(), dot(v2, Vector3d(0, cos(rotation), -sin(rotation))),
-            dot(v2, Vector3d(0, sin(rotation), cos(rotation))));
-
-        v3 = Vector3d(v3.x(), dot(v3, Vector3d(0, cos(rotation), -sin(rotation))),
-            dot(v3, Vector3d(0, sin(rotation), cos(rotation))));
-
-        v4 = Vector3d(v4.x(), dot(v4, Vector3d(0, cos(rotation), -sin(rotation))),
-            dot(v4, Vector3d(0, sin(rotation), cos(rotation))));
-    }
-
-    else if (rotateY) {
-        v1 = Vector3d(dot(v1, Vector3d(cos(rotation), 0, sin(rotation))), v1.y(),
-            dot(v1, Vector3d(-sin(rotation), 0, cos(rotation))));
-
-        v2 = Vector3d(dot(v2, Vector3d(cos(rotation), 0, sin(rotation))), v2.y(),
-            dot(v2, Vector3d(-sin(rotation), 0, cos(rotation))));
+    Vector3r v1 = Vector3r(1, 0, - (1 / sqrt(2)));
 
-        v3 = Vector3d(dot(v3, Vector3d(cos(rotation), 0, sin(rotation))), v3.y(),
-            dot(v3, Vector3d(-sin(rotation), 0, cos(rotation))));
+    Vector3r v2 = Vector3r(-1, 0, -(1 / sqrt(2)));
 
-        v4 = Vector3d(dot(v4, Vector3d(cos(rotation), 0, sin(rotation))), v4.y(),
-            dot(v4, Vector3d(-sin(rotation), 0, cos(rotation))));
-    }
-
-    else if (rotateZ) {
-        v1 = Vector3d(dot(v1, Vector3d(cos(rotation), -sin(rotation), 0)),
-            dot(v1, Vector3d(sin(rotation), cos(rotation), 0)),
-            v1.z());
+    Vector3r v3 = Vector3r(0, 1, 1 / sqrt(2));
 
-        v2 = Vector3d(dot(v2, Vector3d(cos(rotation), -sin(rotation), 0)),
-            dot(v2, Vector3d(sin(rotation), cos(rotation), 0)),
-            v2.z());
+    Vector3r v4 = Vector3r(0, -1, 1 / sqrt(2));
 
-        v3 = Vector3d(dot(v3, Vector3d(cos(rotation), -sin(rotation), 0)),
-            dot(v3, Vector3d(sin(rotation), cos(rotation), 0)),
-            v3.z());
+    // Draw Spike. The material is replaced by each instance.
 
-        v4 = Vector3d(dot(v4, Vector3d(cos(rotation), -sin(rotation), 0)),
-            dot(v4, Vector3d(sin(rotation), cos(rotation), 0)),
-            v4.z());
-    }
+    auto tetrahedron = new Object;
+    tetrahedron->surfaces.push_back(new TriangleMesh({ v1, v2, v3, v4 },
+                                                     { 0, 1, 2,  0, 2, 3,  1, 2, 3,  0, 1, 3 }, 0));
+    tetrahedron->build();
+    return tetrahedron;
+}
 
-    // transform to centre c
+void DrawTetrahedron(Vector3r c, Scene& s, const Object *tetrahedron, int m, double scale, bool rotateX, bool rotateY, bool rotateZ) {
+    
+    // do necessary transformation: scale, then rotate, then move to centre c
 
-    v1 += c; v2 += c; v3 += c; v4 += c;
+    double rotation = 180;
 
-    // Draw Spike
+    Transform rotate;
+    if (rotateX) rotate = Transform::rotateX(rotation);
+    else if (rotateY) rotate = Transform::rotateY(rotation);
+    else if (rotateZ) rotate = Transform::rotateZ(rotation);
 
-    auto t1 = new Triangle(v1, v2, v3, m);
-    auto t2 = new Triangle(v1, v3, v4, m);
-    auto t3 = new Triangle(v2, v3, v4, m);
-    auto t4 = new Triangle(v1, v2, v4, m);
+    Transform toWorld = Transform::translate(c) * rotate * Transform::scale(scale);
 
-    s.surfaces.push_back(t1);
-    s.surfaces.push_back(t2);
-    s.surfaces.push_back(t3);
-    s.surfaces.push_back(t4);
-    
+    s.surfaces.push_back(new Instance(tetrahedron, toWorld, m));
 }
 
 void DefineScene2( Scene &scene, int imageWidth, int imageHeight )
@@ -420,8 +599,8 @@ void DefineScene2( Scene &scene, int imageWidth, int imageHeight )
 
     scene.ptLights.resize(2);
 
-    PointLightSource light0 = { Vector3d(100.0, 120.0, 10.0), Color(1.0f, 1.0f, 1.0f) * 0.3f };
-    PointLightSource light1 = { Vector3d(5.0, 80.0, 60.0), Color(1.0f, 1.0f, 1.0f) * 0.3f };
+    PointLightSource light0 = { Vector3r(100.0, 120.0, 10.0), Color(1.0f, 1.0f, 1.0f) * 0.3f };
+    PointLightSource light1 = { Vector3r(5.0, 80.0, 60.0), Color(1.0f, 1.0f, 1.0f) * 0.3f };
 
     scene.ptLights = { light0, light1 }; 
 
@@ -430,39 +609,42 @@ void DefineScene2( Scene &scene, int imageWidth, int imageHeight )
 
     scene.surfaces.resize(15);
 
-    auto horzPlane = new Plane(0.0, 1.0, 0.0, 0.0, scene.materials[1]); // Horizontal plane.
-    auto leftVertPlane = new Plane(1.0, 0.0, 0.0, 0.0, scene.materials[1]); // Left vertical plane.
-    auto rightVertPlane = new Plane(0.0, 0.0, 1.0, 0.0, scene.materials[1]); // Right vertical plane.
-    auto Moon = new Sphere(Vector3d(70.0, 40.0, 80.0), 30.0, scene.materials[2]);
+    auto horzPlane = new Plane(0.0, 1.0, 0.0, 0.0, 1); // Horizontal plane.
+    auto leftVertPlane = new Plane(1.0, 0.0, 0.0, 0.0, 1); // Left vertical plane.
+    auto rightVertPlane = new Plane(0.0, 0.0, 1.0, 0.0, 1); // Right vertical plane.
+    auto Moon = new Sphere(Vector3r(70.0, 40.0, 80.0), 30.0, 2);
     scene.surfaces = { horzPlane, leftVertPlane, rightVertPlane, Moon};
 
     // Draw the stars
-    /*DrawTetrahedron(Vector3d(70, 40, 80), scene, scene.materials[0], 30, 0, 0, 0);
-    DrawTetrahedron(Vector3d(70, 40, 80), scene, scene.materials[0], -30, 0, 0, 0);*/
+    Object *tetrahedron = MakeTetrahedron();
+    scene.objects.push_back(tetrahedron);
+
+    /*DrawTetrahedron(Vector3r(70, 40, 80), scene, tetrahedron, 0, 30, 0, 0, 0);
+    DrawTetrahedron(Vector3r(70, 40, 80), scene, tetrahedron, 0, -30, 0, 0, 0);*/
 
-    DrawTetrahedron(Vector3d(35, 75, 100), scene, scene.materials[0], 15, 1, 0, 0);
-    DrawTetrahedron(Vector3d(35, 75, 100), scene, scene.materials[0], -15, 1, 0, 0);
+    DrawTetrahedron(Vector3r(35, 75, 100), scene, tetrahedron, 0, 15, 1, 0, 0);
+    DrawTetrahedron(Vector3r(35, 75, 100), scene, tetrahedron, 0, -15, 1, 0, 0);
 
-    DrawTetrahedron(Vector3d(120, 23, 70), scene, scene.materials[0], 5, 0, 0, 1);
-    DrawTetrahedron(Vector3d(120, 23, 70), scene, scene.materials[0], -5, 0, 0, 1);
+    DrawTetrahedron(Vector3r(120, 23, 70), scene, tetrahedron, 0, 5, 0, 0, 1);
+    DrawTetrahedron(Vector3r(120, 23, 70), scene, tetrahedron, 0, -5, 0, 0, 1);
 
-    DrawTetrahedron(Vector3d(45, 50, 130), scene, scene.materials[0], 5, 0, 0, 1);
-    DrawTetrahedron(Vector3d(45, 50, 130), scene, scene.materials[0], -5, 0, 0, 1);
+    DrawTetrahedron(Vector3r(45, 50, 130), scene, tetrahedron, 0, 5, 0, 0, 1);
+    DrawTetrahedron(Vector3r(45, 50, 130), scene, tetrahedron, 0, -5, 0, 0, 1);
 
-    DrawTetrahedron(Vector3d(120, 80, 70), scene, scene.materials[0], 5, 1, 0, 1);
-    DrawTetrahedron(Vector3d(120, 80, 70), scene, scene.materials[0], -5, 1, 0, 1);
+    DrawTetrahedron(Vector3r(120, 80, 70), scene, tetrahedron, 0, 5, 1, 0, 1);
+    DrawTetrahedron(Vector3r(120, 80, 70), scene, tetrahedron, 0, -5, 1, 0, 1);
 
-    DrawTetrahedron(Vector3d(35, 70, 20), scene, scene.materials[0], 10, 0, 1, 0);
-    DrawTetrahedron(Vector3d(35, 70, 20), scene, scene.materials[0], -10, 0, 1, 0);
+    DrawTetrahedron(Vector3r(35, 70, 20), scene, tetrahedron, 0, 10, 0, 1, 0);
+    DrawTetrahedron(Vector3r(35, 70, 20), scene, tetrahedron, 0, -10, 0, 1, 0);
 
-    DrawTetrahedron(Vector3d(56, 11, 130), scene, scene.materials[0], 10, 1, 0, 1);
-    DrawTetrahedron(Vector3d(56, 11, 130), scene, scene.materials[0], -10, 1, 0, 1);
+    DrawTetrahedron(Vector3r(56, 11, 130), scene, tetrahedron, 0, 10, 1, 0, 1);
+    DrawTetrahedron(Vector3r(56, 11, 130), scene, tetrahedron, 0, -10, 1, 0, 1);
 
 
     // camera
-    scene.camera = Camera(Vector3d(200.0, 120.0, 200.0),  // eye
-        Vector3d(45.0, 22.0, 55.0),  // lookAt
-        Vector3d(0.0, 1.0, 0.0),  //upVector
+    scene.camera = Camera(Vector3r(200.0, 120.0, 200.0),  // eye
+        Vector3r(45.0, 22.0, 55.0),  // lookAt
+        Vector3r(0.0, 1.0, 0.0),  //upVector
         (-1.0 * imageWidth) / imageHeight,  // left
         (1.0 * imageWidth) / imageHeight,  // right
         -1.0, 1.0, 3.0,  // bottom, top, near
@@ -0,0 +1,49 @@
+#ifndef _OBJECT_H_
+#define _OBJECT_H_
+
+#include <vector>
+#include "Surface.h"
+#include "SurfaceBVH.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A piece of geometry that is modelled once, in its own object space, and
+// placed in the scene any number of times by Instance surfaces. It holds
+// the bottom-level BVH over its surfaces, which all instances share.
+//
+// An Object owns its surfaces. Call build() after the last surface has
+// been added and before any Instance of it is created.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class Object
+{
+public:
+
+    std::vector<Surface*> surfaces;  // Surface primitives in object space.
+
+    SurfaceBVH bvh;  // Bottom-level hierarchy over surfaces.
+
+
+    Object() = default;
+
+    ~Object()
+    {
+        for ( Surface *surface : surfaces ) delete surface;
+    }
+
+
+    void build( BVH::BuildMethod method = BVH::BuildMethod::BinnedSAH ) { bvh.build( surfaces, method ); }
+
+
+private:
+
+    // Disallow the use of copy constructor and assignment operator.
+    Object( const Object &object ) = delete;
+    Object &operator= ( const Object &object ) = delete;
+
+}; // Object
+
+
+#endif // _OBJECT_H_
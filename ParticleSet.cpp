@@ -0,0 +1,342 @@
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include "Util.h"
+#include "ParticleSet.h"
+
+using namespace std;
+
+
+// Number of bins along the longest axis of the sphere centers.
+static constexpr int NUM_BINS = 16;
+
+// SAH costs of a node visit, which tests the boxes of both children, and of
+// a sphere test. Sphere tests are cheap and their data compact, so leaves
+// are made as large as this keeps profitable, up to MAX_LEAF_SPHERES.
+static constexpr double TRAVERSAL_COST = 1.0;
+static constexpr double SPHERE_COST = 0.25;
+
+
+
+void ParticleSet::reserve( size_t numSpheres )
+{
+    mSpheres.reserve( numSpheres );
+    mMaterialIndices.reserve( numSpheres );
+}
+
+
+
+void ParticleSet::addSphere( const Vector3r &center, Real radius, int materialIndex )
+{
+    if ( materialIndex < 0 || materialIndex >= MAX_MATERIALS ) Util::ErrorExit( "ParticleSet: material index out of range." );
+    mSpheres.push_back( { { (float)center.x(), (float)center.y(), (float)center.z() }, (float)radius } );
+    mMaterialIndices.push_back( (uint16_t)materialIndex );
+}
+
+
+
+void ParticleSet::expandMaterialRange( int &lo, int &hi ) const
+{
+    for ( uint16_t materialIndex : mMaterialIndices )
+    {
+        lo = min( lo, (int)materialIndex );
+        hi = max( hi, (int)materialIndex );
+    }
+}
+
+
+
+size_t ParticleSet::memoryBytes() const
+{
+    return mSpheres.capacity() * sizeof( PackedSphere ) + mMaterialIndices.capacity() * sizeof( uint16_t )
+         + mNodes.capacity() * sizeof( Node );
+}
+
+
+
+BoundingBox ParticleSet::boundingBox() const
+{
+    if ( mNodes.empty() ) return BoundingBox();
+    const Node &root = mNodes[0];
+    return { Vector3r( root.min[0], root.min[1], root.min[2] ), Vector3r( root.max[0], root.max[1], root.max[2] ) };
+}
+
+
+
+void ParticleSet::build()
+{
+    mNodes.clear();
+    if ( mSpheres.empty() ) return;
+
+    // Leaves average about half full, so this is close to the final size.
+    mNodes.reserve( 4 * mSpheres.size() / MAX_LEAF_SPHERES + 1 );
+    mNodes.emplace_back();
+
+    vector<BuildTask> tasks = { { 0, 0, (int)mSpheres.size(), 1 } };
+    while ( !tasks.empty() )
+    {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+        subdivide( task, tasks );
+    }
+    mNodes.shrink_to_fit();
+}
+
+
+
+void ParticleSet::subdivide( const BuildTask &task, vector<BuildTask> &tasks )
+{
+    int begin = task.begin, end = task.end, count = end - begin;
+
+    // Bounds of the spheres, and of their centers.
+    BoundingBox box, centerBox;
+    for ( int i = begin; i < end; i++ )
+    {
+        const PackedSphere &s = mSpheres[i];
+        Vector3r c( s.center[0], s.center[1], s.center[2] );
+        Vector3r r( s.radius, s.radius, s.radius );
+        box.expand( c - r ).expand( c + r );
+        centerBox.expand( c );
+    }
+
+    Node &node = mNodes[ task.nodeIndex ];
+    for ( int a = 0; a < 3; a++ )
+    {
+        node.min[a] = Util::RoundDownToFloat( box.min()[a] );
+        node.max[a] = Util::RoundUpToFloat( box.max()[a] );
+    }
+    node.first = begin;
+    node.count = count;
+
+    if ( count <= 2 || task.depth >= MAX_DEPTH ) return;
+
+    int axis = centerBox.maxExtentAxis();
+    double extent = centerBox.extent()[ axis ];
+    int mid;
+
+    if ( extent <= 0.0 )
+    {
+        // All centers coincide: any split is as good as any other.
+        if ( count <= MAX_LEAF_SPHERES ) return;
+        mid = begin + count / 2;
+    }
+    else
+    {
+        double axisMin = centerBox.min()[ axis ];
+        double scale = NUM_BINS / extent;
+        auto binIndex = [&]( const PackedSphere &s ) { return min( (int)( ( s.center[ axis ] - axisMin ) * scale ), NUM_BINS - 1 ); };
+
+        int binCount[ NUM_BINS ] = {};
+        BoundingBox binBox[ NUM_BINS ];
+        for ( int i = begin; i < end; i++ )
+        {
+            const PackedSphere &s = mSpheres[i];
+            int b = binIndex( s );
+            Vector3r c( s.center[0], s.center[1], s.center[2] );
+            Vector3r r( s.radius, s.radius, s.radius );
+            binCount[b]++;
+            binBox[b].expand( c - r ).expand( c + r );
+        }
+
+        // Sweep the bin boundaries for the cheapest split. The extreme
+        // centers fall in the first and last bins, so both sides of the
+        // best split are nonempty.
+        double rightCost[ NUM_BINS ];
+        BoundingBox right;
+        int rightCount = 0;
+        for ( int b = NUM_BINS - 1; b > 0; b-- )
+        {
+            right.expand( binBox[b] );
+            rightCount += binCount[b];
+            rightCost[b] = right.surfaceArea() * rightCount;
+        }
+
+        double bestCost = DBL_MAX;
+        int bestBin = 1;
+        BoundingBox left;
+        int leftCount = 0;
+        for ( int b = 1; b < NUM_BINS; b++ )
+        {
+            left.expand( binBox[ b - 1 ] );
+            leftCount += binCount[ b - 1 ];
+            if ( leftCount == 0 || leftCount == count ) continue;
+            double cost = left.surfaceArea() * leftCount + rightCost[b];
+            if ( cost < bestCost )
+            {
+                bestCost = cost;
+                bestBin = b;
+            }
+        }
+
+        double area = box.surfaceArea();
+        double splitCost = ( area > 0.0 )? TRAVERSAL_COST + SPHERE_COST * bestCost / area : DBL_MAX;
+        if ( count <= MAX_LEAF_SPHERES && SPHERE_COST * count <= splitCost ) return;
+
+        // Partition the spheres, and their material indices with them.
+        int i = begin, j = end - 1;
+        while ( true )
+        {
+            while ( i <= j && binIndex( mSpheres[i] ) < bestBin ) i++;
+            while ( i <= j && binIndex( mSpheres[j] ) >= bestBin ) j--;
+            if ( i >= j ) break;
+            swap( mSpheres[i], mSpheres[j] );
+            swap( mMaterialIndices[i], mMaterialIndices[j] );
+        }
+        mid = i;
+    }
+
+    int leftChild = (int)mNodes.size();
+    mNodes.emplace_back();
+    mNodes.emplace_back();
+    Node &parent = mNodes[ task.nodeIndex ];  // The emplace may have moved it.
+    parent.first = leftChild;
+    parent.count = 0;
+
+    tasks.push_back( { leftChild + 1, mid, end, task.depth + 1 } );
+    tasks.push_back( { leftChild, begin, mid, task.depth + 1 } );
+}
+
+
+
+Real ParticleSet::hitNode( const Node &node, const Vector3r &origin, const Vector3r &invDir, Real tmin, Real tmax )
+{
+    for ( int a = 0; a < 3; a++ )
+    {
+        Real t0 = ( node.min[a] - origin[a] ) * invDir[a];
+        Real t1 = ( node.max[a] - origin[a] ) * invDir[a];
+        if ( invDir[a] < 0 ) swap( t0, t1 );
+        tmin = ( t0 > tmin )? t0 : tmin;
+        tmax = ( t1 < tmax )? t1 : tmax;
+        if ( tmax < tmin ) return NAN;
+    }
+    return tmin;
+}
+
+
+
+Real ParticleSet::hitSphere( const PackedSphere &sphere, const Vector3r &origin, const Vector3r &dir, Real a )
+{
+    Real ox = origin.x() - sphere.center[0];
+    Real oy = origin.y() - sphere.center[1];
+    Real oz = origin.z() - sphere.center[2];
+    Real radius = sphere.radius;
+
+    Real b = dir.x() * ox + dir.y() * oy + dir.z() * oz;
+    Real c = ( ox * ox + oy * oy + oz * oz ) - radius * radius;
+    Real disc = b * b - a * c;
+    if ( !( disc >= 0 ) ) return NAN;
+
+    Real sqrtDisc = sqrt( disc );
+    Real t1 = ( -b - sqrtDisc ) / a;
+    return ( t1 >= 0 )? t1 : ( -b + sqrtDisc ) / a;
+}
+
+
+
+bool ParticleSet::hit( const Ray &r, Real tmin, Real tmax, SurfaceHit &hit ) const 
+{
+    if ( mNodes.empty() ) return false;
+
+    Vector3r origin = r.origin(), dir = r.direction();
+    Vector3r invDir( 1 / dir.x(), 1 / dir.y(), 1 / dir.z() );
+    Real a = dot( dir, dir );
+
+    // Stack of nodes to visit, with their entry parameters, to skip those
+    // that a nearer hit found in the meantime has culled.
+    struct Entry { int node; Real t; } stack[ MAX_DEPTH ];
+    int stackSize = 0;
+    int hitIndex = -1;
+
+    Real tRoot = hitNode( mNodes[0], origin, invDir, tmin, tmax );
+    if ( isnan( tRoot ) ) return false;
+    stack[ stackSize++ ] = { 0, tRoot };
+
+    while ( stackSize > 0 )
+    {
+        Entry entry = stack[ --stackSize ];
+        if ( entry.t > tmax ) continue;
+        const Node *node = &mNodes[ entry.node ];
+
+        // Descend toward the nearer child, pushing the farther one.
+        while ( node->count == 0 )
+        {
+            const Node &left = mNodes[ node->first ], &right = mNodes[ node->first + 1 ];
+            Real tLeft = hitNode( left, origin, invDir, tmin, tmax );
+            Real tRight = hitNode( right, origin, invDir, tmin, tmax );
+            bool hitLeft = !isnan( tLeft ), hitRight = !isnan( tRight );
+            if ( hitLeft && hitRight )
+            {
+                bool leftIsNear = tLeft <= tRight;
+                stack[ stackSize++ ] = leftIsNear? Entry{ node->first + 1, tRight } : Entry{ node->first, tLeft };
+                node = leftIsNear? &left : &right;
+            }
+            else if ( hitLeft ) node = &left;
+            else if ( hitRight ) node = &right;
+            else break;
+        }
+        if ( node->count == 0 ) continue;
+
+        for ( int i = node->first; i < node->first + node->count; i++ )
+        {
+            Real t = hitSphere( mSpheres[i], origin, dir, a );
+            if ( t >= tmin && t <= tmax )
+            {
+                tmax = t;
+                hitIndex = i;
+            }
+        }
+    }
+
+    if ( hitIndex < 0 ) return false;
+
+    hit.set( tmax, this, hitIndex );
+    return true;
+}
+
+
+
+void ParticleSet::hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const
+{
+    const PackedSphere &s = mSpheres[ hit.primIndex ];
+    rec.p = r.pointAtParam( hit.t );
+    rec.normal = ( rec.p - Vector3r( s.center[0], s.center[1], s.center[2] ) ).unitVector();
+    rec.material = mMaterialIndices[ hit.primIndex ];
+}
+
+
+
+bool ParticleSet::shadowHit( const Ray &r, Real tmin, Real tmax ) const 
+{
+    if ( mNodes.empty() ) return false;
+
+    Vector3r origin = r.origin(), dir = r.direction();
+    Vector3r invDir( 1 / dir.x(), 1 / dir.y(), 1 / dir.z() );
+    Real a = dot( dir, dir );
+
+    // Like Sphere::shadowHit(), only roots at t >= 0 block.
+    Real tminBlock = Util::Max2( tmin, Real( 0 ) );
+
+    int stack[ MAX_DEPTH ];
+    int stackSize = 0;
+    stack[ stackSize++ ] = 0;
+
+    while ( stackSize > 0 )
+    {
+        const Node &node = mNodes[ stack[ --stackSize ] ];
+        if ( isnan( hitNode( node, origin, invDir, tmin, tmax ) ) ) continue;
+
+        if ( node.count == 0 )
+        {
+            stack[ stackSize++ ] = node.first + 1;
+            stack[ stackSize++ ] = node.first;
+            continue;
+        }
+
+        for ( int i = node.first; i < node.first + node.count; i++ )
+        {
+            Real t = hitSphere( mSpheres[i], origin, dir, a );
+            if ( t >= tminBlock && t <= tmax ) return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,115 @@
+#ifndef _PARTICLESET_H_
+#define _PARTICLESET_H_
+
+#include <vector>
+#include <cstdint>
+#include "Surface.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A compact set of spheres for massive particle and point-cloud data, at
+// about 30 bytes per sphere including its hierarchy, so that tens of
+// millions of spheres fit in a few GB.
+//
+// Spheres are stored as float centers and radii with a 16-bit index into
+// Scene::materials. The set has its own BVH with float bounds
+// (rounded outward, so they always contain their spheres), built in place
+// over the sphere array by binning the sphere centers. Leaves hold up to
+// MAX_LEAF_SPHERES spheres, as a sphere test costs much less than a node
+// visit. Intersection arithmetic is done in the precision of Real.
+//
+// Add all spheres, then call build() before tracing rays.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class ParticleSet : public Surface 
+{
+public:
+
+    static constexpr int MAX_LEAF_SPHERES = 8;
+    static constexpr int MAX_MATERIALS = 65536;
+
+
+    void reserve( size_t numSpheres );
+
+    // materialIndex indexes Scene::materials and must be below MAX_MATERIALS.
+    void addSphere( const Vector3r &center, Real radius, int materialIndex );
+
+    // Builds the hierarchy, reordering the spheres.
+    void build();
+
+
+    bool hit(const Ray &r, // Ray being sent.
+             Real tmin,  // Minimum hit parameter to be searched for.
+             Real tmax,  // Maximum hit parameter to be searched for.
+             SurfaceHit &hit
+             ) const override;
+
+
+    [[nodiscard]] bool shadowHit(const Ray &r, // Ray being sent.
+                                 Real tmin,  // Minimum hit parameter to be searched for.
+                                 Real tmax   // Maximum hit parameter to be searched for.
+                                 ) const override;
+
+
+    void hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const override;
+
+
+    [[nodiscard]] BoundingBox boundingBox() const override;
+
+
+    // The materials of all spheres.
+    void expandMaterialRange( int &lo, int &hi ) const override;
+
+
+    [[nodiscard]] int numSpheres() const { return (int)mSpheres.size(); }
+    [[nodiscard]] int numNodes() const { return (int)mNodes.size(); }
+
+    // Heap memory used by the sphere, material index and node arrays.
+    [[nodiscard]] size_t memoryBytes() const;
+
+
+private:
+
+    struct PackedSphere
+    {
+        float center[3];
+        float radius;
+    };
+
+    struct Node
+    {
+        float min[3];
+        int first;  // Leaf: index of first sphere. Interior: index of left child (right child is first + 1).
+        float max[3];
+        int count;  // Number of spheres in a leaf, 0 for an interior node.
+    };
+
+    // Maximum depth of the tree, which is also the size of the traversal stack.
+    static constexpr int MAX_DEPTH = 64;
+
+    // Entry parameter of the ray into the node box within [tmin, tmax], or
+    // NaN if the ray misses it.
+    static Real hitNode( const Node &node, const Vector3r &origin, const Vector3r &invDir, Real tmin, Real tmax );
+
+    // Parameter of the ray's hit with a sphere, as in Sphere::hit(), or NaN if missed.
+    static Real hitSphere( const PackedSphere &sphere, const Vector3r &origin, const Vector3r &dir, Real a );
+
+    struct BuildTask
+    {
+        int nodeIndex, begin, end, depth;
+    };
+
+    // Splits the spheres [begin, end) of the node, queueing its children
+    // on tasks, or makes it a leaf.
+    void subdivide( const BuildTask &task, std::vector<BuildTask> &tasks );
+
+    std::vector<PackedSphere> mSpheres;
+    std::vector<uint16_t> mMaterialIndices;  // One per sphere.
+    std::vector<Node> mNodes;
+
+}; // ParticleSet
+
+
+#endif // _PARTICLESET_H_
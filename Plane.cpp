@@ -5,29 +5,41 @@ using namespace std;
 
 
 
-bool Plane::hit( const Ray &r, double tmin, double tmax, SurfaceHitRecord &rec ) const 
+bool Plane::hit( const Ray &r, Real tmin, Real tmax, SurfaceHit &hit ) const 
 {
-    Vector3d N( A, B, C );
-    double NRd = dot( N, r.direction() );
-    double NRo = dot( N, r.origin() );
-    double t = (-D - NRo) / NRd;
+    Vector3r N( A, B, C );
+    Real NRd = dot( N, r.direction() );
+    Real NRo = dot( N, r.origin() );
+    Real t = (-D - NRo) / NRd;
     if ( t < tmin || t > tmax ) return false;
 
-    // We have a hit -- populate hit record. 
-    rec.t = t;
-    rec.p = r.pointAtParam(t);
-    rec.normal = N;
-    rec.material = material;
+    hit.set( t, this );
     return true;
 }
 
 
 
-bool Plane::shadowHit( const Ray &r, double tmin, double tmax ) const 
+void Plane::hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const
+{
+    rec.p = r.pointAtParam(hit.t);
+    rec.normal = Vector3r( A, B, C );
+    rec.material = material;
+}
+
+
+
+bool Plane::shadowHit( const Ray &r, Real tmin, Real tmax ) const 
 {
-    Vector3d N( A, B, C );
-    double NRd = dot( N, r.direction() );
-    double NRo = dot( N, r.origin() );
-    double t = (-D - NRo) / NRd;
+    Vector3r N( A, B, C );
+    Real NRd = dot( N, r.direction() );
+    Real NRo = dot( N, r.origin() );
+    Real t = (-D - NRo) / NRd;
     return ( t >= tmin && t <= tmax );
 }
+
+
+
+BoundingBox Plane::boundingBox() const
+{
+    return BoundingBox::infinite();
+}
@@ -9,17 +9,17 @@ class Plane : public Surface
 public:
 
     // The plane equation is Ax + By + Cz + D = 0.
-    double A, B, C, D;
+    Real A, B, C, D;
 
 
-    Plane( double A_, double B_, double C_, double D_, const Material &theMaterial )
+    Plane( Real A_, Real B_, Real C_, Real D_, int theMaterial )
     { 
         A = A_;  B = B_;  C = C_;  D = D_;  
         material = theMaterial;
     }
 
 
-    Plane( const Vector3d &normal, const Vector3d &pointOnPlane, const Material &theMaterial )
+    Plane( const Vector3r &normal, const Vector3r &pointOnPlane, int theMaterial )
     {
         A = normal.x();
         B = normal.y();
@@ -29,15 +29,21 @@ public:
     }
 
     bool hit(const Ray &r, // Ray being sent.
-             double tmin,  // Minimum hit parameter to be searched for.
-             double tmax,  // Maximum hit parameter to be searched for.
-             SurfaceHitRecord &rec
+             Real tmin,  // Minimum hit parameter to be searched for.
+             Real tmax,  // Maximum hit parameter to be searched for.
+             SurfaceHit &hit
             ) const override;
 
     [[nodiscard]] bool shadowHit(const Ray &r, // Ray being sent.
-                                 double tmin,  // Minimum hit parameter to be searched for.
-                                 double tmax   // Maximum hit parameter to be searched for.
+                                 Real tmin,  // Minimum hit parameter to be searched for.
+                                 Real tmax   // Maximum hit parameter to be searched for.
                                 ) const override;
+
+
+    void hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const override;
+
+
+    [[nodiscard]] BoundingBox boundingBox() const override;
 };
 
 #endif // _PLANE_H_
@@ -0,0 +1,87 @@
+#ifndef _PLANELIST_H_
+#define _PLANELIST_H_
+
+#include <vector>
+#include "Vector3d.h"
+#include "Ray.h"
+#include "Plane.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// The planes of a set of surfaces, kept as bare plane equations in a
+// compact array, so that they are tested without virtual calls. Planes
+// are unbounded and cannot be placed in a BVH, so SurfaceBVH and
+// CompiledScene test them linearly on every query.
+//
+// A PlaneList does not own the planes.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class PlaneList
+{
+public:
+
+    void add( const Plane &plane ) { mRecords.push_back( { Vector3r( plane.A, plane.B, plane.C ), plane.D, &plane } ); }
+
+    void clear() { mRecords.clear(); }
+
+    [[nodiscard]] int size() const { return (int)mRecords.size(); }
+    [[nodiscard]] bool empty() const { return mRecords.empty(); }
+
+    [[nodiscard]] const Plane &plane( int i ) const { return *mRecords[i].plane; }
+
+    // The normal ( A, B, C ) of plane i.
+    [[nodiscard]] const Vector3r &normal( int i ) const { return mRecords[i].N; }
+
+
+    // Finds the nearest plane hit in [tmin, tmax] and shrinks tmax to it.
+    // Returns the index of the plane, or -1 if none is hit.
+    int hit( const Ray &r, Real tmin, Real &tmax ) const
+    {
+        int nearestPlane = -1;
+        for ( int i = 0; i < (int)mRecords.size(); i++ )
+        {
+            Real t = intersect( mRecords[i], r );
+            if ( t >= tmin && t <= tmax )
+            {
+                tmax = t;
+                nearestPlane = i;
+            }
+        }
+        return nearestPlane;
+    }
+
+
+    // Does the ray hit any plane in [tmin, tmax]?
+    [[nodiscard]] bool occluded( const Ray &r, Real tmin, Real tmax ) const
+    {
+        for ( const Record &record : mRecords )
+        {
+            Real t = intersect( record, r );
+            if ( t >= tmin && t <= tmax ) return true;
+        }
+        return false;
+    }
+
+
+private:
+
+    struct Record
+    {
+        Vector3r N;  // Plane equation dot( N, p ) + D = 0.
+        Real D;
+        const Plane *plane;
+    };
+
+    static Real intersect( const Record &record, const Ray &r )
+    {
+        return (-record.D - dot( record.N, r.origin() )) / dot( record.N, r.direction() );
+    }
+
+    std::vector<Record> mRecords;
+
+}; // PlaneList
+
+
+#endif // _PLANELIST_H_
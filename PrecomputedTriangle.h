@@ -0,0 +1,106 @@
+#ifndef _PRECOMPUTEDTRIANGLE_H_
+#define _PRECOMPUTEDTRIANGLE_H_
+
+#include <cmath>
+#include <array>
+#include <limits>
+#include "Vector3d.h"
+#include "Ray.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A triangle prepared for fast ray intersection by the method of Baldwin
+// and Weber ("Fast Ray-Triangle Intersections by Coordinate
+// Transformation", JCGT 2016). It stores the affine transform that maps
+// the triangle to the unit triangle (0,0,0), (1,0,0), (0,1,0). A ray is
+// intersected by transforming it and hitting the plane z = 0, after which
+// the barycentric coordinates are simply the x and y of the hit point.
+//
+// The transform is 12 numbers, but its third row always has a 1 in the
+// coordinate of the largest normal component, so only 9 are stored.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class PrecomputedTriangle
+{
+public:
+
+    PrecomputedTriangle() = default;
+
+    // A degenerate triangle (zero area) is never hit.
+    PrecomputedTriangle( const Vector3r &v0, const Vector3r &v1, const Vector3r &v2 )
+    {
+        Vector3r e1 = v1 - v0;
+        Vector3r e2 = v2 - v0;
+        Vector3r n = cross( e1, e2 );
+        Real absN[3] = { std::abs( n.x() ), std::abs( n.y() ), std::abs( n.z() ) };
+
+        // Rows of the transform in coordinates (i, j, k), where i is the
+        // axis of the largest normal component and (i, j, k) is cyclic.
+        mI = ( absN[0] >= absN[1] && absN[0] >= absN[2] )? 0 : ( absN[1] >= absN[2] )? 1 : 2;
+        mJ = ( mI + 1 ) % 3;
+        mK = ( mI + 2 ) % 3;
+        if ( absN[ mI ] == 0.0 )
+        {
+            m[8] = std::numeric_limits<Real>::quiet_NaN();
+            return;
+        }
+
+        int i = mI, j = mJ, k = mK;
+        Real invN = 1 / n[i];
+        Vector3r v2xv0 = cross( v2, v0 );
+        Vector3r v1xv0 = cross( v1, v0 );
+
+        m = { e2[k] * invN,  -e2[j] * invN,  v2xv0[i] * invN,
+              -e1[k] * invN,  e1[j] * invN,  -v1xv0[i] * invN,
+              n[j] * invN,    n[k] * invN,   -dot( n, v0 ) * invN };
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Intersects the ray with the triangle. On a hit in [tmin, tmax], returns
+    // true with the hit parameter t and the barycentric coordinates beta
+    // and gamma of the second and third vertices.
+    //////////////////////////////////////////////////////////////////////////////
+
+    bool hit( const Ray &r, Real tmin, Real tmax, Real &t, Real &beta, Real &gamma ) const
+    {
+        int i = mI, j = mJ, k = mK;
+        Vector3r o = r.origin(), d = r.direction();
+
+        // Distance of the origin from the plane, and its rate along the ray.
+        Real oz = o[i] + m[6] * o[j] + m[7] * o[k] + m[8];
+        Real dz = d[i] + m[6] * d[j] + m[7] * d[k];
+        t = -oz / dz;
+        if ( !( t >= tmin && t <= tmax ) ) return false;
+
+        // Barycentric coordinates of the hit point.
+        Real y = o[j] + t * d[j], z = o[k] + t * d[k];
+        beta = m[0] * y + m[1] * z + m[2];
+        if ( beta < 0.0 || beta > 1.0 ) return false;
+        gamma = m[3] * y + m[4] * z + m[5];
+        return ( gamma >= 0.0 && beta + gamma <= 1.0 );
+    }
+
+
+    // Does the ray hit the triangle in [tmin, tmax]?
+    [[nodiscard]] bool hit( const Ray &r, Real tmin, Real tmax ) const
+    {
+        Real t, beta, gamma;
+        return hit( r, tmin, tmax, t, beta, gamma );
+    }
+
+
+private:
+
+    // Rows 0 and 1 of the transform without their i coefficient, which is
+    // 0, then row 2 without its i coefficient, which is 1. A degenerate
+    // triangle has a NaN offset, for which t is never a number.
+    std::array<Real, 9> m{};
+    int mI = 0, mJ = 1, mK = 2;
+
+}; // PrecomputedTriangle
+
+
+#endif // _PRECOMPUTEDTRIANGLE_H_
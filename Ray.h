@@ -5,41 +5,44 @@
 #include "Vector3d.h"
 
 
-class Ray  
+// A ray with scalar type T. Ray is in the precision of the renderer.
+
+template <typename T>
+class RayT  
 {
 public:
     
 // Constructors
 
-    Ray() = default;
+    RayT() = default;
 
-    Ray( const Vector3d &origin, const Vector3d &direction ) 
+    RayT( const Vector3<T> &origin, const Vector3<T> &direction ) 
         { data[0] = origin; data[1] = direction;  }
 
 
 // Data setting and reading.
 
-    Ray &setRay( const Vector3d &origin, const Vector3d &direction ) 
+    RayT &setRay( const Vector3<T> &origin, const Vector3<T> &direction ) 
         { data[0] = origin; data[1] = direction; return (*this); }
 
-    Ray &setOrigin( const Vector3d &origin ) { data[0] = origin; return (*this); }
-    Ray &setDirection( const Vector3d &direction ) { data[1] = direction; return (*this); }
+    RayT &setOrigin( const Vector3<T> &origin ) { data[0] = origin; return (*this); }
+    RayT &setDirection( const Vector3<T> &direction ) { data[1] = direction; return (*this); }
 
-    [[nodiscard]] Vector3d origin() const { return data[0]; }
-    [[nodiscard]] Vector3d direction() const { return data[1]; }
+    [[nodiscard]] Vector3<T> origin() const { return data[0]; }
+    [[nodiscard]] Vector3<T> direction() const { return data[1]; }
 
 
 // Other functions.
 
-    [[nodiscard]] Vector3d pointAtParam( double t ) const { return data[0] + t * data[1]; }
+    [[nodiscard]] Vector3<T> pointAtParam( T t ) const { return data[0] + t * data[1]; }
 
-    Ray &makeUnitDirection()
+    RayT &makeUnitDirection()
     {
         data[1].makeUnitVector();
         return (*this);
     }
 
-    Ray &moveOriginForward( double delta_t )
+    RayT &moveOriginForward( T delta_t )
     {
         data[0] += delta_t * data[1];
         return (*this);
@@ -47,14 +50,19 @@ public:
 
 private:
 
-    std::array<Vector3d, 2> data;
+    std::array<Vector3<T>, 2> data;
 
-}; // Ray
+}; // RayT
 
 
 
-inline std::ostream &operator<< ( std::ostream &os, const Ray &r )
+template <typename T>
+inline std::ostream &operator<< ( std::ostream &os, const RayT<T> &r )
     { return ( os << "(" << r.origin() << ") + t("  << r.direction() << ")" ); }
 
 
+
+using Ray = RayT<Real>;
+
+
 #endif // _RAY_H_
@@ -0,0 +1,91 @@
+#ifndef _RAYPACKET_H_
+#define _RAYPACKET_H_
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include "Vector3d.h"
+#include "Ray.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A packet of up to MAX_RAYS rays, such as the primary rays of a tile of
+// SIZE x SIZE pixels, to be traced through a BVH together.
+//
+// A packet is coherent if its rays share an origin and their directions
+// agree in sign along each axis. The reciprocal directions then span an
+// interval per axis that does not cross zero, and interval arithmetic
+// gives a range of t containing the box hits of every ray in the packet,
+// so a node is culled for all rays at once. Packets that are not coherent
+// are traced ray by ray.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class RayPacket
+{
+public:
+
+    static constexpr int SIZE = 8;
+    static constexpr int MAX_RAYS = SIZE * SIZE;
+
+
+    void clear() { mNumRays = 0; }
+
+    // Adds a ray. Its direction must not be zero.
+    void addRay( const Ray &r )
+    {
+        assert( mNumRays < MAX_RAYS );
+        mRays[ mNumRays++ ] = r;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Computes the interval of the reciprocal directions and decides
+    // whether the packet is coherent. Call after the last addRay(), before
+    // the packet is traced.
+    //////////////////////////////////////////////////////////////////////////////
+
+    void finalize()
+    {
+        mIsCoherent = ( mNumRays > 0 );
+        for ( int a = 0; a < 3 && mIsCoherent; a++ )
+        {
+            bool isNeg = std::signbit( mRays[0].direction()[a] );
+            mMinInvDir[a] = mMaxInvDir[a] = 1 / mRays[0].direction()[a];
+            for ( int i = 1; i < mNumRays && mIsCoherent; i++ )
+            {
+                Real invDir = 1 / mRays[i].direction()[a];
+                mMinInvDir[a] = std::min( mMinInvDir[a], invDir );
+                mMaxInvDir[a] = std::max( mMaxInvDir[a], invDir );
+                mIsCoherent = ( std::signbit( mRays[i].direction()[a] ) == isNeg &&
+                                mRays[i].origin() == mRays[0].origin() );
+            }
+        }
+    }
+
+    [[nodiscard]] int numRays() const { return mNumRays; }
+
+    [[nodiscard]] const Ray &ray( int i ) const { return mRays[i]; }
+
+    [[nodiscard]] bool isCoherent() const { return mIsCoherent; }
+
+    // The shared origin and the bounds of the reciprocal directions of a coherent packet.
+    [[nodiscard]] Vector3r origin() const { return mRays[0].origin(); }
+    [[nodiscard]] const Vector3r &minInvDir() const { return mMinInvDir; }
+    [[nodiscard]] const Vector3r &maxInvDir() const { return mMaxInvDir; }
+
+    // Is the direction of the coherent packet negative along the axis?
+    [[nodiscard]] bool dirIsNeg( int axis ) const { return ( mMinInvDir[ axis ] < 0 ); }
+
+
+private:
+
+    Ray mRays[ MAX_RAYS ];
+    int mNumRays = 0;
+    bool mIsCoherent = false;
+    Vector3r mMinInvDir, mMaxInvDir;
+
+}; // RayPacket
+
+
+#endif // _RAYPACKET_H_
@@ -7,6 +7,10 @@
 
 #include <cmath>
 #include <cfloat>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include "Util.h"
 #include "Vector3d.h"
 #include "Color.h"
 #include "Ray.h"
@@ -14,133 +18,326 @@
 #include "Surface.h"
 #include "Light.h"
 #include "Scene.h"
+#include "CompiledScene.h"
+#include "Shading.h"
 #include "Raytrace.h"
 
 
-// This is for avoiding the "epsilon problem" or the shadow acne problem.
-static constexpr double DEFAULT_TMIN = 10e-6;
+//////////////////////////////////////////////////////////////////////////////
+// Finds the nearest hit of the ray in the scene. The surfaces of a Scene
+// are tested one by one.
+//////////////////////////////////////////////////////////////////////////////
 
-// Use this for tmax for non-shadow ray intersection test.
-static constexpr double DEFAULT_TMAX = DBL_MAX;
+static bool hitScene( const Ray &ray, const Scene &scene, SurfaceHitRecord &nearestHitRec )
+{
+    SurfaceHit nearestHit;
+    bool hasHitSomething = false;
+    Real nearest_t = Shading::DEFAULT_TMAX;
 
+    for (const auto& surface : scene.surfaces)
+    {
+        if ( surface->hit( ray, Shading::DEFAULT_TMIN, nearest_t, nearestHit ) )
+        {
+            hasHitSomething = true;
+            nearest_t = nearestHit.t;
+        }
+    }
+    if ( !hasHitSomething ) return false;
+
+    // Only the nearest hit gets its hit record filled in.
+    nearestHit.resolve( ray, nearestHitRec );
+    return true;
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// Compute the outgoing mirror reflection vector.
-// Input incoming vector L is pointing AWAY from surface point.
-// Assume normal vector N is unit vector.
-// The output reflection vector is pointing AWAY from surface point, and
-// has same length as incoming vector L.
-//////////////////////////////////////////////////////////////////////////////
 
-static Vector3d mirrorReflect( const Vector3d &L, const Vector3d &N )
+static bool hitScene( const Ray &ray, const CompiledScene &scene, SurfaceHitRecord &nearestHitRec )
 {
-    return ( 2.0 * dot( N, L ) ) * N - L;
+    return scene.hit( ray, Shading::DEFAULT_TMIN, Shading::DEFAULT_TMAX, nearestHitRec );
 }
 
 
 
 //////////////////////////////////////////////////////////////////////////////
-// Compute I_source * [ k_d * (N.L) + k_r * (R.V)^n ].
-// Input vectors L, N and V are pointing AWAY from surface point.
-// Assume all vector L, N and V are unit vectors.
+// Is the shadow ray blocked before maxT?
 //////////////////////////////////////////////////////////////////////////////
 
-static Color computePhongLighting( const Vector3d &L, const Vector3d &N, const Vector3d &V,
-                                   const Material &mat, const PointLightSource &ptLight )
+static bool shadowHitScene( const Ray &shadowRay, Real maxT, const Scene &scene )
 {
-    Vector3d R = mirrorReflect(L, N);
-
-    auto N_dot_L = (float)dot(N, L);
-    if (N_dot_L < 0.0f) N_dot_L = 0.0f;
+    for (auto& surface : scene.surfaces) {
+        if (surface->shadowHit(shadowRay, Shading::DEFAULT_TMIN, maxT)) return true;
+    }
+    return false;
+}
 
-    auto R_dot_V = (float)dot(R, V);
-    if (R_dot_V < 0.0f) R_dot_V = 0.0f;
-    float R_dot_V_pow_n = powf(R_dot_V, (float)mat.n);
 
-    return ptLight.I_source * (mat.k_d * N_dot_L + mat.k_r * R_dot_V_pow_n);
+static bool shadowHitScene( const Ray &shadowRay, Real maxT, const CompiledScene &scene )
+{
+    return scene.shadowHit( shadowRay, Shading::DEFAULT_TMIN, maxT );
 }
 
 
 
-//////////////////////////////////////////////////////////////////////////////
-// Traces a ray into the scene.
-// reflectLevels: specifies number of levels of reflections (0 for no reflection).
-// hasShadow: specifies whether to generate shadows.
-//////////////////////////////////////////////////////////////////////////////
+template <typename SceneType>
+static Color traceRay( const Ray &ray, const SceneType &scene, 
+                       int reflectLevels, bool hasShadow );
 
-Color Raytrace::TraceRay( const Ray &ray, const Scene &scene, 
-                          int reflectLevels, bool hasShadow )
-{
-    Ray uRay( ray );
-    uRay.makeUnitDirection();  // Normalize ray direction.
 
 
-// Find whether and where the ray hits some surface.
-// Take the nearest hit point.
+//////////////////////////////////////////////////////////////////////////////
+// Computes the phong lighting at the point p by the clusters of the cut of
+// the light tree of the scene, each shadowed by its representative light
+// if hasShadow is true.
+//////////////////////////////////////////////////////////////////////////////
 
-    bool hasHitSomething = false;
-    double nearest_t = DEFAULT_TMAX;
-    SurfaceHitRecord nearestHitRec;
+static Color cutLighting( const Vector3r &p, const Vector3r &N, const Vector3r &V,
+                          const Material &material, const CompiledScene &scene, bool hasShadow )
+{
+    LightTree::CutLight cut[ LightTree::MAX_CUT ];
+    int cutSize = scene.lightTree().selectCut( p, N, V, material, cut );
 
-    for (const auto& surface : scene.surfaces)
+    Color result( 0.0f, 0.0f, 0.0f );
+    int numTraced = 0, numCulled = 0;
+    for ( int c = 0; c < cutSize; c++ )
     {
-        SurfaceHitRecord tempHitRec;
-        bool hasHit = surface->hit( uRay, DEFAULT_TMIN, DEFAULT_TMAX, tempHitRec );
-
-        if ( hasHit && tempHitRec.t < nearest_t )
+        Color kshadow( 1.0, 1.0, 1.0 );
+        if ( hasShadow && Shading::IsShadowRayCulled( cut[c].lighting ) ) numCulled++;
+        else if ( hasShadow )
         {
-            hasHitSomething = true;
-            nearest_t = tempHitRec.t;
-            nearestHitRec = tempHitRec;
+            numTraced++;
+            const Vector3r &lightPos = scene.ptLights[ cut[c].light ].position;
+            Vector3r L = ( lightPos - p ).unitVector();
+            Ray shadowRay( Shading::OffsetRayOrigin( p, N, L ), L );
+            Real maxT = ( lightPos - shadowRay.origin() ).length();
+            if ( shadowHitScene( shadowRay, maxT, scene ) ) kshadow.setRGB( 0.0, 0.0, 0.0 );
         }
+        result += kshadow * cut[c].lighting;
     }
+    Shading::RecordShadowRays( numTraced, numCulled );
+    return result;
+}
+
 
-    if ( !hasHitSomething ) return scene.backgroundColor;
+
+//////////////////////////////////////////////////////////////////////////////
+// Computes the color seen along the ray uRay, with unit direction, at its
+// nearest hit nearestHitRec, including shadows and reflections. If
+// lightBlocked is given, lightBlocked[l] tells whether the hit point is in
+// the shadow of light l, and no shadow rays are traced for it.
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename SceneType>
+static Color shadeHit( const Ray &uRay, SurfaceHitRecord &nearestHitRec, const SceneType &scene,
+                       int reflectLevels, bool hasShadow, const bool *lightBlocked = nullptr )
+{
+    // The material is looked up only for the nearest hit.
+    const Material &material = scene.materials[ nearestHitRec.material ];
 
     nearestHitRec.normal.makeUnitVector();
-    Vector3d N = nearestHitRec.normal;  // Unit vector.
-    Vector3d V = -uRay.direction();     // Unit vector.
+    Vector3r N = nearestHitRec.normal;  // Unit vector.
+    Vector3r V = -uRay.direction();     // Unit vector.
 
     Color result( 0.0f, 0.0f, 0.0f );   // The result will be accumulated here.
 
 
 // Add to result the phong lighting contributed by each point light source.
-// Compute for shadow if hasShadow is true.
+// Compute for shadow if hasShadow is true. A compiled scene may light the
+// point by a cut of its light tree instead. The shadow ray of a light is
+// skipped if Shading culls it by its unshadowed lighting.
 
-    for (PointLightSource lightsrc : scene.ptLights) {
-        Vector3d L = (lightsrc.position - nearestHitRec.p).unitVector();
+    bool isLitByCut = false;
+    if constexpr ( std::is_same_v<SceneType, CompiledScene> )
+    {
+        isLitByCut = scene.lightTree().isEnabled();
+        if ( isLitByCut ) result += cutLighting( nearestHitRec.p, N, V, material, scene, hasShadow );
+    }
+
+    int numTraced = 0, numCulled = 0;
+    for (int l = 0; l < (int)scene.ptLights.size() && !isLitByCut; l++) {
+        const PointLightSource &lightsrc = scene.ptLights[l];
+        Vector3r L = (lightsrc.position - nearestHitRec.p).unitVector();
+        Color lighting = Shading::PhongLighting(L, N, V, material, lightsrc);
 
         Color kshadow(1.0, 1.0, 1.0);
 
-        if (hasShadow) {
+        if (hasShadow && lightBlocked != nullptr) {
+            if (lightBlocked[l]) kshadow.setRGB(0.0, 0.0, 0.0);
+        }
+        else if (hasShadow && Shading::IsShadowRayCulled(lighting)) {
+            numCulled++;
+        }
+        else if (hasShadow) {
+            numTraced++;
 
             //initiate Shadow Ray
-            Ray shadowRay(nearestHitRec.p, L);
+            Ray shadowRay(Shading::OffsetRayOrigin(nearestHitRec.p, N, L), L);
+            Real maxT = (lightsrc.position - shadowRay.origin()).length();
 
             //check blockage
-            for (auto& surface : scene.surfaces) {
-                double maxT = (lightsrc.position - nearestHitRec.p).length();
-                if (surface->shadowHit(shadowRay, DEFAULT_TMIN, maxT)) {
-                    kshadow.setRGB(0.0, 0.0, 0.0);
-                    break;
-                }
-            }
+            if (shadowHitScene(shadowRay, maxT, scene)) kshadow.setRGB(0.0, 0.0, 0.0);
         }
-        result += kshadow * computePhongLighting(L, N, V, nearestHitRec.material, lightsrc);
+        result += kshadow * lighting;
     }
+    if (hasShadow && lightBlocked == nullptr && !isLitByCut) Shading::RecordShadowRays(numTraced, numCulled);
 
 // Add to result the global ambient lighting.
 
-    result += scene.amLight.I_a * nearestHitRec.material.k_a;
+    result += scene.amLight.I_a * material.k_a;
 
 // Add to result the reflection of the scene.
 
     if (reflectLevels > 0) {
         //reflect ray from camera for subsequent reflections
-        Vector3d reflectedVector = mirrorReflect(V, N);
-        Ray reflectedRay = Ray(nearestHitRec.p, reflectedVector);
+        Vector3r reflectedVector = Shading::MirrorReflect(V, N);
+        Ray reflectedRay = Ray(Shading::OffsetRayOrigin(nearestHitRec.p, N, reflectedVector), reflectedVector);
 
-        result += nearestHitRec.material.k_rg * TraceRay(reflectedRay, scene, reflectLevels - 1, hasShadow);
+        result += material.k_rg * traceRay(reflectedRay, scene, reflectLevels - 1, hasShadow);
     }
     return result;
 }
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Traces a ray into the scene.
+// reflectLevels: specifies number of levels of reflections (0 for no reflection).
+// hasShadow: specifies whether to generate shadows.
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename SceneType>
+static Color traceRay( const Ray &ray, const SceneType &scene, 
+                       int reflectLevels, bool hasShadow )
+{
+    Ray uRay( ray );
+    uRay.makeUnitDirection();  // Normalize ray direction.
+
+
+// Find whether and where the ray hits some surface.
+// Take the nearest hit point.
+
+    SurfaceHitRecord nearestHitRec;
+    if ( !hitScene( uRay, scene, nearestHitRec ) ) return scene.backgroundColor;
+
+    return shadeHit( uRay, nearestHitRec, scene, reflectLevels, hasShadow );
+}
+
+
+
+Color Raytrace::TraceRay( const Ray &ray, const Scene &scene, 
+                          int reflectLevels, bool hasShadow )
+{
+    return traceRay( ray, scene, reflectLevels, hasShadow );
+}
+
+
+
+Color Raytrace::TraceRay( const Ray &ray, const CompiledScene &scene, 
+                          int reflectLevels, bool hasShadow )
+{
+    return traceRay( ray, scene, reflectLevels, hasShadow );
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Tests the hit points of a packet for shadow from the point light at
+// lightPos, setting blocked[i] for hit i if isTested[i]. The shadow rays are reversed, to
+// start at the light and end at the hit points, so that they share an
+// origin. They are split by octant of direction into coherent packets.
+//////////////////////////////////////////////////////////////////////////////
+
+static void shadowTestPacket( const Vector3r &lightPos, const CompiledScene &scene, int numRays,
+                              const SurfaceHitRecord recs[], const bool isTested[], bool blocked[] )
+{
+    RayPacket packets[8];
+    int rayIndices[8][ RayPacket::MAX_RAYS ];
+    Real tmax[8][ RayPacket::MAX_RAYS ];
+
+    for ( int i = 0; i < numRays; i++ )
+    {
+        blocked[i] = false;
+        if ( !isTested[i] ) continue;
+
+        // The same segment that the forward shadow ray from the offset hit point tests.
+        Vector3r N = recs[i].normal.unitVector();
+        Vector3r L = ( lightPos - recs[i].p ).unitVector();
+        Vector3r dir = Shading::OffsetRayOrigin( recs[i].p, N, L ) - lightPos;
+        Real length = dir.length();
+        if ( !( length > Shading::DEFAULT_TMIN ) ) continue;
+        dir /= length;
+
+        int octant = ( dir.x() < 0 ) | ( dir.y() < 0 ) << 1 | ( dir.z() < 0 ) << 2;
+        RayPacket &packet = packets[ octant ];
+        rayIndices[ octant ][ packet.numRays() ] = i;
+        // The far end is kept as far from the hit point as the near end of the forward ray.
+        tmax[ octant ][ packet.numRays() ] = length * ( 1 - Shading::RAY_OFFSET_ULPS * std::numeric_limits<Real>::epsilon() ) - Shading::DEFAULT_TMIN;
+        packet.addRay( Ray( lightPos, dir ) );
+    }
+
+    for ( int octant = 0; octant < 8; octant++ )
+    {
+        RayPacket &packet = packets[ octant ];
+        if ( packet.numRays() == 0 ) continue;
+        packet.finalize();
+
+        bool occluded[ RayPacket::MAX_RAYS ];
+        scene.shadowHitPacket( packet, 0, tmax[ octant ], occluded );
+        for ( int j = 0; j < packet.numRays(); j++ ) blocked[ rayIndices[ octant ][j] ] = occluded[j];
+    }
+}
+
+
+
+void Raytrace::TracePacket( const RayPacket &packet, const CompiledScene &scene, 
+                            int reflectLevels, bool hasShadow, Color colors[] )
+{
+    int numRays = packet.numRays();
+    SurfaceHitRecord recs[ RayPacket::MAX_RAYS ];
+    bool hasHit[ RayPacket::MAX_RAYS ];
+    scene.hitPacket( packet, Shading::DEFAULT_TMIN, Shading::DEFAULT_TMAX, recs, hasHit );
+
+    // The shadow rays of the primary hits to each light converge on it, so
+    // they are traced together. lightBlocked[ i * numLights + l ] is for hit i and light l.
+    int numLights = (int)scene.ptLights.size();
+    // Lighting by cuts of the light tree traces its own shadow rays.
+    bool hasPacketShadow = hasShadow && !scene.lightTree().isEnabled();
+    // Per-thread scratch, grown to the most lights seen, so that packets do not allocate.
+    static thread_local std::unique_ptr<bool[]> lightBlocked;
+    static thread_local int lightBlockedLights = 0;
+    if ( hasPacketShadow && lightBlockedLights < numLights )
+    {
+        lightBlocked.reset( new bool[ RayPacket::MAX_RAYS * numLights ] );
+        lightBlockedLights = numLights;
+    }
+    if ( hasPacketShadow )
+    {
+        bool isTested[ RayPacket::MAX_RAYS ], blocked[ RayPacket::MAX_RAYS ];
+        int numTraced = 0, numCulled = 0;
+        for ( int l = 0; l < numLights; l++ )
+        {
+            // The hits that Shading culls the shadow ray of are left unblocked.
+            const PointLightSource &lightsrc = scene.ptLights[l];
+            for ( int i = 0; i < numRays; i++ )
+            {
+                isTested[i] = hasHit[i];
+                if ( !hasHit[i] ) continue;
+                Vector3r L = ( lightsrc.position - recs[i].p ).unitVector();
+                Color lighting = Shading::PhongLighting( L, recs[i].normal.unitVector(), -packet.ray( i ).direction(), 
+                                                         scene.materials[ recs[i].material ], lightsrc );
+                isTested[i] = !Shading::IsShadowRayCulled( lighting );
+                numTraced += isTested[i];
+                numCulled += !isTested[i];
+            }
+            shadowTestPacket( lightsrc.position, scene, numRays, recs, isTested, blocked );
+            for ( int i = 0; i < numRays; i++ ) lightBlocked[ i * numLights + l ] = blocked[i];
+        }
+        Shading::RecordShadowRays( numTraced, numCulled );
+    }
+
+    // Reflected rays are incoherent, so they are traced one by one.
+    for ( int i = 0; i < numRays; i++ )
+    {
+        colors[i] = hasHit[i]? shadeHit( packet.ray( i ), recs[i], scene, reflectLevels, hasShadow,
+                                         hasPacketShadow? &lightBlocked[ i * numLights ] : nullptr ) 
+                             : scene.backgroundColor;
+    }
+}
@@ -4,6 +4,8 @@
 #include "Color.h"
 #include "Ray.h"
 #include "Scene.h"
+#include "CompiledScene.h"
+#include "RayPacket.h"
 
 
 class Raytrace
@@ -19,6 +21,19 @@ public:
     static Color TraceRay( const Ray &ray, const Scene &scene, 
                            int reflectLevels, bool hasShadow );
 
+    // The same, against a compiled scene. This is the form used for rendering.
+    static Color TraceRay( const Ray &ray, const CompiledScene &scene, 
+                           int reflectLevels, bool hasShadow );
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Traces the rays of a packet into a compiled scene, as TraceRay()
+    // would one by one, and stores the color of ray i in colors[i]. The
+    // rays must have unit directions.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void TracePacket( const RayPacket &packet, const CompiledScene &scene, 
+                             int reflectLevels, bool hasShadow, Color colors[] );
+
 };
 
 
@@ -0,0 +1,104 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Support for SIMD kernels that are compiled into the program alongside
+// scalar ones and chosen at run time with Util::HasAVX2().
+//
+// HAS_AVX2_KERNELS is defined when compiling for x86, where AVX2 kernels
+// can be built. A function using AVX2 intrinsics must be declared
+// TARGET_AVX2, which lets GCC and Clang compile that function for AVX2
+// without compiling the whole program for it. MSVC compiles AVX2
+// intrinsics anywhere.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Vector3d.h"
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#define HAS_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined( HAS_AVX2_KERNELS ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define TARGET_AVX2
+#endif
+
+
+// Instruction sets that kernels are compiled for.
+enum class ISA
+{
+    Scalar,
+    AVX2
+};
+
+inline const char *ISAName( ISA isa ) { return ( isa == ISA::AVX2 )? "avx2" : "scalar"; }
+
+
+// Number of Real lanes in a 256-bit register: 4 doubles, or 8 floats.
+constexpr int REAL_LANES = 32 / sizeof( Real );
+
+
+
+#ifdef HAS_AVX2_KERNELS
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// The AVX2 operations on REAL_LANES lanes of Real that the batch kernels
+// use, so that one kernel serves both precisions. Comparisons are
+// ordered: a NaN lane compares false.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct RealLanesAVX2
+{
+#ifdef RAYTRACE_FLOAT
+
+    using Type = __m256;
+
+    TARGET_AVX2 static Type Set1( Real a ) { return _mm256_set1_ps( a ); }
+    TARGET_AVX2 static Type Zero() { return _mm256_setzero_ps(); }
+    TARGET_AVX2 static Type Load( const Real *p ) { return _mm256_load_ps( p ); }
+    TARGET_AVX2 static void Store( Real *p, Type a ) { _mm256_store_ps( p, a ); }
+    TARGET_AVX2 static Type Add( Type a, Type b ) { return _mm256_add_ps( a, b ); }
+    TARGET_AVX2 static Type Sub( Type a, Type b ) { return _mm256_sub_ps( a, b ); }
+    TARGET_AVX2 static Type Mul( Type a, Type b ) { return _mm256_mul_ps( a, b ); }
+    TARGET_AVX2 static Type Div( Type a, Type b ) { return _mm256_div_ps( a, b ); }
+    TARGET_AVX2 static Type Sqrt( Type a ) { return _mm256_sqrt_ps( a ); }
+    TARGET_AVX2 static Type And( Type a, Type b ) { return _mm256_and_ps( a, b ); }
+    TARGET_AVX2 static Type GreaterEqual( Type a, Type b ) { return _mm256_cmp_ps( a, b, _CMP_GE_OQ ); }
+    TARGET_AVX2 static Type LessEqual( Type a, Type b ) { return _mm256_cmp_ps( a, b, _CMP_LE_OQ ); }
+    // Lanes of a where mask is set, else of b.
+    TARGET_AVX2 static Type Select( Type mask, Type a, Type b ) { return _mm256_blendv_ps( b, a, mask ); }
+    TARGET_AVX2 static int MoveMask( Type mask ) { return _mm256_movemask_ps( mask ); }
+
+#else
+
+    using Type = __m256d;
+
+    TARGET_AVX2 static Type Set1( Real a ) { return _mm256_set1_pd( a ); }
+    TARGET_AVX2 static Type Zero() { return _mm256_setzero_pd(); }
+    TARGET_AVX2 static Type Load( const Real *p ) { return _mm256_load_pd( p ); }
+    TARGET_AVX2 static void Store( Real *p, Type a ) { _mm256_store_pd( p, a ); }
+    TARGET_AVX2 static Type Add( Type a, Type b ) { return _mm256_add_pd( a, b ); }
+    TARGET_AVX2 static Type Sub( Type a, Type b ) { return _mm256_sub_pd( a, b ); }
+    TARGET_AVX2 static Type Mul( Type a, Type b ) { return _mm256_mul_pd( a, b ); }
+    TARGET_AVX2 static Type Div( Type a, Type b ) { return _mm256_div_pd( a, b ); }
+    TARGET_AVX2 static Type Sqrt( Type a ) { return _mm256_sqrt_pd( a ); }
+    TARGET_AVX2 static Type And( Type a, Type b ) { return _mm256_and_pd( a, b ); }
+    TARGET_AVX2 static Type GreaterEqual( Type a, Type b ) { return _mm256_cmp_pd( a, b, _CMP_GE_OQ ); }
+    TARGET_AVX2 static Type LessEqual( Type a, Type b ) { return _mm256_cmp_pd( a, b, _CMP_LE_OQ ); }
+    // Lanes of a where mask is set, else of b.
+    TARGET_AVX2 static Type Select( Type mask, Type a, Type b ) { return _mm256_blendv_pd( b, a, mask ); }
+    TARGET_AVX2 static int MoveMask( Type mask ) { return _mm256_movemask_pd( mask ); }
+
+#endif
+}; // RealLanesAVX2
+
+#endif // HAS_AVX2_KERNELS
+
+
+#endif // _SIMD_H_
@@ -6,12 +6,15 @@
 #include "Material.h"
 #include "Light.h"
 #include "Surface.h"
+#include "Object.h"
 #include <vector>
 
 
 struct Scene
 {
-    std::vector<Surface*> surfaces;   // Array of surface primitives.
+    std::vector<Surface*> surfaces;   // Array of surface primitives. Render a CompiledScene to accelerate them.
+
+    std::vector<Object*> objects;  // Shared geometry placed by Instance surfaces.
 
     std::vector<Material> materials; // Vector of materials
 
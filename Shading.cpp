@@ -0,0 +1,274 @@
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include "Util.h"
+#include "Shading.h"
+
+using namespace std;
+
+
+
+struct ShadingKernels
+{
+    using PointBatch = Shading::PointBatch;
+    static constexpr int WIDTH = 8;
+
+    // ln( x ) = e * ln( 2 ) + ln( 1 + f ) for x = 2^e ( 1 + f ), with ln( 2 )
+    // split into a part exact in float and a remainder, and ln( 1 + f ) =
+    // f - f^2 / 2 + f^3 P( f ) for f in [ sqrt( 1/2 ) - 1, sqrt( 2 ) - 1 ).
+    static constexpr float LN2_HI = 0.693359375f;
+    static constexpr float LN2_LO = -2.12194440e-4f;
+    static constexpr float SQRT2 = 1.41421356f;
+    static constexpr float LOG_P[] = { 7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f,
+                                       -1.2420140846e-1f, 1.4249322787e-1f, -1.6668057665e-1f,
+                                       2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f };
+
+    // exp( a ) = 2^i exp( r ) for i = round( a / ln( 2 ) ) and r = a - i ln( 2 ),
+    // with exp( r ) = 1 + r + r^2 Q( r ).
+    static constexpr float LOG2E = 1.44269504088896341f;
+    static constexpr float EXP_Q[] = { 1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f,
+                                       4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f };
+    // exp( a ) is taken as 0 below EXP_MIN, about 1.8e-35, so that no
+    // denormals, which are slow to multiply, reach the lighting sums.
+    static constexpr float EXP_MIN = -80.0f;
+    static constexpr float EXP_MAX = 88.37626266f;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // The terms of the lighting by one light of points of one material,
+    // rounded to float, except for the light position. Points far from the
+    // origin would lose the short vector to a near light if rounded first,
+    // so it is taken in Real and only the difference is rounded.
+    //////////////////////////////////////////////////////////////////////////////
+
+    struct Light
+    {
+        Real x, y, z;         // Light position.
+        float I[3];           // I_source.
+        float k_d[3], k_r[3];
+        float n;
+        float powOfZero;      // 0^n.
+
+        Light( const Material &mat, const PointLightSource &ptLight )
+            : x( ptLight.position.x() ), y( ptLight.position.y() ), z( ptLight.position.z() ),
+              I{ ptLight.I_source.r(), ptLight.I_source.g(), ptLight.I_source.b() },
+              k_d{ mat.k_d.r(), mat.k_d.g(), mat.k_d.b() },
+              k_r{ mat.k_r.r(), mat.k_r.g(), mat.k_r.b() },
+              n( mat.n ), powOfZero( ( mat.n == 0.0f )? 1.0f : 0.0f )
+        {}
+    };
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Shading::FastPow() for x > 0, in the same order of operations as the
+    // AVX2 kernel.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static float PowPositive( float x, float n )
+    {
+        x = Util::Max2( x, FLT_MIN );
+        uint32_t bits;
+        memcpy( &bits, &x, sizeof( bits ) );
+        float e = (float)( (int)( bits >> 23 ) - 127 );
+        bits = ( bits & 0x007FFFFFu ) | 0x3F800000u;
+        float m;
+        memcpy( &m, &bits, sizeof( m ) );
+
+        float f = m - 1.0f;
+        if ( m > SQRT2 )
+        {
+            f = m * 0.5f - 1.0f;
+            e = e + 1.0f;
+        }
+        float z = f * f;
+        float p = LOG_P[0];
+        for ( int i = 1; i < 9; i++ ) p = p * f + LOG_P[i];
+        float lnx = ( ( p * f ) * z + e * LN2_LO ) + -0.5f * z;
+        lnx = ( f + lnx ) + e * LN2_HI;
+
+        float a = n * lnx;
+        if ( !( a >= EXP_MIN ) ) return 0.0f;
+        a = Util::Min2( a, EXP_MAX );
+        float i = floorf( a * LOG2E + 0.5f );
+        float r = ( a - i * LN2_HI ) - i * LN2_LO;
+        float q = EXP_Q[0];
+        for ( int j = 1; j < 6; j++ ) q = q * r + EXP_Q[j];
+        float expr = ( q * ( r * r ) + r ) + 1.0f;
+
+        uint32_t scaleBits = (uint32_t)( (int)i + 127 ) << 23;
+        float scale;
+        memcpy( &scale, &scaleBits, sizeof( scale ) );
+        return expr * scale;
+    }
+
+
+    // Shading::PhongLighting() of point k of the batch, in float.
+    static Color PhongLightingLane( const PointBatch &points, int k, const Light &light )
+    {
+        auto lx = (float)( light.x - points.px[k] );
+        auto ly = (float)( light.y - points.py[k] );
+        auto lz = (float)( light.z - points.pz[k] );
+        float length = sqrtf( ( lx * lx + ly * ly ) + lz * lz );
+        lx = lx / length; ly = ly / length; lz = lz / length;
+
+        float nx = (float)points.nx[k], ny = (float)points.ny[k], nz = (float)points.nz[k];
+        float N_dot_L = ( nx * lx + ny * ly ) + nz * lz;
+        float twoN_dot_L = 2.0f * N_dot_L;
+        float rx = twoN_dot_L * nx - lx, ry = twoN_dot_L * ny - ly, rz = twoN_dot_L * nz - lz;
+        float R_dot_V = ( rx * (float)points.vx[k] + ry * (float)points.vy[k] ) + rz * (float)points.vz[k];
+
+        // As _mm256_max_ps( x, 0 ), which also turns NaN into 0.
+        N_dot_L = ( N_dot_L > 0.0f )? N_dot_L : 0.0f;
+        R_dot_V = ( R_dot_V > 0.0f )? R_dot_V : 0.0f;
+        float R_dot_V_pow_n = ( R_dot_V > 0.0f )? PowPositive( R_dot_V, light.n ) : light.powOfZero;
+
+        float c[3];
+        for ( int ch = 0; ch < 3; ch++ ) c[ch] = light.I[ch] * ( light.k_d[ch] * N_dot_L + light.k_r[ch] * R_dot_V_pow_n );
+        return { c[0], c[1], c[2] };
+    }
+
+
+    static void PhongLightingBatchScalar( const PointBatch &points, int begin, int end,
+                                          const Material &mat, const PointLightSource &ptLight, Color out[] )
+    {
+        Light light( mat, ptLight );
+        for ( int k = begin; k < end; k++ ) out[k] = PhongLightingLane( points, k, light );
+    }
+
+
+#ifdef HAS_AVX2_KERNELS
+
+    // Loads 8 coordinates as floats.
+    TARGET_AVX2 static __m256 Load( const float *p ) { return _mm256_loadu_ps( p ); }
+
+    TARGET_AVX2 static __m256 Load( const double *p )
+    {
+        return _mm256_set_m128( _mm256_cvtpd_ps( _mm256_loadu_pd( p + 4 ) ), _mm256_cvtpd_ps( _mm256_loadu_pd( p ) ) );
+    }
+
+    // Loads c - p[i] for 8 coordinates, subtracted in their precision and rounded to float.
+    TARGET_AVX2 static __m256 LoadDifference( float c, const float *p ) { return _mm256_sub_ps( _mm256_set1_ps( c ), Load( p ) ); }
+
+    TARGET_AVX2 static __m256 LoadDifference( double c, const double *p )
+    {
+        __m256d c4 = _mm256_set1_pd( c );
+        return _mm256_set_m128( _mm256_cvtpd_ps( _mm256_sub_pd( c4, _mm256_loadu_pd( p + 4 ) ) ),
+                                _mm256_cvtpd_ps( _mm256_sub_pd( c4, _mm256_loadu_pd( p ) ) ) );
+    }
+
+
+    TARGET_AVX2 static __m256 PowPositiveAVX2( __m256 x, __m256 n )
+    {
+        x = _mm256_max_ps( x, _mm256_set1_ps( FLT_MIN ) );
+        __m256i bits = _mm256_castps_si256( x );
+        __m256 e = _mm256_cvtepi32_ps( _mm256_sub_epi32( _mm256_srli_epi32( bits, 23 ), _mm256_set1_epi32( 127 ) ) );
+        bits = _mm256_or_si256( _mm256_and_si256( bits, _mm256_set1_epi32( 0x007FFFFF ) ), _mm256_set1_epi32( 0x3F800000 ) );
+        __m256 m = _mm256_castsi256_ps( bits );
+
+        __m256 one = _mm256_set1_ps( 1.0f );
+        __m256 isHigh = _mm256_cmp_ps( m, _mm256_set1_ps( SQRT2 ), _CMP_GT_OQ );
+        __m256 f = _mm256_blendv_ps( _mm256_sub_ps( m, one ),
+                                     _mm256_sub_ps( _mm256_mul_ps( m, _mm256_set1_ps( 0.5f ) ), one ), isHigh );
+        e = _mm256_blendv_ps( e, _mm256_add_ps( e, one ), isHigh );
+        __m256 z = _mm256_mul_ps( f, f );
+        __m256 p = _mm256_set1_ps( LOG_P[0] );
+        for ( int i = 1; i < 9; i++ ) p = _mm256_add_ps( _mm256_mul_ps( p, f ), _mm256_set1_ps( LOG_P[i] ) );
+        __m256 lnx = _mm256_add_ps( _mm256_mul_ps( _mm256_mul_ps( p, f ), z ), _mm256_mul_ps( e, _mm256_set1_ps( LN2_LO ) ) );
+        lnx = _mm256_add_ps( lnx, _mm256_mul_ps( _mm256_set1_ps( -0.5f ), z ) );
+        lnx = _mm256_add_ps( _mm256_add_ps( f, lnx ), _mm256_mul_ps( e, _mm256_set1_ps( LN2_HI ) ) );
+
+        __m256 a = _mm256_mul_ps( n, lnx );
+        __m256 isAboveMin = _mm256_cmp_ps( a, _mm256_set1_ps( EXP_MIN ), _CMP_GE_OQ );
+        a = _mm256_min_ps( _mm256_max_ps( a, _mm256_set1_ps( EXP_MIN ) ), _mm256_set1_ps( EXP_MAX ) );
+        __m256 i = _mm256_floor_ps( _mm256_add_ps( _mm256_mul_ps( a, _mm256_set1_ps( LOG2E ) ), _mm256_set1_ps( 0.5f ) ) );
+        __m256 r = _mm256_sub_ps( _mm256_sub_ps( a, _mm256_mul_ps( i, _mm256_set1_ps( LN2_HI ) ) ),
+                                  _mm256_mul_ps( i, _mm256_set1_ps( LN2_LO ) ) );
+        __m256 q = _mm256_set1_ps( EXP_Q[0] );
+        for ( int j = 1; j < 6; j++ ) q = _mm256_add_ps( _mm256_mul_ps( q, r ), _mm256_set1_ps( EXP_Q[j] ) );
+        __m256 expr = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( q, _mm256_mul_ps( r, r ) ), r ), one );
+
+        __m256i scaleBits = _mm256_slli_epi32( _mm256_add_epi32( _mm256_cvtps_epi32( i ), _mm256_set1_epi32( 127 ) ), 23 );
+        return _mm256_and_ps( _mm256_mul_ps( expr, _mm256_castsi256_ps( scaleBits ) ), isAboveMin );
+    }
+
+
+    TARGET_AVX2 static void PhongLightingBatchAVX2( const PointBatch &points, int begin, int end,
+                                                    const Material &mat, const PointLightSource &ptLight, Color out[] )
+    {
+        Light light( mat, ptLight );
+        __m256 zero = _mm256_setzero_ps();
+        __m256 two = _mm256_set1_ps( 2.0f );
+
+        int k = begin;
+        for ( ; k + WIDTH <= end; k += WIDTH )
+        {
+            __m256 lx = LoadDifference( light.x, points.px + k );
+            __m256 ly = LoadDifference( light.y, points.py + k );
+            __m256 lz = LoadDifference( light.z, points.pz + k );
+            __m256 length = _mm256_sqrt_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( lx, lx ), _mm256_mul_ps( ly, ly ) ),
+                                                           _mm256_mul_ps( lz, lz ) ) );
+            lx = _mm256_div_ps( lx, length ); ly = _mm256_div_ps( ly, length ); lz = _mm256_div_ps( lz, length );
+
+            __m256 nx = Load( points.nx + k ), ny = Load( points.ny + k ), nz = Load( points.nz + k );
+            __m256 N_dot_L = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( nx, lx ), _mm256_mul_ps( ny, ly ) ), _mm256_mul_ps( nz, lz ) );
+            __m256 twoN_dot_L = _mm256_mul_ps( two, N_dot_L );
+            __m256 rx = _mm256_sub_ps( _mm256_mul_ps( twoN_dot_L, nx ), lx );
+            __m256 ry = _mm256_sub_ps( _mm256_mul_ps( twoN_dot_L, ny ), ly );
+            __m256 rz = _mm256_sub_ps( _mm256_mul_ps( twoN_dot_L, nz ), lz );
+            __m256 R_dot_V = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( rx, Load( points.vx + k ) ), _mm256_mul_ps( ry, Load( points.vy + k ) ) ),
+                                            _mm256_mul_ps( rz, Load( points.vz + k ) ) );
+
+            N_dot_L = _mm256_max_ps( N_dot_L, zero );
+            R_dot_V = _mm256_max_ps( R_dot_V, zero );
+            __m256 R_dot_V_pow_n = _mm256_blendv_ps( _mm256_set1_ps( light.powOfZero ),
+                                                     PowPositiveAVX2( R_dot_V, _mm256_set1_ps( light.n ) ),
+                                                     _mm256_cmp_ps( R_dot_V, zero, _CMP_GT_OQ ) );
+
+            alignas( 32 ) float c[3][ WIDTH ];
+            for ( int ch = 0; ch < 3; ch++ )
+            {
+                __m256 sum = _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( light.k_d[ch] ), N_dot_L ),
+                                            _mm256_mul_ps( _mm256_set1_ps( light.k_r[ch] ), R_dot_V_pow_n ) );
+                _mm256_store_ps( c[ch], _mm256_mul_ps( _mm256_set1_ps( light.I[ch] ), sum ) );
+            }
+            for ( int lane = 0; lane < WIDTH; lane++ ) out[ k + lane ] = Color( c[0][lane], c[1][lane], c[2][lane] );
+        }
+
+        for ( ; k < end; k++ ) out[k] = PhongLightingLane( points, k, light );
+    }
+
+#endif // HAS_AVX2_KERNELS
+
+
+    static Shading::Kernels Select( ISA isa )
+    {
+#ifdef HAS_AVX2_KERNELS
+        if ( isa == ISA::AVX2 && Util::HasAVX2() ) return { isa, PhongLightingBatchAVX2 };
+#endif
+        return { ISA::Scalar, PhongLightingBatchScalar };
+    }
+
+}; // ShadingKernels
+
+
+
+Shading::Kernels Shading::sKernels = ShadingKernels::Select( ISA::AVX2 );
+
+float Shading::sShadowCullThreshold = 0.0f;
+bool Shading::sCollectShadowStats = false;
+atomic<unsigned long long> Shading::sShadowRaysTraced{ 0 }, Shading::sShadowRaysCulled{ 0 };
+
+
+
+float Shading::FastPow( float x, float n )
+{
+    return ( x > 0.0f )? ShadingKernels::PowPositive( x, n ) : ( ( n == 0.0f )? 1.0f : 0.0f );
+}
+
+
+
+void Shading::setISA( ISA isa )
+{
+    sKernels = ShadingKernels::Select( isa );
+}
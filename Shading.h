@@ -0,0 +1,208 @@
+#ifndef _SHADING_H_
+#define _SHADING_H_
+
+#include <cmath>
+#include <atomic>
+#include <limits>
+#include "Util.h"
+#include "Vector3d.h"
+#include "Color.h"
+#include "Material.h"
+#include "Light.h"
+#include "SIMD.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// The ray parameters and the lighting model shared by the renderers: the
+// recursive tracer in Raytrace and the breadth-first one in Wavefront.
+//
+// PhongLighting() shades one point, and is the reference. The batch kernel
+// shades many points of one material at once, in float with FastPow(),
+// 8 points per AVX2 instruction if the CPU supports it, or else one at a
+// time in the same order of operations, so both give the same results.
+//
+// The renderers ask IsShadowRayCulled() before tracing each shadow ray, so
+// that lights that could not visibly change the color are not tested.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class Shading
+{
+public:
+
+    // This is for avoiding the "epsilon problem" or the shadow acne problem.
+    static constexpr Real DEFAULT_TMIN = Real( 10e-6 );
+
+    // Secondary ray origins are moved off the surface by this many units in
+    // the last place of the largest hit point coordinate.
+    static constexpr Real RAY_OFFSET_ULPS = 32;
+
+    // Use this for tmax for non-shadow ray intersection test.
+    static constexpr Real DEFAULT_TMAX = std::numeric_limits<Real>::max();
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Compute the outgoing mirror reflection vector.
+    // Input incoming vector L is pointing AWAY from surface point.
+    // Assume normal vector N is unit vector.
+    // The output reflection vector is pointing AWAY from surface point, and
+    // has same length as incoming vector L.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static Vector3r MirrorReflect( const Vector3r &L, const Vector3r &N )
+    {
+        return ( 2 * dot( N, L ) ) * N - L;
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Moves a hit point p off its surface, along the unit normal N to the side
+    // that the direction dir leaves toward. The rounding error of p grows
+    // with its coordinates and with the precision of Real, which a fixed tmin
+    // alone does not cover in float builds. In both precisions it also keeps
+    // a ray that leaves into a sphere from finding its own start point as a
+    // root near 0, which below tmin would hide the sphere behind it. The
+    // reversed shadow rays of Raytrace::TracePacket rely on that.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static Vector3r OffsetRayOrigin( const Vector3r &p, const Vector3r &N, const Vector3r &dir )
+    {
+        Real maxCoord = Util::Max3( std::abs( p.x() ), std::abs( p.y() ), std::abs( p.z() ) );
+        Real offset = RAY_OFFSET_ULPS * std::numeric_limits<Real>::epsilon() * Util::Max2( maxCoord, Real( 1 ) );
+        return ( dot( N, dir ) >= 0 )? p + offset * N : p - offset * N;
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Compute I_source * [ k_d * (N.L) + k_r * (R.V)^n ].
+    // Input vectors L, N and V are pointing AWAY from surface point.
+    // Assume all vector L, N and V are unit vectors.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static Color PhongLighting( const Vector3r &L, const Vector3r &N, const Vector3r &V,
+                                const Material &mat, const PointLightSource &ptLight )
+    {
+        Vector3r R = MirrorReflect(L, N);
+
+        auto N_dot_L = (float)dot(N, L);
+        if (N_dot_L < 0.0f) N_dot_L = 0.0f;
+
+        auto R_dot_V = (float)dot(R, V);
+        if (R_dot_V < 0.0f) R_dot_V = 0.0f;
+        float R_dot_V_pow_n = powf(R_dot_V, (float)mat.n);
+
+        return ptLight.I_source * (mat.k_d * N_dot_L + mat.k_r * R_dot_V_pow_n);
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Hit points in structure-of-arrays layout, with their unit normals and
+    // the unit vectors from them toward the viewer, to be shaded together.
+    //////////////////////////////////////////////////////////////////////////////
+
+    struct PointBatch
+    {
+        const Real *px, *py, *pz;
+        const Real *nx, *ny, *nz;
+        const Real *vx, *vy, *vz;
+    };
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Computes PhongLighting() by ptLight of the points [begin, end) of the
+    // batch, which all have the material mat, into out[begin .. end-1]. The
+    // results differ from PhongLighting() by the rounding of float and the
+    // error of FastPow().
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void PhongLightingBatch( const PointBatch &points, int begin, int end,
+                                    const Material &mat, const PointLightSource &ptLight, Color out[] )
+    {
+        sKernels.phongLightingBatch( points, begin, end, mat, ptLight, out );
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // x^n for x >= 0 and n >= 0, from polynomial approximations of ln and
+    // exp that also run in SIMD lanes. The relative error is below 1e-5 for
+    // n <= 128 wherever x^n is above 1e-30. Results below about 1e-35 are
+    // returned as 0.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static float FastPow( float x, float n );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Shadow ray culling. The shadow ray of a light is not traced when the
+    // unshadowed lighting by it, from PhongLighting() or a batch kernel, has
+    // no channel above the cull threshold, since the shadow could change
+    // the color by at most that much. The light then counts as unoccluded.
+    // The default threshold of 0 culls only the lights that give nothing,
+    // such as those behind the surface and away from its mirror direction,
+    // so the images are unchanged. A negative threshold traces every
+    // shadow ray. The threshold applies per light, so with many dim lights
+    // their errors add up.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void setShadowCullThreshold( float threshold ) { sShadowCullThreshold = threshold; }
+
+    [[nodiscard]] static float shadowCullThreshold() { return sShadowCullThreshold; }
+
+    [[nodiscard]] static bool IsShadowRayCulled( const Color &lighting )
+    {
+        return Util::Max3( lighting.r(), lighting.g(), lighting.b() ) <= sShadowCullThreshold;
+    }
+
+
+    struct ShadowStats
+    {
+        unsigned long long traced{};
+        unsigned long long culled{};
+    };
+
+    [[nodiscard]] static ShadowStats shadowStats() { return { sShadowRaysTraced.load(), sShadowRaysCulled.load() }; }
+
+    static void resetShadowStats() { sShadowRaysTraced = 0; sShadowRaysCulled = 0; }
+
+    // The shadow ray counters cost two atomic adds per shading, so they are off by default.
+    static void setCollectShadowStats( bool collect ) { sCollectShadowStats = collect; }
+
+    // Adds to the shadow ray counters, if they are collected.
+    static void RecordShadowRays( unsigned long long traced, unsigned long long culled )
+    {
+        if ( !sCollectShadowStats ) return;
+        sShadowRaysTraced.fetch_add( traced, std::memory_order_relaxed );
+        sShadowRaysCulled.fetch_add( culled, std::memory_order_relaxed );
+    }
+
+
+    // The instruction set of the kernels in use.
+    static ISA isa() { return sKernels.isa; }
+
+    // Selects the kernels for isa, or the scalar kernels if the CPU does not
+    // support it. For comparing kernels; by default the widest is used.
+    static void setISA( ISA isa );
+
+
+private:
+
+    struct Kernels
+    {
+        ISA isa;
+        void (*phongLightingBatch)( const PointBatch &points, int begin, int end,
+                                    const Material &mat, const PointLightSource &ptLight, Color out[] );
+    };
+
+    static Kernels sKernels;
+
+    static float sShadowCullThreshold;
+    static bool sCollectShadowStats;
+    static std::atomic<unsigned long long> sShadowRaysTraced, sShadowRaysCulled;
+
+    friend struct ShadingKernels;
+
+}; // Shading
+
+
+#endif // _SHADING_H_
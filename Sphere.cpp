@@ -12,54 +12,59 @@ using namespace std;
 
 
 
-bool Sphere::hit( const Ray &r, double tmin, double tmax, SurfaceHitRecord &rec ) const 
+bool Sphere::hit( const Ray &r, Real tmin, Real tmax, SurfaceHit &hit ) const 
+{
+    Real t = nearestRoot( center, radius, r );
+    if (!(t >= tmin && t <= tmax)) return false;
+
+    hit.set( t, this );
+    return true;
+}
+
+
+
+void Sphere::hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const
+{
+    rec.p = r.pointAtParam(hit.t);
+    rec.normal = (rec.p - center).unitVector();
+    rec.material = material;
+}
+
+
+
+bool Sphere::shadowHit( const Ray &r, Real tmin, Real tmax ) const 
+{
+    Real t = nearestRoot( center, radius, r );
+    return (t >= 0 && t >= tmin && t <= tmax);
+}
+
+
+
+Real Sphere::nearestRoot( const Vector3r &center, Real radius, const Ray &r )
 {
     // Get vector origin with reference from sphere centre as origin
-    Vector3d origin = r.origin() - center;
+    Vector3r origin = r.origin() - center;
 
-    // Form Quadratic equation and solve for t
-    double a = dot(r.direction(), r.direction());
-    double b = 2 * dot(r.direction(), origin);
-    double c = dot(origin, origin) - radius * radius;
+    // Form Quadratic equation a t^2 + 2 b t + c = 0 and solve for t
+    Real a = dot(r.direction(), r.direction());
+    Real b = dot(r.direction(), origin);
+    Real c = dot(origin, origin) - radius * radius;
 
     // Find discriminant to determine if the ray hit
-    double d = b * b - 4 * a * c;
-    if (d < 0) return false;
+    Real d = b * b - a * c;
+    if (d < 0) return NAN;
 
     // 2 solutions for t. Find the t that is positive and closest
-    double t;
-    double t1 = (-b - sqrt(d)) / (2 * a);
-    double t2 = (-b + sqrt(d)) / (2 * a);
-    if (t1 >= 0) t = t1;
-    else t = t2;
-    if (t < tmin || t > tmax) return false;
-
-    rec.t = t;
-    rec.p = r.pointAtParam(t);
-    rec.normal = (r.pointAtParam(t) - center).unitVector();
-    rec.material = material;
-
-    return true;
+    Real sqrtD = sqrt(d);
+    Real t1 = (-b - sqrtD) / a;
+    if (t1 >= 0) return t1;
+    return (-b + sqrtD) / a;
 }
 
 
 
-bool Sphere::shadowHit( const Ray &r, double tmin, double tmax ) const 
+BoundingBox Sphere::boundingBox() const
 {
-    Vector3d origin = r.origin() - center;
-
-    double a = dot(r.direction(), r.direction());
-    double b = 2 * dot(r.direction(), origin);
-    double c = dot(origin, origin) - radius * radius;
-
-    double d = b * b - 4 * a * c;
-    if (d < 0) return false;
-
-    double t;
-    double t1 = (-b - sqrt(d)) / (2 * a);
-    double t2 = (-b + sqrt(d)) / (2 * a);
-    if (t1 >= 0) t = t1;
-    else t = t2;
-    if (t < 0) return false;
-    return (t >= tmin && t <= tmax);
+    Vector3r r( radius, radius, radius );
+    return { center - r, center + r };
 }
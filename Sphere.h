@@ -8,28 +8,39 @@ class Sphere : public Surface
 {
 public:
 
-    Vector3d center;
-    double radius;
+    Vector3r center;
+    Real radius;
 
 
-    Sphere( const Vector3d &theCenter, double theRadius, const Material &theMaterial)
+    Sphere( const Vector3r &theCenter, Real theRadius, int theMaterial)
         { center = theCenter;  radius = theRadius;  material = theMaterial; }
 
 
     bool hit(
                     const Ray &r, // Ray being sent.
-                    double tmin,  // Minimum hit parameter to be searched for.
-                    double tmax,  // Maximum hit parameter to be searched for.
-                    SurfaceHitRecord &rec 
+                    Real tmin,  // Minimum hit parameter to be searched for.
+                    Real tmax,  // Maximum hit parameter to be searched for.
+                    SurfaceHit &hit
                     ) const override;
 
 
     [[nodiscard]] bool shadowHit(
                     const Ray &r, // Ray being sent.
-                    double tmin,  // Minimum hit parameter to be searched for.
-                    double tmax   // Maximum hit parameter to be searched for.
+                    Real tmin,  // Minimum hit parameter to be searched for.
+                    Real tmax   // Maximum hit parameter to be searched for.
                     ) const override;
 
+
+    void hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const override;
+
+
+    [[nodiscard]] BoundingBox boundingBox() const override;
+
+
+    // The nearer root of the ray-sphere equation that is not negative, the
+    // farther root if both are negative, or NaN if the ray misses.
+    [[nodiscard]] static Real nearestRoot( const Vector3r &center, Real radius, const Ray &r );
+
 };
 
 #endif // _SPHERE_H_
@@ -0,0 +1,166 @@
+#include <cmath>
+#include "Util.h"
+#include "SphereBatch.h"
+
+using namespace std;
+
+
+
+void SphereBatch::set( int lane, const Vector3r &center_, Real radius )
+{
+    for ( int axis = 0; axis < 3; axis++ ) center[axis][lane] = center_[axis];
+    radiusSqr[lane] = radius * radius;
+}
+
+
+
+struct SphereBatchKernels
+{
+    using Batch = SphereBatch;
+    static constexpr int WIDTH = SphereBatch::WIDTH;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Sphere::hit() on one lane, in the same order of operations as the
+    // AVX2 kernel. Returns t, or NaN if the lane is missed.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static Real HitLane( const Batch &s, int k, const Vector3r &o, const Vector3r &d, Real a, 
+                         Real tmin, Real tmax )
+    {
+        Real ox = o.x() - s.center[0][k], oy = o.y() - s.center[1][k], oz = o.z() - s.center[2][k];
+        Real b = d.x() * ox + d.y() * oy + d.z() * oz;
+        Real c = ( ox * ox + oy * oy + oz * oz ) - s.radiusSqr[k];
+        Real disc = b * b - a * c;
+        if ( !( disc >= 0 ) ) return NAN;
+
+        Real sqrtDisc = sqrt( disc );
+        Real t1 = ( -b - sqrtDisc ) / a;
+        Real t = ( t1 >= 0 )? t1 : ( -b + sqrtDisc ) / a;
+        return ( t >= tmin && t <= tmax )? t : Real( NAN );
+    }
+
+
+    static int HitScalar( const Batch &s, const Ray &r, Real tmin, Real &tmax )
+    {
+        Vector3r o = r.origin(), d = r.direction();
+        Real a = dot( d, d );
+        int hitLane = -1;
+        for ( int k = 0; k < WIDTH; k++ )
+        {
+            Real t = HitLane( s, k, o, d, a, tmin, tmax );
+            if ( !isnan( t ) )
+            {
+                tmax = t;
+                hitLane = k;
+            }
+        }
+        return hitLane;
+    }
+
+
+    static bool OccludedScalar( const Batch &s, const Ray &r, Real tmin, Real tmax )
+    {
+        // Like Sphere::shadowHit(), only roots at t >= 0 block.
+        Vector3r o = r.origin(), d = r.direction();
+        Real a = dot( d, d );
+        for ( int k = 0; k < WIDTH; k++ )
+        {
+            if ( !isnan( HitLane( s, k, o, d, a, Util::Max2( tmin, Real( 0 ) ), tmax ) ) ) return true;
+        }
+        return false;
+    }
+
+
+#ifdef HAS_AVX2_KERNELS
+
+    using V = RealLanesAVX2;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Intersects all lanes. Returns the mask of lanes hit in [tmin, tmax],
+    // with their t.
+    //////////////////////////////////////////////////////////////////////////////
+
+    TARGET_AVX2 static V::Type HitLanesAVX2( const Batch &s, const Ray &r, Real tmin, Real tmax, V::Type &t )
+    {
+        Vector3r origin = r.origin(), dir = r.direction();
+        V::Type dx = V::Set1( dir.x() ), dy = V::Set1( dir.y() ), dz = V::Set1( dir.z() );
+        V::Type a = V::Set1( dot( dir, dir ) );
+
+        V::Type ox = V::Sub( V::Set1( origin.x() ), V::Load( s.center[0] ) );
+        V::Type oy = V::Sub( V::Set1( origin.y() ), V::Load( s.center[1] ) );
+        V::Type oz = V::Sub( V::Set1( origin.z() ), V::Load( s.center[2] ) );
+        V::Type b = V::Add( V::Add( V::Mul( dx, ox ), V::Mul( dy, oy ) ), V::Mul( dz, oz ) );
+        V::Type c = V::Sub( V::Add( V::Add( V::Mul( ox, ox ), V::Mul( oy, oy ) ), V::Mul( oz, oz ) ),
+                            V::Load( s.radiusSqr ) );
+        V::Type disc = V::Sub( V::Mul( b, b ), V::Mul( a, c ) );
+
+        // Ordered comparisons, so that NaN lanes (empty spheres) miss. The
+        // square root of a negative discriminant is NaN and masked out.
+        V::Type zero = V::Zero();
+        V::Type mask = V::GreaterEqual( disc, zero );
+        V::Type sqrtDisc = V::Sqrt( disc );
+        V::Type negB = V::Sub( zero, b );
+        V::Type t1 = V::Div( V::Sub( negB, sqrtDisc ), a );
+        V::Type t2 = V::Div( V::Add( negB, sqrtDisc ), a );
+        t = V::Select( V::GreaterEqual( t1, zero ), t1, t2 );
+
+        mask = V::And( mask, V::GreaterEqual( t, V::Set1( tmin ) ) );
+        mask = V::And( mask, V::LessEqual( t, V::Set1( tmax ) ) );
+        return mask;
+    }
+
+
+    TARGET_AVX2 static int HitAVX2( const Batch &s, const Ray &r, Real tmin, Real &tmax )
+    {
+        V::Type t;
+        int hitMask = V::MoveMask( HitLanesAVX2( s, r, tmin, tmax, t ) );
+        if ( hitMask == 0 ) return -1;
+
+        // Horizontal minimum of t over the lanes hit. On equal t the
+        // last lane wins, as in the scalar kernel.
+        alignas( 32 ) Real ts[ WIDTH ];
+        V::Store( ts, t );
+        int hitLane = -1;
+        for ( int k = 0; k < WIDTH; k++ )
+        {
+            if ( ( hitMask & ( 1 << k ) ) && ts[k] <= tmax )
+            {
+                tmax = ts[k];
+                hitLane = k;
+            }
+        }
+        return hitLane;
+    }
+
+
+    TARGET_AVX2 static bool OccludedAVX2( const Batch &s, const Ray &r, Real tmin, Real tmax )
+    {
+        V::Type t;
+        return V::MoveMask( HitLanesAVX2( s, r, Util::Max2( tmin, Real( 0 ) ), tmax, t ) ) != 0;
+    }
+
+#endif // HAS_AVX2_KERNELS
+
+
+    static SphereBatch::Kernels Select( ISA isa )
+    {
+#ifdef HAS_AVX2_KERNELS
+        if ( isa == ISA::AVX2 && Util::HasAVX2() ) return { isa, HitAVX2, OccludedAVX2 };
+#endif
+        return { ISA::Scalar, HitScalar, OccludedScalar };
+    }
+
+}; // SphereBatchKernels
+
+
+
+SphereBatch::Kernels SphereBatch::sKernels = SphereBatchKernels::Select( ISA::AVX2 );
+
+
+
+void SphereBatch::setISA( ISA isa )
+{
+    sKernels = SphereBatchKernels::Select( isa );
+}
@@ -0,0 +1,77 @@
+#ifndef _SPHEREBATCH_H_
+#define _SPHEREBATCH_H_
+
+#include <cmath>
+#include <algorithm>
+#include "Vector3d.h"
+#include "Ray.h"
+#include "SIMD.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Up to WIDTH spheres stored as a structure of arrays (center and squared
+// radius, one lane per sphere), so that one ray can be intersected with
+// all of them at once in SIMD lanes. The lanes are Real, so a batch holds
+// 4 spheres in double and 8 in float.
+//
+// The kernel is chosen at run time: AVX2 if the CPU supports it, else a
+// scalar loop over the lanes. Both give the same results as Sphere::hit().
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class SphereBatch
+{
+public:
+
+    static constexpr int WIDTH = REAL_LANES;
+
+
+    SphereBatch() { std::fill( radiusSqr, radiusSqr + WIDTH, Real( NAN ) ); }
+
+    // Lanes that are not set hold an empty sphere, which is never hit.
+    void set( int lane, const Vector3r &center, Real radius );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Finds the nearest sphere hit in [tmin, tmax]. On a hit, shrinks tmax
+    // to its parameter and returns its lane. Returns -1 if no sphere is hit.
+    //////////////////////////////////////////////////////////////////////////////
+
+    int hit( const Ray &r, Real tmin, Real &tmax ) const { return sKernels.hit( *this, r, tmin, tmax ); }
+
+    // Is any sphere hit in [tmin, tmax]?
+    [[nodiscard]] bool occluded( const Ray &r, Real tmin, Real tmax ) const
+        { return sKernels.occluded( *this, r, tmin, tmax ); }
+
+
+    // The instruction set of the kernels in use.
+    static ISA isa() { return sKernels.isa; }
+
+    // Selects the kernels for isa, or the scalar kernels if the CPU does not
+    // support it. For comparing kernels; by default the widest is used.
+    static void setISA( ISA isa );
+
+
+private:
+
+    struct Kernels
+    {
+        ISA isa;
+        int (*hit)( const SphereBatch &batch, const Ray &r, Real tmin, Real &tmax );
+        bool (*occluded)( const SphereBatch &batch, const Ray &r, Real tmin, Real tmax );
+    };
+
+    static Kernels sKernels;
+
+    // The kernels need the layout, so they are defined in SphereBatch.cpp.
+    friend struct SphereBatchKernels;
+
+    // Coordinates [axis][lane]. Empty lanes have a NaN squared radius.
+    alignas( 32 ) Real center[3][ WIDTH ] = {};
+    alignas( 32 ) Real radiusSqr[ WIDTH ];
+
+}; // SphereBatch
+
+
+#endif // _SPHEREBATCH_H_
@@ -0,0 +1,116 @@
+#include "SphereSet.h"
+
+using namespace std;
+
+
+
+SphereSet::SphereSet( vector<Vector3r> theCenters, vector<Real> theRadii, int theMaterial, 
+                      BVH::BuildMethod method )
+    : mCenters( move( theCenters ) ), mRadii( move( theRadii ) )
+{
+    material = theMaterial;
+    build( method );
+}
+
+
+
+void SphereSet::build( BVH::BuildMethod method )
+{
+    int numSpheres = (int)mCenters.size();
+    vector<BoundingBox> sphereBounds( numSpheres );
+    for ( int i = 0; i < numSpheres; i++ )
+    {
+        Vector3r r( mRadii[i], mRadii[i], mRadii[i] );
+        sphereBounds[i] = BoundingBox( mCenters[i] - r, mCenters[i] + r );
+    }
+    mBVH.setLeafBatchWidth( SphereBatch::WIDTH );
+    mBVH.build( sphereBounds, method );
+
+    // Store the spheres in BVH leaf order.
+    const vector<int> &order = mBVH.primIndices();
+    vector<Vector3r> centers( numSpheres );
+    vector<Real> radii( numSpheres );
+    for ( int i = 0; i < numSpheres; i++ )
+    {
+        centers[i] = mCenters[ order[i] ];
+        radii[i] = mRadii[ order[i] ];
+    }
+    mCenters.swap( centers );
+    mRadii.swap( radii );
+    mBVH.renumberPrimitives();
+
+    // Pack the spheres of each leaf into batches.
+    mBatches.clear();
+    mLeafBatch.assign( numSpheres, -1 );
+    for ( const BVH::Node &node : mBVH.nodes() )
+    {
+        if ( node.count == 0 ) continue;
+        mLeafBatch[ node.first ] = (int)mBatches.size();
+        for ( int i = 0; i < node.count; i++ )
+        {
+            if ( i % SphereBatch::WIDTH == 0 ) mBatches.emplace_back();
+            mBatches.back().set( i % SphereBatch::WIDTH, mCenters[ node.first + i ], mRadii[ node.first + i ] );
+        }
+    }
+}
+
+
+
+size_t SphereSet::memoryBytes() const
+{
+    return mCenters.capacity() * sizeof( Vector3r ) + mRadii.capacity() * sizeof( Real )
+         + mBatches.capacity() * sizeof( SphereBatch ) + mLeafBatch.capacity() * sizeof( int )
+         + mBVH.nodes().capacity() * sizeof( BVH::Node ) + mBVH.primIndices().capacity() * sizeof( int );
+}
+
+
+
+bool SphereSet::hit( const Ray &r, Real tmin, Real tmax, SurfaceHit &hit ) const 
+{
+    int hitSphere = -1;
+
+    mBVH.hitLeaves( r, tmin, tmax,
+        [&]( int first, int count, Real &nearest_t )
+        {
+            bool hasHit = false;
+            const SphereBatch *batch = &mBatches[ mLeafBatch[ first ] ];
+            for ( int i = 0; i < count; i += SphereBatch::WIDTH, batch++ )
+            {
+                int lane = batch->hit( r, tmin, nearest_t );
+                if ( lane < 0 ) continue;
+                hitSphere = first + i + lane;
+                hasHit = true;
+            }
+            return hasHit;
+        } );
+
+    if ( hitSphere < 0 ) return false;
+
+    hit.set( tmax, this, hitSphere );
+    return true;
+}
+
+
+
+void SphereSet::hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const
+{
+    rec.p = r.pointAtParam( hit.t );
+    rec.normal = ( rec.p - mCenters[ hit.primIndex ] ) / mRadii[ hit.primIndex ];
+    rec.material = material;
+}
+
+
+
+bool SphereSet::shadowHit( const Ray &r, Real tmin, Real tmax ) const 
+{
+    return mBVH.occludedLeaves( r, tmin, tmax,
+        [&]( int first, int count )
+        {
+            const SphereBatch *batch = &mBatches[ mLeafBatch[ first ] ];
+            for ( int i = 0; i < count; i += SphereBatch::WIDTH, batch++ )
+            {
+                if ( batch->occluded( r, tmin, tmax ) ) return true;
+            }
+            return false;
+        } );
+}
@@ -0,0 +1,69 @@
+#ifndef _SPHERESET_H_
+#define _SPHERESET_H_
+
+#include <vector>
+#include "Surface.h"
+#include "BVH.h"
+#include "SphereBatch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A large set of spheres sharing one material, such as the atoms of one
+// element in a molecule or the particles of a simulation, stored as flat
+// arrays of centers and radii with a BVH of their own. The spheres are
+// reordered to the leaf order of the BVH, and the spheres of each leaf are
+// also copied into SphereBatch groups, through which ray intersection
+// tests them together in SIMD lanes.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class SphereSet : public Surface 
+{
+public:
+
+    SphereSet( std::vector<Vector3r> theCenters, std::vector<Real> theRadii, int theMaterial,
+               BVH::BuildMethod method = BVH::BuildMethod::BinnedSAH );
+
+
+    bool hit(const Ray &r, // Ray being sent.
+             Real tmin,  // Minimum hit parameter to be searched for.
+             Real tmax,  // Maximum hit parameter to be searched for.
+             SurfaceHit &hit
+             ) const override;
+
+
+    [[nodiscard]] bool shadowHit(const Ray &r, // Ray being sent.
+                                 Real tmin,  // Minimum hit parameter to be searched for.
+                                 Real tmax   // Maximum hit parameter to be searched for.
+                                 ) const override;
+
+
+    void hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const override;
+
+
+    [[nodiscard]] BoundingBox boundingBox() const override { return mBVH.bounds(); }
+
+
+    [[nodiscard]] int numSpheres() const { return (int)mCenters.size(); }
+
+    [[nodiscard]] const BVH &bvh() const { return mBVH; }
+
+    // Heap memory used by the sphere, batch and BVH arrays.
+    [[nodiscard]] size_t memoryBytes() const;
+
+
+private:
+
+    void build( BVH::BuildMethod method );
+
+    std::vector<Vector3r> mCenters;
+    std::vector<Real> mRadii;
+    BVH mBVH;
+    std::vector<SphereBatch> mBatches;  // The spheres of each leaf, in leaf order.
+    std::vector<int> mLeafBatch;        // First batch of the leaf starting at sphere i.
+
+}; // SphereSet
+
+
+#endif // _SPHERESET_H_
@@ -0,0 +1,16 @@
+#include "Surface.h"
+#include "Instance.h"
+
+using namespace std;
+
+
+
+void SurfaceHit::resolve( const Ray &r, SurfaceHitRecord &rec ) const
+{
+    // An instanced hit is resolved by the outermost instance, which passes
+    // it in through any nested instances to the surface.
+    const Surface *outermost = ( numInstances > 0 )? instances[ numInstances - 1 ] : surface;
+    outermost->hitAttributes( r, *this, rec );
+    rec.t = t;
+    rec.p = r.pointAtParam( t );
+}
@@ -4,18 +4,59 @@
 //  Abstract class Surface may be subclassed to a particular type of 
 //  Surface such as a Plane, Sphere, Triangle, and triangle mesh.
 
+#include <algorithm>
 #include "Vector3d.h"
 #include "Ray.h"
 #include "Color.h"
-#include "Material.h"
+#include "BoundingBox.h"
 
 
+class Surface;
+class Instance;
+
+
+// The complete description of the nearest hit, for shading.
+
 struct SurfaceHitRecord
 {
-    double t{};        // Ray hits at p = Ray.origin() + t * Ray.direction().
-    Vector3d p;        // The point of intersection.
-    Vector3d normal;   // Surface normal at p. May not be unit vector.
-    Material material; // Surface material.
+    Real t{};        // Ray hits at p = Ray.origin() + t * Ray.direction().
+    Vector3r p;        // The point of intersection.
+    Vector3r normal;   // Surface normal at p. May not be unit vector.
+    int material{};    // Index of the surface material in Scene::materials.
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// What a hit test records for a candidate hit: its ray parameter and just
+// enough to identify the primitive and the point on it. Most candidates
+// are superseded by nearer ones, so the hit point, normal and material
+// are only worked out for the final, nearest hit, by resolve().
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct SurfaceHit
+{
+    static constexpr int MAX_INSTANCE_DEPTH = 4;
+
+    Real t{};                        // Ray hits at Ray.origin() + t * Ray.direction().
+    const Surface *surface = nullptr;  // The innermost surface hit.
+    int primIndex{};                   // The primitive of the surface, e.g. a triangle of a mesh.
+    Real beta{}, gamma{};            // Barycentric coordinates of a hit on a triangle.
+
+    // The instances the ray was traced through to reach the surface,
+    // innermost first.
+    const Instance *instances[ MAX_INSTANCE_DEPTH ]{};
+    int numInstances{};
+
+
+    // Records a hit on a primitive of a surface outside any instance.
+    void set( Real theT, const Surface *theSurface, int thePrimIndex = 0 )
+        { t = theT;  surface = theSurface;  primIndex = thePrimIndex;  numInstances = 0; }
+
+    // Fills in the hit record. r is the ray that was tested.
+    void resolve( const Ray &r, SurfaceHitRecord &rec ) const;
 };
 
 
@@ -24,14 +65,15 @@ class Surface
 {
 public:
 
-    Material material;   // Material of the surface.
+    int material{};   // Index of the surface material in Scene::materials.
 
-    // Does a Ray hit the Surface?
+    // Does a Ray hit the Surface? On a hit, records the nearest one in hit.
+    // On a miss, hit is left unchanged.
     virtual bool hit(
         const Ray& r, // Ray being sent.
-        double tmin,  // Minimum hit parameter to be searched for.
-        double tmax,  // Maximum hit parameter to be searched for.
-        SurfaceHitRecord& rec
+        Real tmin,  // Minimum hit parameter to be searched for.
+        Real tmax,  // Maximum hit parameter to be searched for.
+        SurfaceHit& hit
     ) const = 0;
 
 
@@ -39,9 +81,32 @@ public:
     // Does a Ray hit any Surface?  Allows early termination.
     [[nodiscard]] virtual bool shadowHit(
         const Ray& r, // Ray being sent.
-        double tmin,  // Minimum hit parameter to be searched for.
-        double tmax   // Maximum hit parameter to be searched for.
+        Real tmin,  // Minimum hit parameter to be searched for.
+        Real tmax   // Maximum hit parameter to be searched for.
     ) const = 0;
+
+
+
+    // Fills in rec for a hit recorded by hit(), except for t. r is in the
+    // space of the surface.
+    virtual void hitAttributes(
+        const Ray& r,
+        const SurfaceHit& hit,
+        SurfaceHitRecord& rec
+    ) const = 0;
+
+
+
+    // Bounding box of the Surface. Unbounded surfaces return BoundingBox::infinite().
+    [[nodiscard]] virtual BoundingBox boundingBox() const = 0;
+
+
+
+    // Widens [lo, hi] to include the index of every material the Surface
+    // can be shaded with, so that a scene can check them all up front.
+    virtual void expandMaterialRange( int &lo, int &hi ) const
+        { lo = std::min( lo, material );  hi = std::max( hi, material ); }
+
     
     virtual ~Surface() = default;
 
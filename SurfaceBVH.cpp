@@ -0,0 +1,102 @@
+#include "SurfaceBVH.h"
+#include "Plane.h"
+
+using namespace std;
+
+
+
+void SurfaceBVH::clear()
+{
+    mBVH.clear();
+    mBounded.clear();
+    mPlanes.clear();
+    mUnbounded.clear();
+    mIsBuilt = false;
+}
+
+
+
+void SurfaceBVH::build( const vector<Surface*> &surfaces, BVH::BuildMethod method )
+{
+    clear();
+
+    vector<BoundingBox> primBounds;
+    primBounds.reserve( surfaces.size() );
+
+    for ( const Surface *surface : surfaces )
+    {
+        BoundingBox box = surface->boundingBox();
+        if ( box.isBounded() )
+        {
+            mBounded.push_back( surface );
+            primBounds.push_back( box );
+        }
+        else if ( auto plane = dynamic_cast<const Plane*>( surface ) )
+        {
+            mPlanes.add( *plane );
+        }
+        else mUnbounded.push_back( surface );
+    }
+
+    mBVH.build( primBounds, method );
+    mIsBuilt = true;
+}
+
+
+
+bool SurfaceBVH::update()
+{
+    vector<BoundingBox> primBounds( mBounded.size() );
+    for ( size_t i = 0; i < mBounded.size(); i++ ) primBounds[i] = mBounded[i]->boundingBox();
+    return mBVH.update( primBounds );
+}
+
+
+
+bool SurfaceBVH::hit( const Ray &r, Real tmin, Real tmax, SurfaceHit &hit ) const
+{
+    // Unbounded surfaces first, so that the hierarchy is only searched in
+    // front of the nearest of them. A plane is recorded as the hit only if
+    // nothing nearer is found.
+    int nearestPlane = mPlanes.hit( r, tmin, tmax );
+    bool hasHitSomething = false;
+
+    for ( const Surface *surface : mUnbounded )
+    {
+        if ( surface->hit( r, tmin, tmax, hit ) )
+        {
+            hasHitSomething = true;
+            tmax = hit.t;
+        }
+    }
+
+    hasHitSomething |= mBVH.hit( r, tmin, tmax,
+        [&]( int primIndex, Real &nearest_t )
+        {
+            if ( !mBounded[ primIndex ]->hit( r, tmin, nearest_t, hit ) ) return false;
+            nearest_t = hit.t;
+            return true;
+        } );
+
+    if ( hasHitSomething ) return true;
+    if ( nearestPlane < 0 ) return false;
+
+    hit.set( tmax, &mPlanes.plane( nearestPlane ) );
+    return true;
+}
+
+
+
+bool SurfaceBVH::shadowHit( const Ray &r, Real tmin, Real tmax ) const
+{
+    // Unbounded surfaces are few and large, so they are the cheapest likely blockers.
+    if ( mPlanes.occluded( r, tmin, tmax ) ) return true;
+
+    for ( const Surface *surface : mUnbounded )
+    {
+        if ( surface->shadowHit( r, tmin, tmax ) ) return true;
+    }
+
+    return mBVH.occluded( r, tmin, tmax,
+        [&]( int primIndex ) { return mBounded[ primIndex ]->shadowHit( r, tmin, tmax ); } );
+}
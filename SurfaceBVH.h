@@ -0,0 +1,74 @@
+#ifndef _SURFACEBVH_H_
+#define _SURFACEBVH_H_
+
+#include <vector>
+#include "Surface.h"
+#include "BVH.h"
+#include "PlaneList.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Accelerates ray queries over a set of Surface objects with a BVH.
+// Surfaces without a finite bounding box cannot be placed in the hierarchy
+// and are tested separately on every query, before the hierarchy, so that
+// their hits cull it. Planes, the common case, are kept in a PlaneList.
+//
+// A SurfaceBVH does not own the surfaces. It must be rebuilt whenever
+// surfaces are added, removed or moved.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class SurfaceBVH
+{
+public:
+
+    void build( const std::vector<Surface*> &surfaces, 
+                BVH::BuildMethod method = BVH::BuildMethod::BinnedSAH );
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Updates the hierarchy after surfaces have moved (e.g. new Triangle
+    // vertices), refitting its bounds or, once the tree has degraded too
+    // far, rebuilding it. Surfaces must not have been added or removed.
+    // Returns true iff the hierarchy was rebuilt.
+    //////////////////////////////////////////////////////////////////////////////
+
+    bool update();
+
+    void clear();
+
+    [[nodiscard]] bool isBuilt() const { return mIsBuilt; }
+
+    // Bounds of all surfaces. Infinite if any surface is unbounded.
+    [[nodiscard]] BoundingBox bounds() const
+        { return ( mPlanes.empty() && mUnbounded.empty() )? mBVH.bounds() : BoundingBox::infinite(); }
+
+
+    // Finds the nearest hit of the ray in [tmin, tmax] over all surfaces.
+    // On a miss, hit is left unchanged.
+    bool hit( const Ray &r, Real tmin, Real tmax, SurfaceHit &hit ) const;
+
+
+    // Does the ray hit any surface in [tmin, tmax]? Stops at the first blocker found.
+    [[nodiscard]] bool shadowHit( const Ray &r, Real tmin, Real tmax ) const;
+
+
+    [[nodiscard]] const BVH &bvh() const { return mBVH; }
+    [[nodiscard]] BVH &bvh() { return mBVH; }
+
+    [[nodiscard]] int numBounded() const { return (int)mBounded.size(); }
+    [[nodiscard]] int numUnbounded() const { return (int)( mPlanes.size() + mUnbounded.size() ); }
+
+
+private:
+
+    BVH mBVH;
+    std::vector<const Surface*> mBounded;    // Indexed by BVH primitive index.
+    PlaneList mPlanes;                       // Tested linearly.
+    std::vector<const Surface*> mUnbounded;  // Other unbounded surfaces, tested linearly.
+    bool mIsBuilt = false;
+
+}; // SurfaceBVH
+
+
+#endif // _SURFACEBVH_H_
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include "ThreadPool.h"
+
+using namespace std;
+
+
+
+ThreadPool::ThreadPool( int numThreads )
+{
+    if ( numThreads <= 0 ) numThreads = (int)thread::hardware_concurrency();
+    if ( numThreads <= 0 ) numThreads = 1;
+
+    for ( int i = 1; i < numThreads; i++ )
+    {
+        mWorkers.emplace_back( [this]() { workerLoop(); } );
+    }
+}
+
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock( mMutex );
+        mStopping = true;
+    }
+    mTaskReady.notify_all();
+    for ( thread &worker : mWorkers ) worker.join();
+}
+
+
+
+void ThreadPool::workerLoop()
+{
+    while ( true )
+    {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock( mMutex );
+            mTaskReady.wait( lock, [this]() { return mStopping || !mTasks.empty(); } );
+            if ( mTasks.empty() ) return;  // Stopping.
+            task = move( mTasks.front() );
+            mTasks.pop_front();
+        }
+        task();
+    }
+}
+
+
+
+void ThreadPool::parallelFor( int begin, int end, const function<void( int, int )> &rangeFunc )
+{
+    int numChunks = min( numThreads(), end - begin );
+    if ( numChunks <= 1 )
+    {
+        if ( end > begin ) rangeFunc( begin, end );
+        return;
+    }
+
+    TaskGroup group( *this );
+    for ( int c = 0; c < numChunks; c++ )
+    {
+        int chunkBegin = begin + (int)( (long long)( end - begin ) * c / numChunks );
+        int chunkEnd = begin + (int)( (long long)( end - begin ) * ( c + 1 ) / numChunks );
+        group.run( [&rangeFunc, chunkBegin, chunkEnd]() { rangeFunc( chunkBegin, chunkEnd ); } );
+    }
+    group.wait();
+}
+
+
+
+bool ThreadPool::runPendingTask()
+{
+    function<void()> task;
+    {
+        lock_guard<mutex> lock( mMutex );
+        if ( mTasks.empty() ) return false;
+        // Take the newest task: it is the smallest and most likely still in cache.
+        task = move( mTasks.back() );
+        mTasks.pop_back();
+    }
+    task();
+    return true;
+}
+
+
+
+void ThreadPool::TaskGroup::run( function<void()> task )
+{
+    mPending++;
+    {
+        lock_guard<mutex> lock( mPool.mMutex );
+        mPool.mTasks.emplace_back( [this, task = move( task )]() { task(); mPending--; } );
+    }
+    mPool.mTaskReady.notify_one();
+}
+
+
+
+void ThreadPool::TaskGroup::wait()
+{
+    while ( mPending > 0 )
+    {
+        if ( !mPool.runPendingTask() ) this_thread::yield();
+    }
+}
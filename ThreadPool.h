@@ -0,0 +1,83 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A fixed-size pool of worker threads running tasks from a shared queue.
+// Tasks are submitted through a TaskGroup, whose wait() runs queued tasks
+// on the calling thread until all tasks of the group have finished. This
+// makes it safe for tasks to spawn and wait on nested task groups.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class ThreadPool
+{
+public:
+
+    // A pool of numThreads threads, counting the thread that waits on a
+    // TaskGroup. numThreads <= 0 uses all hardware threads.
+    explicit ThreadPool( int numThreads = 0 );
+
+    ~ThreadPool();
+
+    [[nodiscard]] int numThreads() const { return (int)mWorkers.size() + 1; }
+
+
+    // Calls rangeFunc( chunkBegin, chunkEnd ) on contiguous chunks covering
+    // [begin, end), one chunk per thread, and returns when all have finished.
+    void parallelFor( int begin, int end, const std::function<void( int, int )> &rangeFunc );
+
+
+    class TaskGroup
+    {
+    public:
+
+        explicit TaskGroup( ThreadPool &pool ) : mPool( pool ) {}
+        ~TaskGroup() { wait(); }
+
+        // Queues task to run on any thread of the pool.
+        void run( std::function<void()> task );
+
+        // Returns when all tasks run by this group have finished.
+        void wait();
+
+    private:
+
+        ThreadPool &mPool;
+        std::atomic<int> mPending{ 0 };
+
+        TaskGroup( const TaskGroup & ) = delete;
+        TaskGroup &operator= ( const TaskGroup & ) = delete;
+
+    }; // TaskGroup
+
+
+private:
+
+    void workerLoop();
+
+    // Runs one queued task, if there is any. Returns false if the queue is empty.
+    bool runPendingTask();
+
+    std::vector<std::thread> mWorkers;
+    std::deque<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mTaskReady;
+    bool mStopping = false;
+
+    ThreadPool( const ThreadPool & ) = delete;
+    ThreadPool &operator= ( const ThreadPool & ) = delete;
+
+}; // ThreadPool
+
+
+#endif // _THREADPOOL_H_
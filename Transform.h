@@ -0,0 +1,137 @@
+#ifndef _TRANSFORM_H_
+#define _TRANSFORM_H_
+
+#include <cmath>
+#include <cassert>
+#include <array>
+#include "Vector3d.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// An affine transform, stored as the upper 3x4 part of a 4x4 matrix
+// together with its inverse, so that points, vectors and normals can be
+// mapped in both directions without inverting on the fly.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class Transform
+{
+public:
+
+// Constructors
+
+    // The identity transform.
+    Transform() = default;
+
+
+// Common transforms.
+
+    static Transform translate( const Vector3r &t )
+    {
+        return { { 1, 0, 0, t.x(),   0, 1, 0, t.y(),   0, 0, 1, t.z() },
+                 { 1, 0, 0, -t.x(),  0, 1, 0, -t.y(),  0, 0, 1, -t.z() } };
+    }
+
+    // Uniform scaling about the origin. A negative factor also mirrors.
+    static Transform scale( Real s )
+    {
+        assert( s != 0.0 );
+        Real inv = 1 / s;
+        return { { s, 0, 0, 0,  0, s, 0, 0,  0, 0, s, 0 },
+                 { inv, 0, 0, 0,  0, inv, 0, 0,  0, 0, inv, 0 } };
+    }
+
+    // Rotations by angle radians about the coordinate axes.
+    static Transform rotateX( Real angle )
+    {
+        Real c = std::cos( angle ), s = std::sin( angle );
+        return { { 1, 0, 0, 0,  0, c, -s, 0,  0, s, c, 0 },
+                 { 1, 0, 0, 0,  0, c, s, 0,   0, -s, c, 0 } };
+    }
+
+    static Transform rotateY( Real angle )
+    {
+        Real c = std::cos( angle ), s = std::sin( angle );
+        return { { c, 0, s, 0,   0, 1, 0, 0,  -s, 0, c, 0 },
+                 { c, 0, -s, 0,  0, 1, 0, 0,  s, 0, c, 0 } };
+    }
+
+    static Transform rotateZ( Real angle )
+    {
+        Real c = std::cos( angle ), s = std::sin( angle );
+        return { { c, -s, 0, 0,  s, c, 0, 0,   0, 0, 1, 0 },
+                 { c, s, 0, 0,   -s, c, 0, 0,  0, 0, 1, 0 } };
+    }
+
+
+// Operators.
+
+    // Composition: (a * b) applies b first, then a.
+    friend Transform operator* ( const Transform &a, const Transform &b )
+        { return { multiply( a.m, b.m ), multiply( b.mInv, a.mInv ) }; }
+
+
+// Other functions.
+
+    [[nodiscard]] Transform inverse() const { return { mInv, m }; }
+
+    [[nodiscard]] Vector3r transformPoint( const Vector3r &p ) const
+    {
+        return { m[0] * p.x() + m[1] * p.y() + m[2]  * p.z() + m[3],
+                 m[4] * p.x() + m[5] * p.y() + m[6]  * p.z() + m[7],
+                 m[8] * p.x() + m[9] * p.y() + m[10] * p.z() + m[11] };
+    }
+
+    [[nodiscard]] Vector3r transformVector( const Vector3r &v ) const
+    {
+        return { m[0] * v.x() + m[1] * v.y() + m[2]  * v.z(),
+                 m[4] * v.x() + m[5] * v.y() + m[6]  * v.z(),
+                 m[8] * v.x() + m[9] * v.y() + m[10] * v.z() };
+    }
+
+    // Normals transform by the inverse transpose, so that they stay
+    // perpendicular to transformed surfaces. The result is not unit length.
+    [[nodiscard]] Vector3r transformNormal( const Vector3r &n ) const
+    {
+        return { mInv[0] * n.x() + mInv[4] * n.y() + mInv[8]  * n.z(),
+                 mInv[1] * n.x() + mInv[5] * n.y() + mInv[9]  * n.z(),
+                 mInv[2] * n.x() + mInv[6] * n.y() + mInv[10] * n.z() };
+    }
+
+    // Determinant of the linear part. It is negative iff the transform mirrors.
+    [[nodiscard]] Real determinant() const
+    {
+        return m[0] * ( m[5] * m[10] - m[6] * m[9] )
+             - m[1] * ( m[4] * m[10] - m[6] * m[8] )
+             + m[2] * ( m[4] * m[9]  - m[5] * m[8] );
+    }
+
+
+private:
+
+    using Matrix = std::array<Real, 12>;  // Row-major 3x4.
+
+    Transform( const Matrix &theM, const Matrix &theMInv ) : m( theM ), mInv( theMInv ) {}
+
+    static Matrix multiply( const Matrix &a, const Matrix &b )
+    {
+        Matrix r{};
+        for ( int i = 0; i < 3; i++ )
+        {
+            for ( int j = 0; j < 4; j++ )
+            {
+                r[4*i + j] = a[4*i] * b[j] + a[4*i + 1] * b[4 + j] + a[4*i + 2] * b[8 + j];
+            }
+            r[4*i + 3] += a[4*i + 3];
+        }
+        return r;
+    }
+
+    Matrix m{ 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0 };
+    Matrix mInv{ 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0 };
+
+}; // Transform
+
+
+#endif // _TRANSFORM_H_
@@ -2,44 +2,62 @@
 #define _TRIANGLE_H_
 
 #include "Surface.h"
+#include "PrecomputedTriangle.h"
 
 
 class Triangle : public Surface 
 {
 public:
 
-    Vector3d v0, v1, v2; // Vertices.
-    Vector3d n0, n1, n2; // Vertex normals.
+    Vector3r v0, v1, v2; // Vertices. Call precompute() after changing them.
+    Vector3r n0, n1, n2; // Vertex normals.
 
 
-    Triangle( const Vector3d &v0_, const Vector3d &v1_, const Vector3d &v2_, const Material &theMaterial )
+    Triangle( const Vector3r &v0_, const Vector3r &v1_, const Vector3r &v2_, int theMaterial )
     {
         v0 = v0_;  v1 = v1_;  v2 = v2_;
         n0 = n1 = n2 = triNormal( v0, v1, v2 );
         material = theMaterial;
+        precompute();
     }
 
 
-    Triangle( const Vector3d &v0_, const Vector3d &v1_, const Vector3d &v2_,
-              const Vector3d &n0_, const Vector3d &n1_, const Vector3d &n2_, const Material& theMaterial )
+    Triangle( const Vector3r &v0_, const Vector3r &v1_, const Vector3r &v2_,
+              const Vector3r &n0_, const Vector3r &n1_, const Vector3r &n2_, int theMaterial )
     {
         v0 = v0_;  v1 = v1_;  v2 = v2_; 
         n0 = n0_;  n1 = n1_;  n2 = n2_;  
         material = theMaterial;
+        precompute();
     }
 
 
+    // Updates the intersection record from the vertices.
+    void precompute() { mPrecomputed = PrecomputedTriangle( v0, v1, v2 ); }
+
+
     bool hit(const Ray &r, // Ray being sent.
-             double tmin,  // Minimum hit parameter to be searched for.
-             double tmax,  // Maximum hit parameter to be searched for.
-             SurfaceHitRecord &rec
+             Real tmin,  // Minimum hit parameter to be searched for.
+             Real tmax,  // Maximum hit parameter to be searched for.
+             SurfaceHit &hit
              ) const override;
 
 
     [[nodiscard]] bool shadowHit(const Ray &r, // Ray being sent.
-                                 double tmin,  // Minimum hit parameter to be searched for.
-                                 double tmax   // Maximum hit parameter to be searched for.
+                                 Real tmin,  // Minimum hit parameter to be searched for.
+                                 Real tmax   // Maximum hit parameter to be searched for.
                                  ) const override;
+
+
+    void hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const override;
+
+
+    [[nodiscard]] BoundingBox boundingBox() const override;
+
+
+private:
+
+    PrecomputedTriangle mPrecomputed;  // What the hit tests read instead of the vertices.
 };
 
 
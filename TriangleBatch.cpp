@@ -0,0 +1,189 @@
+#include <cmath>
+#include "Util.h"
+#include "TriangleBatch.h"
+
+using namespace std;
+
+
+
+void TriangleBatch::set( int lane, const Vector3r &v0_, const Vector3r &v1_, const Vector3r &v2_ )
+{
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+        v0[axis][lane] = v0_[axis];
+        e1[axis][lane] = v1_[axis] - v0_[axis];
+        e2[axis][lane] = v2_[axis] - v0_[axis];
+    }
+}
+
+
+
+struct TriangleBatchKernels
+{
+    using Batch = TriangleBatch;
+    static constexpr int WIDTH = TriangleBatch::WIDTH;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Moller-Trumbore on one lane, in the same order of operations as the
+    // AVX2 kernel. Returns t, or NaN if the lane is missed.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static Real HitLane( const Batch &b, int k, const Vector3r &o, const Vector3r &d, Real tmin, Real tmax,
+                         Real &beta, Real &gamma )
+    {
+        Real px = d.y() * b.e2[2][k] - d.z() * b.e2[1][k];
+        Real py = d.z() * b.e2[0][k] - d.x() * b.e2[2][k];
+        Real pz = d.x() * b.e2[1][k] - d.y() * b.e2[0][k];
+        Real f = Real( 1 ) / ( b.e1[0][k] * px + b.e1[1][k] * py + b.e1[2][k] * pz );
+
+        Real sx = o.x() - b.v0[0][k], sy = o.y() - b.v0[1][k], sz = o.z() - b.v0[2][k];
+        beta = f * ( sx * px + sy * py + sz * pz );
+
+        Real qx = sy * b.e1[2][k] - sz * b.e1[1][k];
+        Real qy = sz * b.e1[0][k] - sx * b.e1[2][k];
+        Real qz = sx * b.e1[1][k] - sy * b.e1[0][k];
+        gamma = f * ( d.x() * qx + d.y() * qy + d.z() * qz );
+        Real t = f * ( b.e2[0][k] * qx + b.e2[1][k] * qy + b.e2[2][k] * qz );
+
+        bool isHit = beta >= 0 && beta <= 1 && gamma >= 0 && beta + gamma <= 1 && t >= tmin && t <= tmax;
+        return isHit? t : Real( NAN );
+    }
+
+
+    static int HitScalar( const Batch &b, const Ray &r, Real tmin, Real &tmax, Real &beta, Real &gamma )
+    {
+        Vector3r o = r.origin(), d = r.direction();
+        int hitLane = -1;
+        for ( int k = 0; k < WIDTH; k++ )
+        {
+            Real laneBeta, laneGamma;
+            Real t = HitLane( b, k, o, d, tmin, tmax, laneBeta, laneGamma );
+            if ( !isnan( t ) )
+            {
+                tmax = t;
+                beta = laneBeta;
+                gamma = laneGamma;
+                hitLane = k;
+            }
+        }
+        return hitLane;
+    }
+
+
+    static bool OccludedScalar( const Batch &b, const Ray &r, Real tmin, Real tmax )
+    {
+        Vector3r o = r.origin(), d = r.direction();
+        for ( int k = 0; k < WIDTH; k++ )
+        {
+            Real beta, gamma;
+            Real t = HitLane( b, k, o, d, tmin, tmax, beta, gamma );
+            if ( !isnan( t ) ) return true;
+        }
+        return false;
+    }
+
+
+#ifdef HAS_AVX2_KERNELS
+
+    using V = RealLanesAVX2;
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Moller-Trumbore on all lanes. Returns the mask of lanes hit in
+    // [tmin, tmax], with their t, beta and gamma.
+    //////////////////////////////////////////////////////////////////////////////
+
+    TARGET_AVX2 static V::Type HitLanesAVX2( const Batch &b, const Ray &r, Real tmin, Real tmax,
+                                             V::Type &t, V::Type &beta, V::Type &gamma )
+    {
+        Vector3r origin = r.origin(), dir = r.direction();
+        V::Type ox = V::Set1( origin.x() ), oy = V::Set1( origin.y() ), oz = V::Set1( origin.z() );
+        V::Type dx = V::Set1( dir.x() ), dy = V::Set1( dir.y() ), dz = V::Set1( dir.z() );
+
+        V::Type e1x = V::Load( b.e1[0] ), e1y = V::Load( b.e1[1] ), e1z = V::Load( b.e1[2] );
+        V::Type e2x = V::Load( b.e2[0] ), e2y = V::Load( b.e2[1] ), e2z = V::Load( b.e2[2] );
+
+        V::Type px = V::Sub( V::Mul( dy, e2z ), V::Mul( dz, e2y ) );
+        V::Type py = V::Sub( V::Mul( dz, e2x ), V::Mul( dx, e2z ) );
+        V::Type pz = V::Sub( V::Mul( dx, e2y ), V::Mul( dy, e2x ) );
+        V::Type a = V::Add( V::Add( V::Mul( e1x, px ), V::Mul( e1y, py ) ), V::Mul( e1z, pz ) );
+        V::Type f = V::Div( V::Set1( 1 ), a );
+
+        V::Type sx = V::Sub( ox, V::Load( b.v0[0] ) );
+        V::Type sy = V::Sub( oy, V::Load( b.v0[1] ) );
+        V::Type sz = V::Sub( oz, V::Load( b.v0[2] ) );
+        beta = V::Mul( f, V::Add( V::Add( V::Mul( sx, px ), V::Mul( sy, py ) ), V::Mul( sz, pz ) ) );
+
+        V::Type qx = V::Sub( V::Mul( sy, e1z ), V::Mul( sz, e1y ) );
+        V::Type qy = V::Sub( V::Mul( sz, e1x ), V::Mul( sx, e1z ) );
+        V::Type qz = V::Sub( V::Mul( sx, e1y ), V::Mul( sy, e1x ) );
+        gamma = V::Mul( f, V::Add( V::Add( V::Mul( dx, qx ), V::Mul( dy, qy ) ), V::Mul( dz, qz ) ) );
+        t = V::Mul( f, V::Add( V::Add( V::Mul( e2x, qx ), V::Mul( e2y, qy ) ), V::Mul( e2z, qz ) ) );
+
+        // Ordered comparisons, so that NaN lanes (empty triangles) miss.
+        V::Type zero = V::Zero(), one = V::Set1( 1 );
+        V::Type mask = V::And( V::GreaterEqual( beta, zero ), V::GreaterEqual( gamma, zero ) );
+        mask = V::And( mask, V::LessEqual( V::Add( beta, gamma ), one ) );
+        mask = V::And( mask, V::GreaterEqual( t, V::Set1( tmin ) ) );
+        mask = V::And( mask, V::LessEqual( t, V::Set1( tmax ) ) );
+        return mask;
+    }
+
+
+    TARGET_AVX2 static int HitAVX2( const Batch &b, const Ray &r, Real tmin, Real &tmax, Real &beta, Real &gamma )
+    {
+        V::Type t, laneBeta, laneGamma;
+        int hitMask = V::MoveMask( HitLanesAVX2( b, r, tmin, tmax, t, laneBeta, laneGamma ) );
+        if ( hitMask == 0 ) return -1;
+
+        // Horizontal minimum of t over the lanes hit. On equal t the
+        // last lane wins, as in the scalar kernel.
+        alignas( 32 ) Real ts[ WIDTH ], betas[ WIDTH ], gammas[ WIDTH ];
+        V::Store( ts, t );
+        V::Store( betas, laneBeta );
+        V::Store( gammas, laneGamma );
+        int hitLane = -1;
+        for ( int k = 0; k < WIDTH; k++ )
+        {
+            if ( ( hitMask & ( 1 << k ) ) && ts[k] <= tmax )
+            {
+                tmax = ts[k];
+                hitLane = k;
+            }
+        }
+        beta = betas[ hitLane ];
+        gamma = gammas[ hitLane ];
+        return hitLane;
+    }
+
+
+    TARGET_AVX2 static bool OccludedAVX2( const Batch &b, const Ray &r, Real tmin, Real tmax )
+    {
+        V::Type t, beta, gamma;
+        return V::MoveMask( HitLanesAVX2( b, r, tmin, tmax, t, beta, gamma ) ) != 0;
+    }
+
+#endif // HAS_AVX2_KERNELS
+
+
+    static TriangleBatch::Kernels Select( ISA isa )
+    {
+#ifdef HAS_AVX2_KERNELS
+        if ( isa == ISA::AVX2 && Util::HasAVX2() ) return { isa, HitAVX2, OccludedAVX2 };
+#endif
+        return { ISA::Scalar, HitScalar, OccludedScalar };
+    }
+
+}; // TriangleBatchKernels
+
+
+
+TriangleBatch::Kernels TriangleBatch::sKernels = TriangleBatchKernels::Select( ISA::AVX2 );
+
+
+
+void TriangleBatch::setISA( ISA isa )
+{
+    sKernels = TriangleBatchKernels::Select( isa );
+}
@@ -0,0 +1,78 @@
+#ifndef _TRIANGLEBATCH_H_
+#define _TRIANGLEBATCH_H_
+
+#include "Vector3d.h"
+#include "Ray.h"
+#include "SIMD.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Up to WIDTH triangles stored as a structure of arrays (first vertex and
+// two edges, one lane per triangle), so that one ray can be intersected
+// with all of them at once in SIMD lanes. The lanes are Real, so a batch
+// holds 4 triangles in double and 8 in float.
+//
+// The kernel is chosen at run time: AVX2 if the CPU supports it, else a
+// scalar loop over the lanes. Both give the same results as the
+// Moller-Trumbore test on the vertices.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class TriangleBatch
+{
+public:
+
+    static constexpr int WIDTH = REAL_LANES;
+
+
+    // Lanes that are not set hold an empty triangle, which is never hit.
+    void set( int lane, const Vector3r &v0, const Vector3r &v1, const Vector3r &v2 );
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Finds the nearest triangle hit in [tmin, tmax]. On a hit, shrinks tmax
+    // to its parameter, sets beta and gamma to the barycentric coordinates
+    // of its second and third vertices, and returns its lane. Returns -1 if
+    // no triangle is hit.
+    //////////////////////////////////////////////////////////////////////////////
+
+    int hit( const Ray &r, Real tmin, Real &tmax, Real &beta, Real &gamma ) const
+        { return sKernels.hit( *this, r, tmin, tmax, beta, gamma ); }
+
+    // Is any triangle hit in [tmin, tmax]?
+    [[nodiscard]] bool occluded( const Ray &r, Real tmin, Real tmax ) const
+        { return sKernels.occluded( *this, r, tmin, tmax ); }
+
+
+    // The instruction set of the kernels in use.
+    static ISA isa() { return sKernels.isa; }
+
+    // Selects the kernels for isa, or the scalar kernels if the CPU does not
+    // support it. For comparing kernels; by default the widest is used.
+    static void setISA( ISA isa );
+
+
+private:
+
+    struct Kernels
+    {
+        ISA isa;
+        int (*hit)( const TriangleBatch &batch, const Ray &r, Real tmin, Real &tmax, Real &beta, Real &gamma );
+        bool (*occluded)( const TriangleBatch &batch, const Ray &r, Real tmin, Real tmax );
+    };
+
+    static Kernels sKernels;
+
+    // The kernels need the layout, so they are defined in TriangleBatch.cpp.
+    friend struct TriangleBatchKernels;
+
+    // Coordinates [axis][lane].
+    alignas( 32 ) Real v0[3][ WIDTH ] = {};
+    alignas( 32 ) Real e1[3][ WIDTH ] = {};
+    alignas( 32 ) Real e2[3][ WIDTH ] = {};
+
+}; // TriangleBatch
+
+
+#endif // _TRIANGLEBATCH_H_
@@ -0,0 +1,149 @@
+#include <cmath>
+#include "TriangleMesh.h"
+
+using namespace std;
+
+
+
+TriangleMesh::TriangleMesh( vector<Vector3r> thePositions, vector<int> theIndices, int theMaterial,
+                            BVH::BuildMethod method )
+    : TriangleMesh( move( thePositions ), vector<Vector3r>(), move( theIndices ), theMaterial, method )
+{
+}
+
+
+
+TriangleMesh::TriangleMesh( vector<Vector3r> thePositions, vector<Vector3r> theNormals, 
+                            vector<int> theIndices, int theMaterial, BVH::BuildMethod method )
+    : mPositions( move( thePositions ) ), mNormals( move( theNormals ) ), mIndices( move( theIndices ) )
+{
+    material = theMaterial;
+    build( method );
+}
+
+
+
+void TriangleMesh::build( BVH::BuildMethod method )
+{
+    int numTris = numTriangles();
+    vector<BoundingBox> triBounds( numTris );
+    for ( int i = 0; i < numTris; i++ )
+    {
+        const int *v = &mIndices[ 3*i ];
+        triBounds[i].expand( mPositions[ v[0] ] ).expand( mPositions[ v[1] ] ).expand( mPositions[ v[2] ] );
+    }
+    // Costing a whole leaf as one test makes the leaves large and the BVH
+    // small, at some cost in speed.
+    mBVH.setLeafBatchWidth( MAX_LEAF_TRIANGLES );
+    mBVH.build( triBounds, method );
+
+    // Store the triangles in BVH leaf order, and the vertices in the order
+    // they are first used by the reordered triangles.
+    const vector<int> &triOrder = mBVH.primIndices();
+    vector<int> newIndex( mPositions.size(), -1 );
+    vector<Vector3r> positions, normals;
+    vector<int> indices( mIndices.size() );
+    positions.reserve( mPositions.size() );
+    normals.reserve( mNormals.size() );
+
+    for ( int i = 0; i < numTris; i++ )
+    {
+        for ( int k = 0; k < 3; k++ )
+        {
+            int v = mIndices[ 3 * triOrder[i] + k ];
+            if ( newIndex[v] < 0 )
+            {
+                newIndex[v] = (int)positions.size();
+                positions.push_back( mPositions[v] );
+                if ( !mNormals.empty() ) normals.push_back( mNormals[v] );
+            }
+            indices[ 3*i + k ] = newIndex[v];
+        }
+    }
+
+    mPositions.swap( positions );
+    mNormals.swap( normals );
+    mIndices.swap( indices );
+    mBVH.renumberPrimitives();
+}
+
+
+
+void TriangleMesh::loadBatch( int first, int count, TriangleBatch &batch ) const
+{
+    for ( int i = 0; i < count; i++ )
+    {
+        const int *v = &mIndices[ 3 * ( first + i ) ];
+        batch.set( i, mPositions[ v[0] ], mPositions[ v[1] ], mPositions[ v[2] ] );
+    }
+}
+
+
+
+size_t TriangleMesh::memoryBytes() const
+{
+    return mPositions.capacity() * sizeof( Vector3r ) + mNormals.capacity() * sizeof( Vector3r )
+         + mIndices.capacity() * sizeof( int ) 
+         + mBVH.nodes().capacity() * sizeof( BVH::Node ) + mBVH.primIndices().capacity() * sizeof( int );
+}
+
+
+
+bool TriangleMesh::hit( const Ray &r, Real tmin, Real tmax, SurfaceHit &hit ) const 
+{
+    int hitTri = -1;
+    Real hitBeta = 0.0, hitGamma = 0.0;
+
+    mBVH.hitLeaves( r, tmin, tmax,
+        [&]( int first, int count, Real &nearest_t )
+        {
+            bool hasHit = false;
+            for ( int i = 0; i < count; i += TriangleBatch::WIDTH )
+            {
+                TriangleBatch batch;
+                loadBatch( first + i, Util::Min2( count - i, TriangleBatch::WIDTH ), batch );
+                int lane = batch.hit( r, tmin, nearest_t, hitBeta, hitGamma );
+                if ( lane < 0 ) continue;
+                hitTri = first + i + lane;
+                hasHit = true;
+            }
+            return hasHit;
+        } );
+
+    if ( hitTri < 0 ) return false;
+
+    hit.set( tmax, this, hitTri );
+    hit.beta = hitBeta;
+    hit.gamma = hitGamma;
+    return true;
+}
+
+
+
+void TriangleMesh::hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const
+{
+    const int *v = &mIndices[ 3*hit.primIndex ];
+    rec.p = r.pointAtParam( hit.t );
+    if ( mNormals.empty() )
+        rec.normal = triNormal( mPositions[ v[0] ], mPositions[ v[1] ], mPositions[ v[2] ] );
+    else
+        rec.normal = ( 1 - hit.beta - hit.gamma ) * mNormals[ v[0] ] + hit.beta * mNormals[ v[1] ] + hit.gamma * mNormals[ v[2] ];
+    rec.material = material;
+}
+
+
+
+bool TriangleMesh::shadowHit( const Ray &r, Real tmin, Real tmax ) const 
+{
+    return mBVH.occludedLeaves( r, tmin, tmax,
+        [&]( int first, int count )
+        {
+            for ( int i = 0; i < count; i += TriangleBatch::WIDTH )
+            {
+                TriangleBatch batch;
+                loadBatch( first + i, Util::Min2( count - i, TriangleBatch::WIDTH ), batch );
+                if ( batch.occluded( r, tmin, tmax ) ) return true;
+            }
+            return false;
+        } );
+}
@@ -0,0 +1,89 @@
+#ifndef _TRIANGLEMESH_H_
+#define _TRIANGLEMESH_H_
+
+#include <vector>
+#include "Surface.h"
+#include "BVH.h"
+#include "TriangleBatch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A mesh of triangles sharing one material, stored as flat arrays: vertex
+// positions, optional vertex normals, and three vertex indices per
+// triangle. Neighbouring triangles share their vertices, so a triangle
+// costs its 12 bytes of indices plus its share of the vertices and of the
+// mesh's own BVH, instead of a whole Triangle object.
+//
+// The triangles are reordered to the leaf order of the BVH and the
+// vertices to the order of first use, so that a leaf's triangles and
+// their vertices are close together in memory. Ray intersection loads the
+// triangles of a leaf from these arrays into a TriangleBatch on the stack
+// and tests them together in SIMD lanes. With no batch copies kept, and
+// leaves of up to MAX_LEAF_TRIANGLES, a triangle takes about a tenth of
+// the memory of a Triangle object.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class TriangleMesh : public Surface 
+{
+public:
+
+    static constexpr int MAX_LEAF_TRIANGLES = 16;
+
+
+    // Triangle i has vertices thePositions[ theIndices[3*i .. 3*i+2] ]. Its
+    // normal is the geometric normal of the triangle.
+    TriangleMesh( std::vector<Vector3r> thePositions, std::vector<int> theIndices, int theMaterial,
+                  BVH::BuildMethod method = BVH::BuildMethod::BinnedSAH );
+
+    // As above, with the normal interpolated from vertex normals theNormals.
+    TriangleMesh( std::vector<Vector3r> thePositions, std::vector<Vector3r> theNormals, 
+                  std::vector<int> theIndices, int theMaterial,
+                  BVH::BuildMethod method = BVH::BuildMethod::BinnedSAH );
+
+
+    bool hit(const Ray &r, // Ray being sent.
+             Real tmin,  // Minimum hit parameter to be searched for.
+             Real tmax,  // Maximum hit parameter to be searched for.
+             SurfaceHit &hit
+             ) const override;
+
+
+    [[nodiscard]] bool shadowHit(const Ray &r, // Ray being sent.
+                                 Real tmin,  // Minimum hit parameter to be searched for.
+                                 Real tmax   // Maximum hit parameter to be searched for.
+                                 ) const override;
+
+
+    void hitAttributes( const Ray &r, const SurfaceHit &hit, SurfaceHitRecord &rec ) const override;
+
+
+    [[nodiscard]] BoundingBox boundingBox() const override { return mBVH.bounds(); }
+
+
+    [[nodiscard]] int numTriangles() const { return (int)mIndices.size() / 3; }
+    [[nodiscard]] int numVertices() const { return (int)mPositions.size(); }
+
+    [[nodiscard]] const BVH &bvh() const { return mBVH; }
+
+    // Heap memory used by the vertex, index and BVH arrays.
+    [[nodiscard]] size_t memoryBytes() const;
+
+
+private:
+
+    void build( BVH::BuildMethod method );
+
+    // Loads the count <= TriangleBatch::WIDTH triangles from first into the lanes of batch.
+    void loadBatch( int first, int count, TriangleBatch &batch ) const;
+
+    std::vector<Vector3r> mPositions;
+    std::vector<Vector3r> mNormals;  // Empty, or one per vertex.
+    std::vector<int> mIndices;       // Three per triangle.
+    BVH mBVH;
+
+}; // TriangleMesh
+
+
+#endif // _TRIANGLEMESH_H_
@@ -10,6 +10,11 @@
 #include <sys/timeb.h>
 #include "Util.h"
 
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
 #define MSG_BUF_SIZE    1024
 
 
@@ -95,3 +100,34 @@ double Util::GetCurrCPUTime( )
 {
     return ((double) clock() ) / CLOCKS_PER_SEC;
 }
+
+
+
+bool Util::HasAVX2()
+    // Returns true if the CPU and the operating system support AVX2 
+    // instructions. Code compiled for AVX2 must only run if it does.
+{
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+    static const bool hasAVX2 = []()
+    {
+        int info[4];
+        __cpuid( info, 0 );
+        if ( info[0] < 7 ) return false;
+
+        // AVX support, and the OS saving the YMM registers on context switches.
+        __cpuid( info, 1 );
+        bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+        bool avx = ( info[2] & ( 1 << 28 ) ) != 0;
+        if ( !osxsave || !avx || ( _xgetbv( 0 ) & 6 ) != 6 ) return false;
+
+        __cpuidex( info, 7, 0 );
+        return ( info[1] & ( 1 << 5 ) ) != 0;
+    }();
+    return hasAVX2;
+#elif ( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+    __builtin_cpu_init();  // In case this runs in a static initializer.
+    return __builtin_cpu_supports( "avx2" );
+#else
+    return false;
+#endif
+}
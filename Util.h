@@ -2,6 +2,7 @@
 #define _UTIL_H_
 
 #include <cstdlib>
+#include <cstdint>
 #include <cmath>
 
 typedef unsigned char uchar;
@@ -47,6 +48,11 @@ public:
         // start of the current process.
 
 
+    static bool HasAVX2();
+        // Returns true if the CPU and the operating system support AVX2 
+        // instructions. Code compiled for AVX2 must only run if it does.
+
+
     static void *_CheckedMalloc( size_t size, const char *srcfile, int lineNum )
         // Same as malloc(), but checks for out-of-memory.
     {
@@ -72,6 +78,42 @@ public:
     }
 
 
+    static float RoundDownToFloat( double x )
+        // Returns the nearest float not above x.
+    {
+        float f = (float)x;
+        return ( f > x )? std::nextafter( f, -INFINITY ) : f;
+    }
+
+
+    static float RoundUpToFloat( double x )
+        // Returns the nearest float not below x.
+    {
+        float f = (float)x;
+        return ( f < x )? std::nextafter( f, INFINITY ) : f;
+    }
+
+
+    static uint32_t ExpandBits( uint32_t v )
+        // Spreads the low 10 bits of v so that there are two zero bits between each.
+    {
+        v = ( v * 0x00010001u ) & 0xFF0000FFu;
+        v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+        v = ( v * 0x00000011u ) & 0xC30C30C3u;
+        v = ( v * 0x00000005u ) & 0x49249249u;
+        return v;
+    }
+
+
+    static uint32_t MortonCode( double x, double y, double z )
+        // Returns the 30-bit Morton code of a point with coordinates in
+        // [0, 1], with the x bit highest in each group of three.
+    {
+        auto quantize = []( double f ) { return (uint32_t)Clamp( f * 1024.0, 0.0, 1023.0 ); };
+        return ( ExpandBits( quantize( x ) ) << 2 ) | ( ExpandBits( quantize( y ) ) << 1 ) | ExpandBits( quantize( z ) );
+    }
+
+
     static int sqr( int i )
         // Returns the square of i.
     {
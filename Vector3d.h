@@ -7,38 +7,65 @@
 #include <array>
 
 
-// For 3D vectors and 3D points.
-
-class Vector3d
+//////////////////////////////////////////////////////////////////////////////
+//
+// The scalar type of the geometry and ray math. It is double by default.
+// Define RAYTRACE_FLOAT to make it float, as the ReleaseFloat configuration
+// does. This switches Vector3r and Ray, the surfaces' own vertices, centers
+// and normals, the CompiledScene records, instance transforms, the camera
+// and shading, and the lanes of the SIMD TriangleBatch and SphereBatch,
+// which then hold 8 primitives instead of 4. The BVH node bounds and the
+// ParticleSet spheres are float in both. Colors are always float. Float
+// renders differ from double only at scattered pixels, where a ray grazes
+// an edge and rounding decides whether it hits.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef RAYTRACE_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
+
+
+
+// For 3D vectors and 3D points, with scalar type T.
+
+template <typename T>
+class Vector3
 {
 public:
 
 // Constructors
 
-    Vector3d() = default;
-    explicit Vector3d( const double v[3] ) { data[0] = v[0]; data[1] = v[1]; data[2] = v[2]; }
-    explicit Vector3d( const float  v[3] ) { data[0] = v[0]; data[1] = v[1]; data[2] = v[2]; }
-    Vector3d( double x, double y, double z ) { data[0] = x; data[1] = y; data[2] = z; }
+    Vector3() = default;
+    explicit Vector3( const double v[3] ) { data[0] = (T)v[0]; data[1] = (T)v[1]; data[2] = (T)v[2]; }
+    explicit Vector3( const float  v[3] ) { data[0] = (T)v[0]; data[1] = (T)v[1]; data[2] = (T)v[2]; }
+    Vector3( T x, T y, T z ) { data[0] = x; data[1] = y; data[2] = z; }
+
+    // Conversion between precisions.
+    template <typename U>
+    explicit Vector3( const Vector3<U> &v ) { data[0] = (T)v.x(); data[1] = (T)v.y(); data[2] = (T)v.z(); }
 
 
 // Data setting and reading.
 
-    Vector3d &setX( double a ) { data[0] = a; return (*this); }
-    Vector3d &setY( double a ) { data[1] = a; return (*this); }
-    Vector3d &setZ( double a ) { data[2] = a; return (*this); }
+    Vector3 &setX( T a ) { data[0] = a; return (*this); }
+    Vector3 &setY( T a ) { data[1] = a; return (*this); }
+    Vector3 &setZ( T a ) { data[2] = a; return (*this); }
 
-    Vector3d &setXYZ( const double v[3] ) { data[0] = v[0]; data[1] = v[1]; data[2] = v[2]; return (*this); }
-    Vector3d &setXYZ( const float  v[3] ) { data[0] = v[0]; data[1] = v[1]; data[2] = v[2]; return (*this); }
-    Vector3d &setXYZ( double x, double y, double z ) { data[0] = x; data[1] = y; data[2] = z; return (*this); }
-    Vector3d &setToZeros() { data[0] = data[1] = data[2] = 0.0; return (*this); }
+    Vector3 &setXYZ( const double v[3] ) { data[0] = (T)v[0]; data[1] = (T)v[1]; data[2] = (T)v[2]; return (*this); }
+    Vector3 &setXYZ( const float  v[3] ) { data[0] = (T)v[0]; data[1] = (T)v[1]; data[2] = (T)v[2]; return (*this); }
+    Vector3 &setXYZ( T x, T y, T z ) { data[0] = x; data[1] = y; data[2] = z; return (*this); }
+    Vector3 &setToZeros() { data[0] = data[1] = data[2] = 0; return (*this); }
 
-    double &x() { return data[0]; }
-    double &y() { return data[1]; }
-    double &z() { return data[2]; }
+    T &x() { return data[0]; }
+    T &y() { return data[1]; }
+    T &z() { return data[2]; }
 
-    [[nodiscard]] double x() const { return data[0]; }
-    [[nodiscard]] double y() const { return data[1]; }
-    [[nodiscard]] double z() const { return data[2]; }
+    [[nodiscard]] T x() const { return data[0]; }
+    [[nodiscard]] T y() const { return data[1]; }
+    [[nodiscard]] T z() const { return data[2]; }
 
     void getXYZ( double v[3] ) const { v[0] = data[0]; v[1] = data[1]; v[2] = data[2]; }
     void getXYZ( float  v[3] ) const { v[0] = (float)data[0]; v[1] = (float)data[1]; v[2] = (float)data[2]; }
@@ -46,70 +73,99 @@ public:
 
 // Operators.
 
-    double &operator[]( int i ) { assert(i >= 0 && i < 3); return data[i]; }
+    T &operator[]( int i ) { assert(i >= 0 && i < 3); return data[i]; }
 
-    double operator[]( int i ) const { assert(i >= 0 && i < 3); return data[i]; }
+    T operator[]( int i ) const { assert(i >= 0 && i < 3); return data[i]; }
 
 
-    Vector3d operator+ () const 
+    Vector3 operator+ () const 
         { return (*this); }
 
-    Vector3d operator- () const 
+    Vector3 operator- () const 
         { return { -data[0], -data[1], -data[2] }; }
 
 
-    Vector3d &operator+= ( const Vector3d &v ) 
+    Vector3 &operator+= ( const Vector3 &v ) 
         { data[0] += v.data[0]; data[1] += v.data[1]; data[2] += v.data[2]; return (*this); }
 
-    Vector3d &operator-= ( const Vector3d &v ) 
+    Vector3 &operator-= ( const Vector3 &v ) 
         { data[0] -= v.data[0]; data[1] -= v.data[1]; data[2] -= v.data[2]; return (*this); }
 
-    Vector3d &operator*= ( const Vector3d &v ) 
+    Vector3 &operator*= ( const Vector3 &v ) 
         { data[0] *= v.data[0]; data[1] *= v.data[1]; data[2] *= v.data[2]; return (*this); }
 
-    Vector3d &operator/= ( const Vector3d &v ) 
+    Vector3 &operator/= ( const Vector3 &v ) 
         { data[0] /= v.data[0]; data[1] /= v.data[1]; data[2] /= v.data[2]; return (*this); }
 
-    Vector3d &operator*= ( double a ) 
+    Vector3 &operator*= ( T a ) 
         { data[0] *= a; data[1] *= a; data[2] *= a; return (*this); }
 
-    Vector3d &operator/= ( double a ) 
+    Vector3 &operator/= ( T a ) 
         { data[0] /= a; data[1] /= a; data[2] /= a; return (*this); }
 
 
-    friend Vector3d operator+ ( const Vector3d &v1, const Vector3d &v2 );
-    friend Vector3d operator- ( const Vector3d &v1, const Vector3d &v2 );
-    friend Vector3d operator* ( const Vector3d &v1, const Vector3d &v2 );
-    friend Vector3d operator/ ( const Vector3d &v1, const Vector3d &v2 );
-    friend Vector3d operator* ( double a, const Vector3d &v );
-    friend Vector3d operator* ( const Vector3d &v, double a );
-    friend Vector3d operator/ ( const Vector3d &v, double a );
-    friend bool operator== ( const Vector3d &v1, const Vector3d &v2 );
-    friend bool operator!= ( const Vector3d &v1, const Vector3d &v2 );
-    friend double dot( const Vector3d &v1, const Vector3d &v2 );
-    friend Vector3d cross( const Vector3d &v1, const Vector3d &v2 );
-    friend Vector3d triNormal( const Vector3d &v1, const Vector3d &v2, const Vector3d &v3 );
+// More unary and binary vector operators. They are defined here, as
+// friends, so that a double constant can scale a float vector.
+
+    friend Vector3 operator+ ( const Vector3 &v1, const Vector3 &v2 ) 
+        { return { v1.data[0] + v2.data[0], v1.data[1] + v2.data[1], v1.data[2] + v2.data[2] }; }
+
+    friend Vector3 operator- ( const Vector3 &v1, const Vector3 &v2 ) 
+        { return { v1.data[0] - v2.data[0], v1.data[1] - v2.data[1], v1.data[2] - v2.data[2] }; }
+
+    friend Vector3 operator* ( const Vector3 &v1, const Vector3 &v2 ) 
+        { return { v1.data[0] * v2.data[0], v1.data[1] * v2.data[1], v1.data[2] * v2.data[2] }; }
+
+    friend Vector3 operator/ ( const Vector3 &v1, const Vector3 &v2 ) 
+        { return { v1.data[0] / v2.data[0], v1.data[1] / v2.data[1], v1.data[2] / v2.data[2] }; }
+
+    friend Vector3 operator* ( T a, const Vector3 &v ) 
+        { return { a * v.data[0], a * v.data[1], a * v.data[2] }; }
+
+    friend Vector3 operator* ( const Vector3 &v, T a ) 
+        { return { a * v.data[0], a * v.data[1], a * v.data[2] }; }
+
+    friend Vector3 operator/ ( const Vector3 &v, T a ) 
+        { return { v.data[0] / a, v.data[1] / a, v.data[2] / a }; }
+
+    friend bool operator== ( const Vector3 &v1, const Vector3 &v2 ) 
+        { return ( ( v1.data[0] == v2.data[0] ) && ( v1.data[1] == v2.data[1] ) && ( v1.data[2] == v2.data[2] ) ); }
+
+    friend bool operator!= ( const Vector3 &v1, const Vector3 &v2 ) 
+        { return ( ( v1.data[0] != v2.data[0] ) || ( v1.data[1] != v2.data[1] ) || ( v1.data[2] != v2.data[2] ) ); }
+
+    friend T dot( const Vector3 &v1, const Vector3 &v2 ) 
+        { return (v1.data[0] * v2.data[0]) + (v1.data[1] * v2.data[1]) + (v1.data[2] * v2.data[2]); }
+
+    friend Vector3 cross( const Vector3 &v1, const Vector3 &v2 )
+        { return { v1.data[1] * v2.data[2] - v1.data[2] * v2.data[1],
+                   v1.data[2] * v2.data[0] - v1.data[0] * v2.data[2],
+                   v1.data[0] * v2.data[1] - v1.data[1] * v2.data[0] }; }
+
+    // Returns the normal vector of the triangle.
+    friend Vector3 triNormal( const Vector3 &v1, const Vector3 &v2, const Vector3 &v3 )
+        { return cross( v2 - v1, v3 - v1 ); }
 
 
 // Other functions.
 
-    [[nodiscard]] double length() const
-        { return sqrt( data[0]*data[0] + data[1]*data[1] + data[2]*data[2] ); }
+    [[nodiscard]] T length() const
+        { return std::sqrt( data[0]*data[0] + data[1]*data[1] + data[2]*data[2] ); }
 
-    [[nodiscard]] double sqrLength() const
+    [[nodiscard]] T sqrLength() const
         { return ( data[0] * data[0] + data[1] * data[1] + data[2] * data[2] ); }
 
 
-    [[nodiscard]] Vector3d unitVector() const
+    [[nodiscard]] Vector3 unitVector() const
     {
-        double invLen = 1.0 / length();
+        T invLen = 1 / length();
         return { data[0] * invLen, data[1] * invLen, data[2] * invLen };
     }
 
 
-    Vector3d &makeUnitVector()
+    Vector3 &makeUnitVector()
     { 
-        double invLen = 1.0 / length();
+        T invLen = 1 / length();
         data[0] *= invLen; 
         data[1] *= invLen; 
         data[2] *= invLen;
@@ -120,59 +176,25 @@ public:
 private:
 
     // The 3D vector data.
-    std::array<double, 3> data{};
-
-}; // Vector3d
+    std::array<T, 3> data{};
 
+}; // Vector3
 
 
-// More unary and binary vector operators.
 
-inline Vector3d operator+ ( const Vector3d &v1, const Vector3d &v2 ) 
-    { return { v1.data[0] + v2.data[0], v1.data[1] + v2.data[1], v1.data[2] + v2.data[2] }; }
-
-inline Vector3d operator- ( const Vector3d &v1, const Vector3d &v2 ) 
-    { return { v1.data[0] - v2.data[0], v1.data[1] - v2.data[1], v1.data[2] - v2.data[2] }; }
-
-inline Vector3d operator* ( const Vector3d &v1, const Vector3d &v2 ) 
-    { return { v1.data[0] * v2.data[0], v1.data[1] * v2.data[1], v1.data[2] * v2.data[2] }; }
-
-inline Vector3d operator/ ( const Vector3d &v1, const Vector3d &v2 ) 
-    { return { v1.data[0] / v2.data[0], v1.data[1] / v2.data[1], v1.data[2] / v2.data[2] }; }
-
-inline Vector3d operator* ( double a, const Vector3d &v ) 
-    { return { a * v.data[0], a * v.data[1], a * v.data[2] }; }
-
-inline Vector3d operator* ( const Vector3d &v, double a ) 
-    { return { a * v.data[0], a * v.data[1], a * v.data[2] }; }
-
-inline Vector3d operator/ ( const Vector3d &v, double a ) 
-    { return { v.data[0] / a, v.data[1] / a, v.data[2] / a }; }
-
-inline bool operator== ( const Vector3d &v1, const Vector3d &v2 ) 
-    { return ( ( v1.data[0] == v2.data[0] ) && ( v1.data[1] == v2.data[1] ) && ( v1.data[2] == v2.data[2] ) ); }
-
-inline bool operator!= ( const Vector3d &v1, const Vector3d &v2 ) 
-    { return ( ( v1.data[0] != v2.data[0] ) || ( v1.data[1] != v2.data[1] ) || ( v1.data[2] != v2.data[2] ) ); }
-
-inline double dot( const Vector3d &v1, const Vector3d &v2 ) 
-    { return (v1.data[0] * v2.data[0]) + (v1.data[1] * v2.data[1]) + (v1.data[2] * v2.data[2]); }
-
-inline Vector3d cross( const Vector3d &v1, const Vector3d &v2 )
-    { return { v1.data[1] * v2.data[2] - v1.data[2] * v2.data[1],
-                       v1.data[2] * v2.data[0] - v1.data[0] * v2.data[2],
-                       v1.data[0] * v2.data[1] - v1.data[1] * v2.data[0] }; }
+template <typename T>
+inline std::istream &operator>> ( std::istream &is, Vector3<T> &v )
+    { return ( is >> v.x() >> v.y() >> v.z() ); }
 
+template <typename T>
+inline std::ostream &operator<< ( std::ostream &os, Vector3<T> v )
+    { return ( os << v.x() << " " << v.y() << " " << v.z() ); }
 
-// Returns the normal vector of the triangle.
-inline Vector3d triNormal( const Vector3d &v1, const Vector3d &v2, const Vector3d &v3 )
-    { return cross( v2 - v1, v3 - v1 ); }
 
-inline std::istream &operator>> ( std::istream &is, Vector3d &v )
-    { return ( is >> v.x() >> v.y() >> v.z() ); }
 
-inline std::ostream &operator<< ( std::ostream &os, Vector3d v )
-    { return ( os << v.x() << " " << v.y() << " " << v.z() ); }
+using Vector3d = Vector3<double>;
+using Vector3f = Vector3<float>;
+using Vector3r = Vector3<Real>;  // In the precision of the renderer.
 
 
 #endif // _VECTOR3D_H_
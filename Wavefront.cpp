@@ -0,0 +1,599 @@
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "Util.h"
+#include "Vector3d.h"
+#include "Color.h"
+#include "Ray.h"
+#include "Material.h"
+#include "Light.h"
+#include "RayPacket.h"
+#include "Shading.h"
+#include "Wavefront.h"
+
+using namespace std;
+
+
+// Primary rays are generated for square tiles of this many pixels per
+// side, so that neighbouring rays of a queue are coherent.
+static constexpr int TILE_SIZE = RayPacket::SIZE;
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// A queue of rays in structure-of-arrays layout. Each ray carries the
+// index of the pixel of the wave that it contributes to.
+//////////////////////////////////////////////////////////////////////////////
+
+struct RayQueue
+{
+    vector<Real> ox, oy, oz;  // Origins.
+    vector<Real> dx, dy, dz;  // Unit directions.
+    vector<int> pixel;
+
+    [[nodiscard]] int size() const { return (int)pixel.size(); }
+
+    void resize( int n )
+    {
+        ox.resize( n ); oy.resize( n ); oz.resize( n );
+        dx.resize( n ); dy.resize( n ); dz.resize( n );
+        pixel.resize( n );
+    }
+
+    void set( int i, const Ray &r, int thePixel )
+    {
+        Vector3r o = r.origin(), d = r.direction();
+        ox[i] = o.x(); oy[i] = o.y(); oz[i] = o.z();
+        dx[i] = d.x(); dy[i] = d.y(); dz[i] = d.z();
+        pixel[i] = thePixel;
+    }
+
+    [[nodiscard]] Ray ray( int i ) const
+        { return { Vector3r( ox[i], oy[i], oz[i] ), Vector3r( dx[i], dy[i], dz[i] ) }; }
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// The hits of a generation of rays in structure-of-arrays layout, bucketed
+// by material, so that each bucket is shaded in batches with one material.
+//////////////////////////////////////////////////////////////////////////////
+
+struct HitQueue
+{
+    vector<Real> px, py, pz;  // Hit points.
+    vector<Real> nx, ny, nz;  // Unit normals.
+    vector<Real> vx, vy, vz;  // Unit vectors toward the ray origins.
+    vector<int> ray;          // Index of the ray in its queue.
+
+    // The hits [ materialBegin[m], materialBegin[m+1] ) have material m.
+    vector<int> materialBegin;
+
+    // Each hit is lit through numSlots slots. Slot s of hit k is for light
+    // slotLight[ k * numSlots + s ], or -1 if unused, or for light s if
+    // slotLight is empty. lighting[ s * size() + k ] is its lighting.
+    int numSlots = 0;
+    vector<int> slotLight;
+    vector<Color> lighting;
+
+    [[nodiscard]] int size() const { return (int)ray.size(); }
+
+    [[nodiscard]] int light( int k, int s ) const
+        { return slotLight.empty()? s : slotLight[ (size_t)k * numSlots + s ]; }
+
+    void resize( int n )
+    {
+        px.resize( n ); py.resize( n ); pz.resize( n );
+        nx.resize( n ); ny.resize( n ); nz.resize( n );
+        vx.resize( n ); vy.resize( n ); vz.resize( n );
+        ray.resize( n );
+    }
+
+    [[nodiscard]] Vector3r point( int k ) const { return { px[k], py[k], pz[k] }; }
+    [[nodiscard]] Vector3r normal( int k ) const { return { nx[k], ny[k], nz[k] }; }
+    [[nodiscard]] Vector3r toViewer( int k ) const { return { vx[k], vy[k], vz[k] }; }
+
+    [[nodiscard]] Shading::PointBatch points() const
+        { return { px.data(), py.data(), pz.data(), nx.data(), ny.data(), nz.data(), vx.data(), vy.data(), vz.data() }; }
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// The shadow rays of a generation of hits in structure-of-arrays layout.
+// Slot k * numSlots + s is for slot s of hit k of the HitQueue.
+//////////////////////////////////////////////////////////////////////////////
+
+struct ShadowQueue
+{
+    RayQueue rays;          // pixel is unused.
+    vector<Real> tmax;
+    vector<char> isActive;  // Whether the slot has a ray to test.
+    vector<char> occluded;
+
+    void resize( int n )
+    {
+        rays.resize( n );
+        tmax.resize( n );
+        isActive.assign( n, 0 );
+        occluded.assign( n, 0 );
+    }
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Generates the primary rays of the tiles [firstTile, lastTile) of the
+// image, in order, and the coordinates of the pixel of each.
+//////////////////////////////////////////////////////////////////////////////
+
+static void generateRays( const Camera &camera, int firstTile, int lastTile,
+                          RayQueue &rays, vector<int> &pixelX, vector<int> &pixelY )
+{
+    int imgWidth = camera.getImageWidth();
+    int imgHeight = camera.getImageHeight();
+    int numTilesX = ( imgWidth + TILE_SIZE - 1 ) / TILE_SIZE;
+
+    // Sized for full tiles, and trimmed to the rays of edge tiles at the end.
+    int maxRays = ( lastTile - firstTile ) * TILE_SIZE * TILE_SIZE;
+    rays.resize( maxRays );
+    pixelX.resize( maxRays );
+    pixelY.resize( maxRays );
+
+    int numRays = 0;
+    for ( int tile = firstTile; tile < lastTile; tile++ )
+    {
+        int x0 = ( tile % numTilesX ) * TILE_SIZE;
+        int y0 = ( tile / numTilesX ) * TILE_SIZE;
+        for ( int y = y0; y < min( y0 + TILE_SIZE, imgHeight ); y++ )
+        {
+            for ( int x = x0; x < min( x0 + TILE_SIZE, imgWidth ); x++ )
+            {
+                Ray ray = camera.getRay( x + Real( 0.5 ), y + Real( 0.5 ) );
+                rays.set( numRays, ray.makeUnitDirection(), numRays );
+                pixelX[ numRays ] = x;
+                pixelY[ numRays ] = y;
+                numRays++;
+            }
+        }
+    }
+    rays.resize( numRays );
+    pixelX.resize( numRays );
+    pixelY.resize( numRays );
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Sorts the rays of the queue by the octant of their direction, and then
+// by the Morton code of their origin within the bounds of all origins, at
+// 9 bits per axis. The 30-bit keys are radix sorted 8 bits at a time.
+// sorted, keys and sortedKeys are scratch space.
+//////////////////////////////////////////////////////////////////////////////
+
+static void sortRays( RayQueue &rays, RayQueue &sorted, vector<uint64_t> &keys, vector<uint64_t> &sortedKeys )
+{
+    int numRays = rays.size();
+    if ( numRays < 2 ) return;
+
+    auto xBounds = minmax_element( rays.ox.begin(), rays.ox.end() );
+    auto yBounds = minmax_element( rays.oy.begin(), rays.oy.end() );
+    auto zBounds = minmax_element( rays.oz.begin(), rays.oz.end() );
+    Vector3r origin( *xBounds.first, *yBounds.first, *zBounds.first );
+    Vector3r extent = Vector3r( *xBounds.second, *yBounds.second, *zBounds.second ) - origin;
+    Vector3r invExtent( ( extent.x() > 0 )? 1 / extent.x() : 0,
+                        ( extent.y() > 0 )? 1 / extent.y() : 0,
+                        ( extent.z() > 0 )? 1 / extent.z() : 0 );
+
+    // Sort (key, ray) pairs packed into 64-bit keys.
+    keys.resize( numRays );
+    #ifndef __APPLE__
+    #pragma omp parallel for
+    #endif
+    for ( int i = 0; i < numRays; i++ )
+    {
+        Vector3r c = ( Vector3r( rays.ox[i], rays.oy[i], rays.oz[i] ) - origin ) * invExtent;
+        uint32_t cell = Util::MortonCode( c.x(), c.y(), c.z() ) >> 3;
+        uint32_t octant = std::signbit( rays.dx[i] ) << 2 | std::signbit( rays.dy[i] ) << 1 | std::signbit( rays.dz[i] );
+        keys[i] = ( (uint64_t)( octant << 27 | cell ) << 32 ) | (uint32_t)i;
+    }
+    sortedKeys.resize( numRays );
+    for ( int shift = 32; shift < 62; shift += 8 )
+    {
+        int offsets[256] = {};
+        for ( int i = 0; i < numRays; i++ ) offsets[ ( keys[i] >> shift ) & 0xFF ]++;
+        for ( int digit = 0, offset = 0; digit < 256; digit++ )
+        {
+            int count = offsets[ digit ];
+            offsets[ digit ] = offset;
+            offset += count;
+        }
+        for ( int i = 0; i < numRays; i++ ) sortedKeys[ offsets[ ( keys[i] >> shift ) & 0xFF ]++ ] = keys[i];
+        keys.swap( sortedKeys );
+    }
+
+    sorted.resize( numRays );
+    for ( int i = 0; i < numRays; i++ )
+    {
+        int j = (int)(uint32_t)keys[i];
+        sorted.set( i, rays.ray( j ), rays.pixel[j] );
+    }
+    swap( rays, sorted );
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Finds the nearest hit of each ray of the queue.
+//////////////////////////////////////////////////////////////////////////////
+
+static void intersectRays( const CompiledScene &scene, const RayQueue &rays,
+                           vector<SurfaceHitRecord> &hits, vector<char> &hasHit )
+{
+    int numRays = rays.size();
+    hits.resize( numRays );
+    hasHit.resize( numRays );
+
+    #ifndef __APPLE__
+    #pragma omp parallel for
+    #endif
+    for ( int i = 0; i < numRays; i++ )
+    {
+        hasHit[i] = scene.hit( rays.ray( i ), Shading::DEFAULT_TMIN, Shading::DEFAULT_TMAX, hits[i] );
+    }
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Moves the hits of the rays of the queue into the HitQueue, bucketed by
+// material with a counting sort, and normalizes their normals.
+//////////////////////////////////////////////////////////////////////////////
+
+static void bucketHits( const CompiledScene &scene, const RayQueue &rays, const vector<SurfaceHitRecord> &hits,
+                        const vector<char> &hasHit, HitQueue &hitQueue, vector<int> &hitIndex )
+{
+    int numRays = rays.size();
+    int numMaterials = (int)scene.materials.size();
+
+    vector<int> &begin = hitQueue.materialBegin;
+    begin.assign( numMaterials + 1, 0 );
+    for ( int i = 0; i < numRays; i++ )
+    {
+        if ( hasHit[i] ) begin[ hits[i].material + 1 ]++;
+    }
+    for ( int m = 0; m < numMaterials; m++ ) begin[ m + 1 ] += begin[m];
+
+    hitIndex.resize( numRays );
+    vector<int> next( begin.begin(), begin.end() - 1 );
+    for ( int i = 0; i < numRays; i++ )
+    {
+        hitIndex[i] = hasHit[i]? next[ hits[i].material ]++ : -1;
+    }
+
+    hitQueue.resize( begin[ numMaterials ] );
+    #ifndef __APPLE__
+    #pragma omp parallel for
+    #endif
+    for ( int i = 0; i < numRays; i++ )
+    {
+        int k = hitIndex[i];
+        if ( k < 0 ) continue;
+
+        const SurfaceHitRecord &hit = hits[i];
+        Vector3r N = hit.normal.unitVector();
+        hitQueue.px[k] = hit.p.x(); hitQueue.py[k] = hit.p.y(); hitQueue.pz[k] = hit.p.z();
+        hitQueue.nx[k] = N.x(); hitQueue.ny[k] = N.y(); hitQueue.nz[k] = N.z();
+        hitQueue.vx[k] = -rays.dx[i]; hitQueue.vy[k] = -rays.dy[i]; hitQueue.vz[k] = -rays.dz[i];
+        hitQueue.ray[k] = i;
+    }
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Computes the lighting of each hit of the queue through its slots, by a
+// cut of the light tree of the scene for each hit.
+//////////////////////////////////////////////////////////////////////////////
+
+static void shadeHitsByCuts( const CompiledScene &scene, HitQueue &hitQueue )
+{
+    const LightTree &lightTree = scene.lightTree();
+    int numHits = hitQueue.size();
+    int numSlots = lightTree.maxCut();
+    hitQueue.numSlots = numSlots;
+    hitQueue.slotLight.resize( (size_t)numHits * numSlots );
+    hitQueue.lighting.resize( (size_t)numHits * numSlots );
+
+    for ( int m = 0; m < (int)scene.materials.size(); m++ )
+    {
+        const Material &material = scene.materials[m];
+        #ifndef __APPLE__
+        #pragma omp parallel for schedule( dynamic, 64 )
+        #endif
+        for ( int k = hitQueue.materialBegin[m]; k < hitQueue.materialBegin[ m + 1 ]; k++ )
+        {
+            LightTree::CutLight cut[ LightTree::MAX_CUT ];
+            int cutSize = lightTree.selectCut( hitQueue.point( k ), hitQueue.normal( k ), hitQueue.toViewer( k ), 
+                                               material, cut );
+            for ( int s = 0; s < numSlots; s++ )
+            {
+                bool isUsed = ( s < cutSize );
+                hitQueue.slotLight[ (size_t)k * numSlots + s ] = isUsed? cut[s].light : -1;
+                hitQueue.lighting[ (size_t)s * numHits + k ] = isUsed? cut[s].lighting : Color( 0.0f, 0.0f, 0.0f );
+            }
+        }
+    }
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Computes the lighting of each hit of the queue by each light, in batches
+// of up to SHADE_BATCH hits of one material, or by cuts of the light tree
+// if it is enabled.
+//////////////////////////////////////////////////////////////////////////////
+
+static constexpr int SHADE_BATCH = 256;
+
+static void shadeHits( const CompiledScene &scene, HitQueue &hitQueue )
+{
+    if ( scene.lightTree().isEnabled() )
+    {
+        shadeHitsByCuts( scene, hitQueue );
+        return;
+    }
+
+    int numHits = hitQueue.size();
+    int numLights = (int)scene.ptLights.size();
+    int numMaterials = (int)scene.materials.size();
+    hitQueue.numSlots = numLights;
+    hitQueue.slotLight.clear();
+    hitQueue.lighting.resize( (size_t)numHits * numLights );
+
+    // Split the buckets into batches, given by their first hit and material.
+    vector<pair<int, int>> batches;
+    for ( int m = 0; m < numMaterials; m++ )
+    {
+        for ( int k = hitQueue.materialBegin[m]; k < hitQueue.materialBegin[ m + 1 ]; k += SHADE_BATCH )
+        {
+            batches.emplace_back( k, m );
+        }
+    }
+
+    Shading::PointBatch points = hitQueue.points();
+    #ifndef __APPLE__
+    #pragma omp parallel for schedule( dynamic )
+    #endif
+    for ( int b = 0; b < (int)batches.size(); b++ )
+    {
+        int begin = batches[b].first;
+        int material = batches[b].second;
+        int end = min( begin + SHADE_BATCH, hitQueue.materialBegin[ material + 1 ] );
+        for ( int l = 0; l < numLights; l++ )
+        {
+            Shading::PhongLightingBatch( points, begin, end, scene.materials[ material ], scene.ptLights[l],
+                                         &hitQueue.lighting[ (size_t)l * numHits ] );
+        }
+    }
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Queues the shadow rays of each hit of the queue, if hasShadow is true,
+// but those that Shading culls by their lighting, and, if reflect is true,
+// its reflected ray, in the slot of its ray. Returns the number of shadow
+// rays culled.
+//////////////////////////////////////////////////////////////////////////////
+
+static long long spawnRays( const CompiledScene &scene, const RayQueue &rays, const HitQueue &hitQueue,
+                       bool hasShadow, bool reflect, ShadowQueue &shadows, 
+                       RayQueue &reflected, vector<char> &hasReflected )
+{
+    int numHits = hitQueue.size();
+    int numSlots = hitQueue.numSlots;
+    shadows.resize( hasShadow? numHits * numSlots : 0 );
+    reflected.resize( rays.size() );
+    hasReflected.assign( rays.size(), 0 );
+    long long numCulled = 0;
+
+    #ifndef __APPLE__
+    #pragma omp parallel for reduction( +: numCulled )
+    #endif
+    for ( int k = 0; k < numHits; k++ )
+    {
+        Vector3r p = hitQueue.point( k );
+        Vector3r N = hitQueue.normal( k );
+
+        for ( int s = 0; s < numSlots && hasShadow; s++ )
+        {
+            int l = hitQueue.light( k, s );
+            if ( l < 0 ) continue;
+            if ( Shading::IsShadowRayCulled( hitQueue.lighting[ (size_t)s * numHits + k ] ) )
+            {
+                numCulled++;
+                continue;
+            }
+            const PointLightSource &lightsrc = scene.ptLights[l];
+            Vector3r L = ( lightsrc.position - p ).unitVector();
+            Ray shadowRay( Shading::OffsetRayOrigin( p, N, L ), L );
+            int slot = k * numSlots + s;
+            shadows.rays.set( slot, shadowRay, 0 );
+            shadows.tmax[ slot ] = ( lightsrc.position - shadowRay.origin() ).length();
+            shadows.isActive[ slot ] = 1;
+        }
+
+        if ( reflect )
+        {
+            int i = hitQueue.ray[k];
+            Vector3r reflectedVector = Shading::MirrorReflect( hitQueue.toViewer( k ), N );
+            Ray reflectedRay( Shading::OffsetRayOrigin( p, N, reflectedVector ), reflectedVector );
+            reflected.set( i, reflectedRay.makeUnitDirection(), rays.pixel[i] );
+            hasReflected[i] = 1;
+        }
+    }
+    return numCulled;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Tests the active shadow rays of the queue for occlusion.
+//////////////////////////////////////////////////////////////////////////////
+
+static void traceShadowRays( const CompiledScene &scene, ShadowQueue &shadows )
+{
+    int numSlots = shadows.rays.size();
+
+    #ifndef __APPLE__
+    #pragma omp parallel for
+    #endif
+    for ( int slot = 0; slot < numSlots; slot++ )
+    {
+        if ( !shadows.isActive[ slot ] ) continue;
+        shadows.occluded[ slot ] = scene.shadowHit( shadows.rays.ray( slot ), Shading::DEFAULT_TMIN, shadows.tmax[ slot ] );
+    }
+}
+
+
+
+void Wavefront::RenderImage( Image &image, const CompiledScene &scene,
+                             int reflectLevels, bool hasShadow, 
+                             bool sortReflected, Stats *stats )
+{
+    const Camera &camera = scene.camera;
+    int numTilesX = ( camera.getImageWidth() + TILE_SIZE - 1 ) / TILE_SIZE;
+    int numTilesY = ( camera.getImageHeight() + TILE_SIZE - 1 ) / TILE_SIZE;
+    int numTiles = numTilesX * numTilesY;
+    int tilesPerWave = Util::Max2( 1, RAYS_PER_WAVE / ( TILE_SIZE * TILE_SIZE ) );
+    int numLevels = reflectLevels + 1;
+
+    RayQueue rays, reflected, sorted;
+    HitQueue hitQueue;
+    ShadowQueue shadows;
+    vector<uint64_t> sortKeys, sortedKeys;
+    Stats waveStats;
+    vector<int> pixelX, pixelY;
+    vector<SurfaceHitRecord> hits;
+    vector<char> hasHit, hasReflected;
+    vector<int> hitIndex;
+
+    // The color of each pixel of the wave is local[0] + k_rg[0] * ( local[1]
+    // + k_rg[1] * ( ... ) ), over the generations of its ray, where local[d]
+    // is the lighting at the hit of generation d and k_rg[d] its material's
+    // reflectance. They are kept per pixel and generation, and summed from
+    // the last generation back, as the recursive tracer does.
+    vector<Color> local, reflectance;
+    vector<int> numGenerations;
+
+    for ( int firstTile = 0; firstTile < numTiles; firstTile += tilesPerWave )
+    {
+        generateRays( camera, firstTile, min( firstTile + tilesPerWave, numTiles ), rays, pixelX, pixelY );
+        int numPixels = rays.size();
+        local.assign( (size_t)numPixels * numLevels, Color( 0.0f, 0.0f, 0.0f ) );
+        reflectance.assign( (size_t)numPixels * numLevels, Color( 0.0f, 0.0f, 0.0f ) );
+        numGenerations.assign( numPixels, 0 );
+
+        for ( int depth = 0; depth <= reflectLevels && rays.size() > 0; depth++ )
+        {
+            if ( depth == 0 )
+            {
+                intersectRays( scene, rays, hits, hasHit );
+                waveStats.primaryRays += rays.size();
+            }
+            else
+            {
+                double startTime = Util::GetCurrRealTime();
+                if ( sortReflected ) sortRays( rays, sorted, sortKeys, sortedKeys );
+                double sortedTime = Util::GetCurrRealTime();
+                intersectRays( scene, rays, hits, hasHit );
+                waveStats.sortTime += sortedTime - startTime;
+                waveStats.reflectedTime += Util::GetCurrRealTime() - sortedTime;
+                waveStats.reflectedRays += rays.size();
+            }
+
+            double startTime = Util::GetCurrRealTime();
+            bucketHits( scene, rays, hits, hasHit, hitQueue, hitIndex );
+            shadeHits( scene, hitQueue );
+            waveStats.shadeTime += Util::GetCurrRealTime() - startTime;
+            long long numCulled = spawnRays( scene, rays, hitQueue, hasShadow, depth < reflectLevels, 
+                                             shadows, reflected, hasReflected );
+            if ( hasShadow )
+            {
+                traceShadowRays( scene, shadows );
+                long long numTraced = count( shadows.isActive.begin(), shadows.isActive.end(), 1 );
+                waveStats.shadowRays += numTraced;
+                waveStats.culledShadowRays += numCulled;
+                Shading::RecordShadowRays( numTraced, numCulled );
+            }
+
+            // Gather the lighting of each hit, and the background for each miss.
+            int numHits = hitQueue.size();
+            int numSlots = hitQueue.numSlots;
+            #ifndef __APPLE__
+            #pragma omp parallel for
+            #endif
+            for ( int i = 0; i < rays.size(); i++ )
+            {
+                int pixel = rays.pixel[i];
+                size_t entry = (size_t)pixel * numLevels + depth;
+                numGenerations[ pixel ] = depth + 1;
+                int k = hitIndex[i];
+                if ( k < 0 )
+                {
+                    local[ entry ] = scene.backgroundColor;
+                    continue;
+                }
+
+                const Material &material = scene.materials[ hits[i].material ];
+                Color result( 0.0f, 0.0f, 0.0f );
+                for ( int s = 0; s < numSlots; s++ )
+                {
+                    if ( hitQueue.light( k, s ) < 0 ) continue;
+                    Color kshadow( 1.0, 1.0, 1.0 );
+                    if ( hasShadow && shadows.occluded[ k * numSlots + s ] ) kshadow.setRGB( 0.0, 0.0, 0.0 );
+                    result += kshadow * hitQueue.lighting[ (size_t)s * numHits + k ];
+                }
+                result += scene.amLight.I_a * material.k_a;
+                local[ entry ] = result;
+                reflectance[ entry ] = material.k_rg;
+            }
+
+            // The reflected rays are the next generation.
+            rays.resize( (int)count( hasReflected.begin(), hasReflected.end(), 1 ) );
+            for ( int i = 0, j = 0; i < (int)hasReflected.size(); i++ )
+            {
+                if ( hasReflected[i] ) rays.set( j++, reflected.ray( i ), reflected.pixel[i] );
+            }
+        }
+
+        for ( int pixel = 0; pixel < numPixels; pixel++ )
+        {
+            const Color *pixelLocal = &local[ (size_t)pixel * numLevels ];
+            const Color *pixelReflectance = &reflectance[ (size_t)pixel * numLevels ];
+            Color pixelColor = pixelLocal[ numGenerations[ pixel ] - 1 ];
+            for ( int depth = numGenerations[ pixel ] - 2; depth >= 0; depth-- )
+            {
+                Color result = pixelLocal[ depth ];
+                result += pixelReflectance[ depth ] * pixelColor;
+                pixelColor = result;
+            }
+            pixelColor.clamp();
+            image.setPixel( pixelX[ pixel ], pixelY[ pixel ], pixelColor );
+        }
+    }
+
+    if ( stats != nullptr )
+    {
+        stats->primaryRays += waveStats.primaryRays;
+        stats->reflectedRays += waveStats.reflectedRays;
+        stats->shadowRays += waveStats.shadowRays;
+        stats->culledShadowRays += waveStats.culledShadowRays;
+        stats->sortTime += waveStats.sortTime;
+        stats->reflectedTime += waveStats.reflectedTime;
+        stats->shadeTime += waveStats.shadeTime;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef _WAVEFRONT_H_
+#define _WAVEFRONT_H_
+
+#include "Image.h"
+#include "CompiledScene.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// A breadth-first renderer. Instead of following each pixel's rays depth
+// first, as Raytrace::TraceRay() does, it renders the image in waves of
+// RAYS_PER_WAVE pixels, and takes all rays of a wave through each stage
+// before the next: generate the primary rays, intersect them, bucket the
+// hits by material, shade each bucket in batches, queue the shadow and
+// reflected rays of the hits, test the shadow rays, then intersect the
+// reflected rays as the next generation, and so on. The queues are kept
+// in structure-of-arrays layout, and each stage is one data-parallel loop
+// over its queue. Shading is thus deferred until all hits are found, and
+// each batch evaluates the lighting of many points with one material, by
+// Shading::PhongLightingBatch().
+//
+// The reflected rays of a wave scatter across the scene. They can be
+// sorted before they are traced, by direction octant and then by the
+// Morton code of their origin, so that rays that leave the same region in
+// similar directions follow each other through the BVH and find its nodes
+// and surfaces still in cache.
+//
+// The contributions to a pixel are combined in the same order as by the
+// recursive tracer, which stays the reference. The images differ only by
+// the float rounding of the batch lighting kernel (see Shading.h), sorted
+// or not.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class Wavefront
+{
+public:
+
+    // Number of pixels per wave. The queues of a wave then take a few MB.
+    static constexpr int RAYS_PER_WAVE = 16384;
+
+
+    // Ray counts and timings of a rendering.
+    struct Stats
+    {
+        long long primaryRays = 0;
+        long long reflectedRays = 0;
+        long long shadowRays = 0;
+        long long culledShadowRays = 0;  // Not traced, by Shading::IsShadowRayCulled().
+        double sortTime = 0.0;       // Seconds spent sorting reflected rays.
+        double reflectedTime = 0.0;  // Seconds spent intersecting reflected rays.
+        double shadeTime = 0.0;      // Seconds spent bucketing and shading hits.
+    };
+
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Renders the scene into image, which must have the image size of the
+    // scene camera. reflectLevels and hasShadow are as for TraceRay(). The
+    // reflected rays are sorted for coherence if sortReflected is true.
+    // If stats is given, the counts and timings are added to it.
+    //////////////////////////////////////////////////////////////////////////////
+
+    static void RenderImage( Image &image, const CompiledScene &scene,
+                             int reflectLevels, bool hasShadow, 
+                             bool sortReflected, Stats *stats = nullptr );
+
+}; // Wavefront
+
+
+#endif // _WAVEFRONT_H_